@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/* The allocations of a block start right after its (aligned) header */
+#define ARENA_BLOCK_DATA(block) ((char*)(block) + ARENA_ALIGN(sizeof(ArenaBlock)))
+
+void arena_init(Arena* arena) {
+    arena->current = NULL;
+    arena->last = NULL;
+}
+
+/* Starts a new block with room for at least 'size' bytes. */
+ArenaBlock* arena_add_block(Arena* arena, size_t size) {
+    ArenaBlock* block = NULL;
+    size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+    block = (ArenaBlock*)malloc(ARENA_ALIGN(sizeof(ArenaBlock)) + capacity);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->previous = arena->current;
+    block->capacity = capacity;
+    block->used = 0;
+    arena->current = block;
+    return block;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    ArenaBlock* block = arena->current;
+    size_t aligned_size = ARENA_ALIGN(size);
+
+    if (block == NULL || block->used + aligned_size > block->capacity) {
+        block = arena_add_block(arena, aligned_size);
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+
+    arena->last = ARENA_BLOCK_DATA(block) + block->used;
+    block->used += aligned_size;
+    return arena->last;
+}
+
+void* arena_resize(Arena* arena, void* ptr, size_t old_size, size_t new_size) {
+    ArenaBlock* block = arena->current;
+    size_t offset = 0;
+    void* new_ptr = NULL;
+
+    if (ptr != NULL && ptr == arena->last) {
+        offset = (char*)ptr - ARENA_BLOCK_DATA(block);
+        if (offset + ARENA_ALIGN(new_size) <= block->capacity) {
+            block->used = offset + ARENA_ALIGN(new_size);
+            return ptr;
+        }
+    }
+
+    new_ptr = arena_alloc(arena, new_size);
+    if (new_ptr != NULL && ptr != NULL) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return new_ptr;
+}
+
+char* arena_strdup(Arena* arena, const char* str) {
+    size_t size = strlen(str) + 1;
+    char* result = (char*)arena_alloc(arena, size);
+
+    if (result != NULL) {
+        memcpy(result, str, size);
+    }
+    return result;
+}
+
+size_t arena_used(Arena* arena) {
+    ArenaBlock* block = NULL;
+    size_t used = 0;
+
+    for (block = arena->current; block != NULL; block = block->previous) {
+        used += block->used;
+    }
+    return used;
+}
+
+void arena_reset(Arena* arena) {
+    ArenaBlock* block = arena->current;
+    ArenaBlock* previous = NULL;
+    size_t total_capacity = 0;
+
+    arena->last = NULL;
+    if (block == NULL) {
+        return;
+    }
+
+    if (block->previous == NULL) {
+        block->used = 0;
+        return;
+    }
+
+    /* The last job needed more than one block, replace them with a single block that fits it all */
+    while (block != NULL) {
+        previous = block->previous;
+        total_capacity += block->capacity;
+        free(block);
+        block = previous;
+    }
+    arena->current = NULL;
+    arena_add_block(arena, total_capacity);
+}
+
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->current;
+    ArenaBlock* previous = NULL;
+
+    while (block != NULL) {
+        previous = block->previous;
+        free(block);
+        block = previous;
+    }
+    arena_init(arena);
+}
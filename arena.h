@@ -0,0 +1,42 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+/* A bump allocator for the memory of a single assembly job.
+ * Nothing is freed separately: arena_reset releases everything at once (and keeps the memory for the next job),
+ * arena_free gives it back to the system. */
+
+typedef struct arenablock_t {
+    struct arenablock_t* previous;
+    size_t capacity; /* the usable bytes after the header */
+    size_t used;
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* current; /* the block allocations come from. older blocks are chained through 'previous' */
+    char* last; /* the last allocation, the only one that can be resized in place */
+} Arena;
+
+void arena_init(Arena* arena);
+
+/* Returns 'size' uninitialized bytes, or NULL if the system is out of memory. */
+void* arena_alloc(Arena* arena, size_t size);
+
+/* Resizes 'ptr' (an allocation of 'old_size' bytes, or NULL) to 'new_size' bytes.
+ * The last allocation is resized in place when it fits, otherwise the contents are copied to a new allocation.
+ * Returns NULL (and leaves 'ptr' as is) if the system is out of memory. */
+void* arena_resize(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+
+char* arena_strdup(Arena* arena, const char* str);
+
+/* Returns the number of bytes allocated since the last arena_reset (including the alignment). */
+size_t arena_used(Arena* arena);
+
+/* Releases all the allocations. the memory is kept (merged into a single block), so a job of the
+ * same size as the previous ones doesn't call malloc at all. */
+void arena_reset(Arena* arena);
+
+void arena_free(Arena* arena);
+
+#endif
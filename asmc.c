@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "linereader.h"
+#include "filelist.h"
+#include "protocol.h"
+
+/* The client of the assembler server (a.out --serve): sends every source over a single connection, and writes
+ * the outputs it gets back next to the source, like a.out itself does:
+ *   asmc --socket /tmp/asm.sock prog.as     writes prog.ob (and prog.ent, prog.ext when needed) */
+
+/* Big enough for "assemble 1 1 <size> " and any path */
+#define REQUEST_HEADER_SIZE (PROTOCOL_LINE_SIZE + 64)
+
+/* The kinds of frames that are written to files: the kind is also the extension of the file */
+const char* file_kinds[] = {"am", "ob", "ent", "ext", "obb"};
+
+void print_usage(void) {
+    printf("usage: asmc --socket SOCKET [--emit-am] [--emit-obb] <file1.as> <file2.as> ... <fileN.as>\n");
+    printf("       a source file named @<manifest> is replaced by the paths listed in <manifest> (one per line)\n");
+    printf("       the sources are assembled by the server listening on SOCKET (a.out --serve SOCKET)\n");
+}
+
+bool is_file_kind(const char* kind) {
+    int i = 0;
+
+    for (i = 0; i < (int)(sizeof(file_kinds) / sizeof(file_kinds[0])); i++) {
+        if (strcmp(kind, file_kinds[i]) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Reads the frames of a response until its status frame. the outputs are written next to 'source_path',
+ * and the diagnostics to stdout. '*assembled' is the status the server reported. */
+Status read_response(SocketReader* reader, Arena* arena, char* source_path, Status* assembled) {
+    char header[PROTOCOL_LINE_SIZE];
+    char kind[PROTOCOL_LINE_SIZE];
+    long size = 0;
+    byte* content = NULL;
+    char* output_path = NULL;
+    Status status = STATUS_SUCCESS;
+
+    while (TRUE) {
+        if (socketreader_read_line(reader, header, PROTOCOL_LINE_SIZE) != STATUS_SUCCESS ||
+            sscanf(header, "%s %ld", kind, &size) != 2 || size < 0) {
+            printf("%s: invalid response from the server\n", source_path);
+            return STATUS_FAILURE;
+        }
+
+        content = (byte*)malloc(size > 0 ? size : 1);
+        if (content == NULL) {
+            printf("%s: failed to allocate memory for the %s output\n", source_path, kind);
+            return STATUS_FAILURE;
+        }
+        if (socketreader_read(reader, (char*)content, size) != STATUS_SUCCESS) {
+            printf("%s: the server closed the connection\n", source_path);
+            free(content);
+            return STATUS_FAILURE;
+        }
+
+        if (strcmp(kind, "status") == 0) {
+            *assembled = (size == 1 && content[0] == '0') ? STATUS_SUCCESS : STATUS_FAILURE;
+            free(content);
+            return status;
+        }
+
+        if (strcmp(kind, "diagnostics") == 0) {
+            fwrite(content, 1, size, stdout);
+        } else if (is_file_kind(kind)) {
+            output_path = change_extension(arena, source_path, kind);
+            if (output_path == NULL || write_buffer_to_file(content, size, output_path) != STATUS_SUCCESS) {
+                status = STATUS_FAILURE;
+            }
+        }
+        /* (frames of other kinds are skipped) */
+        free(content);
+    }
+}
+
+/* Sends one source to the server, and writes what comes back. */
+Status assemble_remote(int fd, SocketReader* reader, Arena* arena, char* source_path, bool emit_am, bool emit_obb) {
+    LineReader source = {0};
+    char header[REQUEST_HEADER_SIZE];
+    StringView views[2];
+    Status assembled = STATUS_FAILURE;
+    Status status = STATUS_SUCCESS;
+
+    if (validate_extension(source_path, "as") != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    if (strchr(source_path, '\n') != NULL || strlen(source_path) >= PROTOCOL_LINE_SIZE - 64) {
+        printf("%s: the path can't be sent to the server\n", source_path);
+        return STATUS_FAILURE;
+    }
+    if (linereader_open(&source, source_path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    if (source.size > PROTOCOL_MAX_SOURCE_SIZE) {
+        printf("%s: the source is too large for the server\n", source_path);
+        linereader_close(&source);
+        return STATUS_FAILURE;
+    }
+
+    views[0].start = header;
+    views[0].length = sprintf(header, "assemble %d %d %ld %s\n", emit_am ? 1 : 0, emit_obb ? 1 : 0, source.size, source_path);
+    views[1].start = source.buffer;
+    views[1].length = (int)source.size;
+
+    if (write_views(fd, views, 2) != STATUS_SUCCESS) {
+        printf("%s: failed to send the source to the server\n", source_path);
+        status = STATUS_FAILURE;
+    } else {
+        status = read_response(reader, arena, source_path, &assembled);
+    }
+
+    linereader_close(&source);
+    return (status == STATUS_SUCCESS && assembled == STATUS_SUCCESS) ? STATUS_SUCCESS : STATUS_FAILURE;
+}
+
+int main(int argc, char **argv) {
+    int i = 0;
+    int status = 0;
+    char* socket_path = NULL;
+    bool emit_am = FALSE;
+    bool emit_obb = FALSE;
+    char** source_paths = NULL;
+    int num_files = 0;
+    int paths_capacity = 0;
+    SocketReader* reader = NULL;
+    Arena arena;
+    int fd = -1;
+
+    arena_init(&arena);
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--emit-am") == 0) {
+            emit_am = TRUE;
+        } else if (strcmp(argv[i], "--emit-obb") == 0) {
+            emit_obb = TRUE;
+        } else if (strcmp(argv[i], "--socket") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                status = 1;
+                goto CLEANUP;
+            }
+            i++;
+            socket_path = argv[i];
+        } else if (argv[i][0] == '@') {
+            if (read_manifest(argv[i] + 1, &source_paths, &num_files, &paths_capacity) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+        } else {
+            if (append_path(argv[i], &source_paths, &num_files, &paths_capacity) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+        }
+    }
+
+    if (socket_path == NULL || num_files == 0) {
+        print_usage();
+        status = 1;
+        goto CLEANUP;
+    }
+
+    reader = (SocketReader*)malloc(sizeof(SocketReader));
+    if (reader == NULL) {
+        printf("failed to allocate memory for the connection\n");
+        status = 1;
+        goto CLEANUP;
+    }
+
+    fd = protocol_connect(socket_path);
+    if (fd < 0) {
+        status = 1;
+        goto CLEANUP;
+    }
+    socketreader_init(reader, fd);
+
+    /* One connection for all the sources, so they all go to the same warm assembler */
+    for (i = 0; i < num_files; i++) {
+        arena_reset(&arena);
+        if (assemble_remote(fd, reader, &arena, source_paths[i], emit_am, emit_obb) != STATUS_SUCCESS) {
+            status = 1;
+        }
+    }
+
+CLEANUP:
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(reader);
+    arena_free(&arena);
+    for (i = 0; i < num_files; i++) {
+        free(source_paths[i]);
+    }
+    free(source_paths);
+    return status;
+}
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,9 +9,10 @@
 #include "parser.h"
 #include "assembler.h"
 #include "secondpass.h"
-
-#define OPCODE_NUM 16
-#define REGISTERS_NUM 8
+#include "preassembler.h"
+#include "format.h"
+#include "objfile.h"
+#include "trace.h"
 
 /* 15bit max: 0011 1111 1111 1111 (3f ff) (+16383)
  * 15bit min: 0100 0000 0000 0000 (40 00) (-16384)
@@ -21,69 +23,47 @@
 #define IMMEDIATE_MAX (0x7ff)
 #define IMMEDIATE_MIN (-0x800)
 
-char *registers[] = {"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7"};
-
-OpcodeTableEntry opcodeTable[] = {
-    {"mov", 0, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
-    {"cmp", 1, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
-    {"add", 2, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
-    {"sub", 3, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
-    {"lea", 4, ADDRESSING_1, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
-    {"clr", 5, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
-    {"not", 6, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
-    {"inc", 7, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
-    {"dec", 8, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
-    {"jmp", 9, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2, 1},
-    {"bne", 10, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2, 1},
-    {"red", 11, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
-    {"prn", 12, ADDRESSING_NONE, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
-    {"jsr", 13, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2, 1},
-    {"rts", 14, ADDRESSING_NONE, ADDRESSING_NONE, 0},
-    {"stop", 15, ADDRESSING_NONE, ADDRESSING_NONE, 0}
-};
-
-Status labeltable_init(LabelTable* table) {
+Status labeltable_init(LabelTable* table, Interner* names, Arena* arena) {
+    table->arena = arena;
+    table->names = names;
     table->capacity = INITIAL_CAPACITY;
     table->count = 0;
-    table->labels = (LabelTableEntry*)malloc(table->capacity * sizeof(LabelTableEntry));
+    table->labels = (LabelTableEntry*)arena_alloc(arena, table->capacity * sizeof(LabelTableEntry));
     if (table->labels == NULL) {
-        printf("failed to allocate memory for labels\n");
+        print_diagnostic("failed to allocate memory for labels\n");
         return STATUS_FAILURE;
     }
 
-    return STATUS_SUCCESS;
+    return idmap_init(&table->by_name, arena);
 }
 
-Status labeltable_get_entry(LabelTable* table, const char* label, LabelTableEntry* out) {
-    int i = 0;
-    for (i = 0; i < table->count; i++) {
-        if (strcmp(table->labels[i].label_name, label) == 0) {
-            *out = table->labels[i];
-            return STATUS_SUCCESS;
-        }
+LabelTableEntry* labeltable_find_id(LabelTable* table, unsigned int name) {
+    int position = idmap_get(&table->by_name, name);
+    if (position < 0) {
+        return NULL;
     }
-    return STATUS_FAILURE;
+    return &table->labels[position];
 }
 
-bool is_label_duplicate(LabelTable* table, const char* label_name) {
-    int i = 0;
-    for (i = 0; i < table->count; i++) {
-        if (strcmp(table->labels[i].label_name, label_name) == 0) {
-            return TRUE;
-        }
+LabelTableEntry* labeltable_find(LabelTable* table, StringView label) {
+    unsigned int name = 0;
+    if (!interner_find(table->names, label, &name)) {
+        return NULL;
     }
-    return FALSE;
+    return labeltable_find_id(table, name);
+}
+
+bool is_label_duplicate(LabelTable* table, StringView label_name) {
+    return labeltable_find(table, label_name) != NULL;
 }
 
 Status expand_label_table(LabelTable* table) {
     LabelTableEntry* new_labels = NULL;
-    new_labels = (LabelTableEntry*)malloc(table->capacity * 2 * sizeof(LabelTableEntry));
+    new_labels = (LabelTableEntry*)arena_resize(table->arena, table->labels, table->capacity * sizeof(LabelTableEntry), table->capacity * 2 * sizeof(LabelTableEntry));
     if (new_labels == NULL) {
-        printf("failed to allocate memory for labels\n");
+        print_diagnostic("failed to allocate memory for labels\n");
         return STATUS_FAILURE;
     }
-    memcpy(new_labels, table->labels, table->capacity * sizeof(LabelTableEntry));
-    free(table->labels);
     table->labels = new_labels;
     table->capacity *= 2;
     return STATUS_SUCCESS;
@@ -91,73 +71,175 @@ Status expand_label_table(LabelTable* table) {
 
 /* TODO: support data-labels too (right now we just put 'dc' in the address...) */
 /* TODO: support entry and extern labels, and figure out how they need to look.. */
-Status assembler_add_label(Assembler* assembler, const char* label_name, LabelType type, CodeOrData code_or_data, const char* filepath, int linenumber) {
-    if (is_label_duplicate(&assembler->label_table, label_name)) {
-        printf("%s:%d: duplicate label\n", filepath, linenumber);
+Status assembler_add_label(Assembler* assembler, StringView label_name, LabelType type, CodeOrData code_or_data, const char* filepath, int linenumber) {
+    LabelTable* table = &assembler->label_table;
+    LabelTableEntry* entry = NULL;
+    unsigned int name = 0;
+
+    if (interner_intern(table->names, label_name, &name) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (labeltable_find_id(table, name) != NULL) {
+        print_diagnostic("%s:%d: duplicate label\n", filepath, linenumber);
         return STATUS_FAILURE;
     }
 
-    if (assembler->label_table.count >= assembler->label_table.capacity) {
-        if (expand_label_table(&assembler->label_table) != STATUS_SUCCESS) {
+    if (table->count >= table->capacity) {
+        if (expand_label_table(table) != STATUS_SUCCESS) {
             return STATUS_FAILURE;
         }
     }
 
+    if (idmap_set(&table->by_name, name, table->count) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    entry = &table->labels[table->count];
     if (code_or_data == LABEL_DATA) {
-        assembler->label_table.labels[assembler->label_table.count].address = assembler->dc;
+        entry->address = assembler->dc;
     } else {
-        assembler->label_table.labels[assembler->label_table.count].address = assembler->ic;
+        entry->address = assembler->ic;
+    }
+
+    entry->name = name;
+    entry->type = type;
+    entry->code_or_data = code_or_data;
+    table->count++;
+    return STATUS_SUCCESS;
+}
+
+void update_label_type(LabelTable* table, StringView label_name, LabelType type) {
+    LabelTableEntry* entry = labeltable_find(table, label_name);
+    if (entry != NULL) {
+        entry->type = type;
+    }
+}
+
+bool is_label_in_table(LabelTable* table, StringView label_name) {
+    return labeltable_find(table, label_name) != NULL;
+}
+
+Status section_init(Section* section, Arena* arena) {
+    section->arena = arena;
+    section->capacity = INITIAL_CAPACITY;
+    section->words = (Word*)arena_alloc(arena, section->capacity * sizeof(Word));
+    if (section->words == NULL) {
+        print_diagnostic("failed to allocate memory for a section\n");
+        return STATUS_FAILURE;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+Status section_reserve(Section* section, int size) {
+    Word* new_words = NULL;
+    int new_capacity = section->capacity;
+
+    if (size <= section->capacity) {
+        return STATUS_SUCCESS;
     }
 
-    strcpy(assembler->label_table.labels[assembler->label_table.count].label_name, label_name);
-    assembler->label_table.labels[assembler->label_table.count].type = type;
-    assembler->label_table.labels[assembler->label_table.count].code_or_data = code_or_data;
-    assembler->label_table.count++;
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+
+    new_words = (Word*)arena_resize(section->arena, section->words, section->capacity * sizeof(Word), new_capacity * sizeof(Word));
+    if (new_words == NULL) {
+        print_diagnostic("failed to allocate memory for a section\n");
+        return STATUS_FAILURE;
+    }
+    section->words = new_words;
+    section->capacity = new_capacity;
     return STATUS_SUCCESS;
 }
 
-void labeltable_free(LabelTable* table) {
-    free(table->labels);
-    table->labels = NULL;
+Status externtable_init(ExternTable* table, Arena* arena) {
+    table->arena = arena;
+    table->capacity = INITIAL_CAPACITY;
     table->count = 0;
-    table->capacity = 0;
+    table->refs = (ExternTableEntry*)arena_alloc(arena, table->capacity * sizeof(ExternTableEntry));
+    if (table->refs == NULL) {
+        print_diagnostic("failed to allocate memory for extern references\n");
+        return STATUS_FAILURE;
+    }
+
+    return STATUS_SUCCESS;
 }
 
-void update_label_type(LabelTable* table, const char* label_name, LabelType type) {
-    int i = 0;
-    for (i = 0; i < table->count; i++) {
-        if (strcmp(table->labels[i].label_name, label_name) == 0) {
-            table->labels[i].type = type;
-            return;
+Status externtable_add(ExternTable* table, unsigned int name, int address) {
+    ExternTableEntry* new_refs = NULL;
+
+    if (table->count >= table->capacity) {
+        new_refs = (ExternTableEntry*)arena_resize(table->arena, table->refs, table->capacity * sizeof(ExternTableEntry), table->capacity * 2 * sizeof(ExternTableEntry));
+        if (new_refs == NULL) {
+            print_diagnostic("failed to allocate memory for extern references\n");
+            return STATUS_FAILURE;
         }
+        table->refs = new_refs;
+        table->capacity *= 2;
     }
+
+    table->refs[table->count].name = name;
+    table->refs[table->count].address = address;
+    table->count++;
+    return STATUS_SUCCESS;
 }
 
-bool is_label_in_table(LabelTable* table, const char* label_name) {
-    int i = 0;
-    for (i = 0; i < table->count; i++) {
-        if (strcmp(table->labels[i].label_name, label_name) == 0) {
-            return TRUE;
-        }
+Status fixuptable_init(FixupTable* table, Arena* arena) {
+    table->arena = arena;
+    table->capacity = INITIAL_CAPACITY;
+    table->count = 0;
+    table->fixups = (Fixup*)arena_alloc(arena, table->capacity * sizeof(Fixup));
+    if (table->fixups == NULL) {
+        print_diagnostic("failed to allocate memory for fixups\n");
+        return STATUS_FAILURE;
     }
-    return FALSE;
+
+    return STATUS_SUCCESS;
 }
 
-Status get_opcode(const char* tokens, int* out_opcode) {
-    int i = 0;
-    for (i = 0; i < OPCODE_NUM; i++) {
-        if (strcmp(opcodeTable[i].name, tokens) == 0) {
-            *out_opcode = opcodeTable[i].code;
-            return STATUS_SUCCESS;
+/* Records a reference to 'label_name', to be resolved by the second pass. 'slot' is only used by FIXUP_OPERAND. */
+Status assembler_add_fixup(Assembler* assembler, FixupKind kind, StringView label_name, int slot, int line_number) {
+    FixupTable* table = &assembler->fixup_table;
+    Fixup* new_fixups = NULL;
+    unsigned int name = 0;
+
+    if (interner_intern(&assembler->names, label_name, &name) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (table->count >= table->capacity) {
+        new_fixups = (Fixup*)arena_resize(table->arena, table->fixups, table->capacity * sizeof(Fixup), table->capacity * 2 * sizeof(Fixup));
+        if (new_fixups == NULL) {
+            print_diagnostic("failed to allocate memory for fixups\n");
+            return STATUS_FAILURE;
         }
+        table->fixups = new_fixups;
+        table->capacity *= 2;
     }
-    return STATUS_FAILURE;
+
+    table->fixups[table->count].kind = kind;
+    table->fixups[table->count].name = name;
+    table->fixups[table->count].slot = slot;
+    table->fixups[table->count].line_number = line_number;
+    table->count++;
+    return STATUS_SUCCESS;
+}
+
+Status get_opcode(StringView token, int* out_opcode) {
+    Keyword keyword = keyword_lookup(token.start, token.length);
+    if (keyword.kind != KEYWORD_OPCODE) {
+        return STATUS_FAILURE;
+    }
+    *out_opcode = keyword.id;
+    return STATUS_SUCCESS;
 }
 
 Status handle_entry_directive(ParsedLine* parsed, LabelTable* label_table, const char* filepath, int line_number) {
-    char* label = parsed->params[0];
+    StringView label = parsed->params[0];
     if (!is_label_in_table(label_table, label)) {
-        printf("%s:%d: entry label '%s' not defined\n", filepath, line_number, label);
+        print_diagnostic("%s:%d: entry label '%.*s' not defined\n", filepath, line_number, label.length, label.start);
         return STATUS_FAILURE;
     }
 
@@ -166,9 +248,17 @@ Status handle_entry_directive(ParsedLine* parsed, LabelTable* label_table, const
 }
 
 Status handle_extern_directive(ParsedLine* parsed, Assembler* assembler, const char* filepath, int line_number) {
-    char* label = parsed->params[0]; 
+    StringView label;
+
+    /* The params of a line are views that parse_line doesn't clear, only the first 'num_params' are this line's */
+    if (parsed->num_params != 1) {
+        print_diagnostic("%s:%d: .extern directive must have exactly one parameter\n", filepath, line_number);
+        return STATUS_FAILURE;
+    }
+
+    label = parsed->params[0];
     if (is_label_in_table(&assembler->label_table, label)) {
-        printf("%s:%d: extern label '%s' already defined\n", filepath, line_number, label);
+        print_diagnostic("%s:%d: extern label '%.*s' already defined\n", filepath, line_number, label.length, label.start);
         return STATUS_FAILURE;
     }
 
@@ -181,27 +271,27 @@ Status handle_extern_directive(ParsedLine* parsed, Assembler* assembler, const c
 Status handle_data_directive(ParsedLine* parsed, Assembler* assembler, const char* filepath, int line_number) {
     int i = 0;
     long value = 0;
-    char* endptr = 0;
+
+    if (section_reserve(&assembler->data, assembler->dc + parsed->num_params) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
 
     for (i = 0; i < parsed->num_params; i++) {
-        /* convert the string to a long integer using strtol */
-        value = strtol(parsed->params[i], &endptr, 10);
-        
-        if (endptr == parsed->params[i] || *endptr != '\0' || value > WORD_MAX || value < WORD_MIN) {
-            printf("%s:%d: number out of range or invalid '%s'\n", filepath, line_number, parsed->params[i]);
+        if (view_to_long(parsed->params[i], WORD_MIN, WORD_MAX, &value) != STATUS_SUCCESS) {
+            print_diagnostic("%s:%d: number out of range or invalid '%.*s'\n", filepath, line_number, parsed->params[i].length, parsed->params[i].start);
             return STATUS_FAILURE;
         }
 
-        assembler->data[assembler->dc] = (short)value & 0x7fff;
+        assembler->data.words[assembler->dc] = (short)value & 0x7fff;
         assembler->dc++;
     }
 
     return STATUS_SUCCESS;
 }
 
-Status check_string_format(const char* str, const char* filepath, int line_number) {
-    if (str[0] != '"' || str[strlen(str) - 1] != '"') {
-        printf("%s:%d: invalid string format\n", filepath, line_number);
+Status check_string_format(StringView str, const char* filepath, int line_number) {
+    if (str.length < 2 || str.start[0] != '"' || str.start[str.length - 1] != '"') {
+        print_diagnostic("%s:%d: invalid string format\n", filepath, line_number);
         return STATUS_FAILURE;
     }
     return STATUS_SUCCESS;
@@ -209,38 +299,49 @@ Status check_string_format(const char* str, const char* filepath, int line_numbe
 
 /* TODO: support strings with spaces, commas
              label4: .string "abcdm ,,,,,, xyz" */
-void handle_string(char* str, Assembler* assembler) {
+Status handle_string(StringView str, Assembler* assembler) {
     int i = 0;
-    str++; /* skip the first " "*/
-    str[strlen(str) - 1] = '\0'; /* skip the last " "*/
 
-    for (i = 0; str[i] != '\0'; i++) {
-        assembler->data[assembler->dc] = (Word)str[i];
+    /* the characters between the quotes, and the '\0' */
+    if (section_reserve(&assembler->data, assembler->dc + str.length - 1) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    /* skip the first and the last " */
+    for (i = 1; i < str.length - 1; i++) {
+        assembler->data.words[assembler->dc] = (Word)str.start[i];
         assembler->dc++;
     }
-    assembler->data[assembler->dc] = '\0';
+    assembler->data.words[assembler->dc] = '\0';
     assembler->dc++;
+    return STATUS_SUCCESS;
 }
 
 Status handle_string_directive(ParsedLine* parsed, Assembler* assembler, const char* filepath, int line_number) {
-    char* str = parsed->params[0];
+    StringView str = parsed->params[0];
 
     if (parsed->num_params != 1) { 
-        printf("%s:%d: a string must receive only a single paramer. the parameter must not contain spaces or commas", filepath, line_number);
+        print_diagnostic("%s:%d: a string must receive only a single paramer. the parameter must not contain spaces or commas", filepath, line_number);
         return STATUS_FAILURE;
     }
 
     if (check_string_format(str, filepath, line_number) != STATUS_SUCCESS) {
         return STATUS_FAILURE;
     }
-    handle_string(str, assembler);
-
-    return STATUS_SUCCESS;
+    return handle_string(str, assembler);
 }
 
 Status assembler_init(Assembler* assembler) {
     memset(assembler, '\0', sizeof(Assembler));
-    if (labeltable_init(&assembler->label_table) != STATUS_SUCCESS) {
+    arena_init(&assembler->arena);
+    assembler->diagnostics = open_memstream(&assembler->diagnostics_buffer, &assembler->diagnostics_size);
+    if (assembler->diagnostics == NULL) {
+        print_diagnostic("failed to allocate memory for the assembler\n");
+        assembler_free(assembler);
+        return STATUS_FAILURE;
+    }
+    if (assembler_reset(assembler) != STATUS_SUCCESS) {
+        assembler_free(assembler);
         return STATUS_FAILURE;
     }
 
@@ -248,59 +349,69 @@ Status assembler_init(Assembler* assembler) {
 }
 
 void assembler_free(Assembler* assembler) {
-  labeltable_free(&assembler->label_table);
+  arena_free(&assembler->arena);
+  if (assembler->diagnostics != NULL) {
+      fclose(assembler->diagnostics);
+  }
+  free(assembler->diagnostics_buffer);
   memset(assembler, '\0', sizeof(Assembler));
 }
 
+Status assembler_reset(Assembler* assembler) {
+  Arena* arena = &assembler->arena;
+
+  /* Releases all the tables of the previous file at once */
+  arena_reset(arena);
+  /* The held back diagnostics of the previous file are dropped, their buffer is kept */
+  fseek(assembler->diagnostics, 0, SEEK_SET);
+  assembler->ic = 0;
+  assembler->dc = 0;
+  assembler->code_section_size = 0;
+
+  if (interner_init(&assembler->names, arena) != STATUS_SUCCESS ||
+      section_init(&assembler->code, arena) != STATUS_SUCCESS ||
+      section_init(&assembler->data, arena) != STATUS_SUCCESS ||
+      labeltable_init(&assembler->label_table, &assembler->names, arena) != STATUS_SUCCESS ||
+      externtable_init(&assembler->extern_table, arena) != STATUS_SUCCESS ||
+      fixuptable_init(&assembler->fixup_table, arena) != STATUS_SUCCESS ||
+      bytearray_init(&assembler->output, arena) != STATUS_SUCCESS) {
+      return STATUS_FAILURE;
+  }
+
+  return STATUS_SUCCESS;
+}
 
-byte get_register_indirect_addressing(const char* param) {
-    char* conversion_end = 0;
-    long reg_num = 0;
-    if (param[0] == '*' && param[1] == 'r') {
-        reg_num = strtol(&param[2], &conversion_end, 10); 
-        if (conversion_end != &param[2] && reg_num >= 0 && reg_num <= 7) {
-            return ADDRESSING_2; 
-        }
+
+/* "*r0" ... "*r7" */
+byte get_register_indirect_addressing(StringView param) {
+    if (param.length > 0 && param.start[0] == '*' && keyword_lookup(param.start + 1, param.length - 1).kind == KEYWORD_REGISTER) {
+        return ADDRESSING_2;
     }
     return ADDRESSING_NONE;
 }
 
-byte get_register_addressing(const char* param) {
-    char* conversion_end = 0;
-    int reg_num = 0;
-    if (param[0] == 'r') {
-        reg_num = strtol(&param[1], &conversion_end, 10);
-        if (conversion_end != &param[1] && reg_num >= 0 && reg_num <= 7) {
-            return ADDRESSING_3; 
-        }
+/* "r0" ... "r7" */
+byte get_register_addressing(StringView param) {
+    if (keyword_lookup(param.start, param.length).kind == KEYWORD_REGISTER) {
+        return ADDRESSING_3;
     }
     return ADDRESSING_NONE;
 }
 
-byte get_addressing_method(const char* param, const char* filepath, int linenumber) {
-    if (param[0] == '#') {
+/* Assumes the addressing of 'param' is 2 or 3. the register number is always the last character. */
+int get_register_number(StringView param) {
+    return param.start[param.length - 1] - '0';
+}
+
+byte get_addressing_method(StringView param, const char* filepath, int linenumber) {
+    if (param.length > 0 && param.start[0] == '#') {
         return ADDRESSING_0;
-    } else if (strcmp(param, "*r0") == 0 || 
-            strcmp(param, "*r1") == 0 ||
-            strcmp(param, "*r2") == 0 ||
-            strcmp(param, "*r3") == 0 ||
-            strcmp(param, "*r4") == 0 ||
-            strcmp(param, "*r5") == 0 ||
-            strcmp(param, "*r6") == 0 ||
-            strcmp(param, "*r7") == 0) {
+    } else if (get_register_indirect_addressing(param) == ADDRESSING_2) {
         return ADDRESSING_2;
-    } else if (strcmp(param, "r0") == 0 || 
-            strcmp(param, "r1") == 0 ||
-            strcmp(param, "r2") == 0 ||
-            strcmp(param, "r3") == 0 ||
-            strcmp(param, "r4") == 0 ||
-            strcmp(param, "r5") == 0 ||
-            strcmp(param, "r6") == 0 ||
-            strcmp(param, "r7") == 0) {
-
-            return ADDRESSING_3;
+    } else if (get_register_addressing(param) == ADDRESSING_3) {
+        return ADDRESSING_3;
     } else if (validate_label_name(param, filepath, linenumber) == STATUS_SUCCESS) {
-            return ADDRESSING_1;
+        return ADDRESSING_1;
     } else {
         return ADDRESSING_NONE;
     }
@@ -317,59 +428,31 @@ Word make_instruction_word(byte opcode, byte src_addressing, byte dst_addressing
 /* Assumes the addressings are either 2 or 3, and the parameters are valid. */
 Status prepare_shared_param_word(
     Assembler* assembler, 
-    const char* src_param, byte src_addressing, 
-    const char* dst_param, byte dst_addressing,
+    StringView src_param, byte src_addressing, 
+    StringView dst_param, byte dst_addressing,
     Word* out,
     const char* filepath, int linenumber) {
 
-    int src_reg_num = 0;
-    int dst_reg_num = 0;
-    char* endptr = 0;
-
-    if (src_addressing == ADDRESSING_2) {
-        src_reg_num = strtol(&src_param[2], &endptr, 10);
-        if (endptr == &src_param[2] || src_reg_num < 0 || src_reg_num > 7) {
-            printf("%s:%d: invalid register '%s'\n", filepath, linenumber, src_param);
-            return STATUS_FAILURE;
-        }
-    } else { /* src_addressing == ADDRESSING_3 */
-        src_reg_num = strtol(&src_param[1], &endptr, 10);
-        if (endptr == &src_param[1] || src_reg_num < 0 || src_reg_num > 7) {
-            printf("%s:%d: invalid register '%s'\n", filepath, linenumber, src_param);
-            return STATUS_FAILURE;
-        }
-    }
-
-    if (dst_addressing == ADDRESSING_2) {
-        dst_reg_num = strtol(&dst_param[2], &endptr, 10);
-        if (endptr == &dst_param[2] || dst_reg_num < 0 || dst_reg_num > 7) {
-            printf("%s:%d: invalid register '%s'\n", filepath, linenumber, dst_param);
-            return STATUS_FAILURE;
-        }
-    } else { /* dst_addressing == ADDRESSING_3 */
-        dst_reg_num = strtol(&dst_param[1], &endptr, 10);
-        if (endptr == &dst_param[1] || dst_reg_num < 0 || dst_reg_num > 7) {
-            printf("%s:%d: invalid register '%s'\n", filepath, linenumber, dst_param);
-            return STATUS_FAILURE;
-        }
-    }
+    int src_reg_num = get_register_number(src_param);
+    int dst_reg_num = get_register_number(dst_param);
 
     *out = (src_reg_num << 6) | (dst_reg_num << 3) | ARE_ABSOLUTE;
     return STATUS_SUCCESS;
 }
 
 /* Receives a parameter string, and prepares the word for the param */
-Status prepare_param_word(Assembler* assembler, const char* str, byte addressing, SrcOrDst src_or_dst, Word* out, const char* filepath, int linenumber) {
-    int value = 0;
-    char* endptr = 0;
+Status prepare_param_word(Assembler* assembler, StringView str, byte addressing, SrcOrDst src_or_dst, Word* out, const char* filepath, int linenumber) {
+    long value = 0;
     int reg_num = 0;
+    StringView number;
     
     /* Immediate Addressing */
     if (addressing == ADDRESSING_0) {
-        value = strtol(str + 1, &endptr, 10);
+        number.start = str.start + 1;
+        number.length = str.length - 1;
         
-        if (endptr == str || *endptr != '\0' || value > IMMEDIATE_MAX || value < IMMEDIATE_MIN) {
-            printf("%s:%d: number out of range or invalid '%s'\n", filepath, linenumber, str);
+        if (view_to_long(number, IMMEDIATE_MIN, IMMEDIATE_MAX, &value) != STATUS_SUCCESS) {
+            print_diagnostic("%s:%d: number out of range or invalid '%.*s'\n", filepath, linenumber, str.length, str.start);
             return STATUS_FAILURE;
         }
 
@@ -377,20 +460,15 @@ Status prepare_param_word(Assembler* assembler, const char* str, byte addressing
         return STATUS_SUCCESS;
     }
 
-    /* Direct Addressing */
+    /* Direct Addressing: the address is only known after the first pass, the word is patched by the second pass. */
     if (addressing == ADDRESSING_1) {        
         *out = 0;
         return STATUS_SUCCESS;
     }
 
-    /* Indirect Register Addressing */
-    if (addressing == ADDRESSING_2) {
-        reg_num = strtol(&str[2], &endptr, 10);
-
-        if (endptr == &str[2] || reg_num < 0 || reg_num > 7) {
-            printf("%s:%d: invalid register '%s'\n", filepath, linenumber, str);
-            return STATUS_FAILURE;
-        }
+    /* Indirect Register Addressing, Direct Register Addressing */
+    if (addressing == ADDRESSING_2 || addressing == ADDRESSING_3) {
+        reg_num = get_register_number(str);
         
         if (src_or_dst == SOURCE_OPERAND) {
             *out = (reg_num << 6) | ARE_ABSOLUTE;
@@ -399,24 +477,8 @@ Status prepare_param_word(Assembler* assembler, const char* str, byte addressing
         }
         return STATUS_SUCCESS;
     }
-
-    /* Direct Register Addressing */
-    if (addressing == ADDRESSING_3) {
-        reg_num = strtol(&str[1], &endptr, 10);
-        if (endptr == &str[1] || reg_num < 0 || reg_num > 7) {
-            printf("%s:%d: invalid register '%s'\n", filepath, linenumber, str);
-            return STATUS_FAILURE;
-        }
-
-        if (src_or_dst == SOURCE_OPERAND) {
-            *out = (reg_num << 6) | ARE_ABSOLUTE;
-        } else {
-            *out = (reg_num << 3) | ARE_ABSOLUTE;
-        }
-        return STATUS_SUCCESS;
-    }
     
-    printf("should never happen!\n");
+    print_diagnostic("should never happen!\n");
     return STATUS_FAILURE;
 }
 
@@ -427,21 +489,27 @@ Status assembler_handle_instruction(Assembler* assembler, ParsedLine* parsed, co
     Word src_param_word = 0;
     Word dst_param_word = 0;
 
-    if (strlen(parsed->label) > 0) {
+    if (parsed->label.length > 0) {
         if (assembler_add_label(assembler, parsed->label, LABEL_NONE, LABEL_CODE, filepath, line_number) != STATUS_SUCCESS) {
             return STATUS_FAILURE;
         }
     }
     
-    if (get_opcode(parsed->instruction, &opcode) != STATUS_SUCCESS) {
-        printf("%s:%d: invalid operation '%s'\n", filepath, line_number, parsed->instruction);
+    if (parsed->keyword.kind != KEYWORD_OPCODE) {
+        print_diagnostic("%s:%d: invalid operation '%.*s'\n", filepath, line_number, parsed->instruction.length, parsed->instruction.start);
         return STATUS_FAILURE;
     }
 
+    opcode = parsed->keyword.id;
     opcode_entry = opcodeTable[opcode];
 
+    /* An instruction takes at most 3 words */
+    if (section_reserve(&assembler->code, assembler->ic + 3) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
     if (parsed->num_params != opcode_entry.operands_num) {
-        printf("%s:%d: unexpected number of operands for opcode %s\n", filepath, line_number, opcode_entry.name);
+        print_diagnostic("%s:%d: unexpected number of operands for opcode %s\n", filepath, line_number, opcode_entry.name);
         return STATUS_FAILURE;
     }
 
@@ -451,11 +519,11 @@ Status assembler_handle_instruction(Assembler* assembler, ParsedLine* parsed, co
         byte dst_addressing = get_addressing_method(parsed->params[1], filepath, line_number);
 
         if (!(src_addressing & opcode_entry.valid_src_operands) || !(dst_addressing & opcode_entry.valid_dst_operands)) {
-            printf("%s:%d: unsupported addressing method for opcode %s\n", filepath, line_number, opcode_entry.name);
+            print_diagnostic("%s:%d: unsupported addressing method for opcode %s\n", filepath, line_number, opcode_entry.name);
             return STATUS_FAILURE;
         }
 
-        assembler->code[assembler->ic] = make_instruction_word(
+        assembler->code.words[assembler->ic] = make_instruction_word(
             opcode,
             src_addressing,
             dst_addressing,
@@ -476,7 +544,7 @@ Status assembler_handle_instruction(Assembler* assembler, ParsedLine* parsed, co
                 return STATUS_FAILURE;
             }
             
-            assembler->code[assembler->ic] = param_word;
+            assembler->code.words[assembler->ic] = param_word;
             assembler->ic++;
         } else { /* Separate words for the operands */
             if (prepare_param_word(assembler, parsed->params[0], src_addressing, SOURCE_OPERAND, &src_param_word, filepath, line_number) != STATUS_SUCCESS) {
@@ -487,9 +555,20 @@ Status assembler_handle_instruction(Assembler* assembler, ParsedLine* parsed, co
                 return STATUS_FAILURE;
             }
 
-            assembler->code[assembler->ic] = src_param_word;
+            if (src_addressing == ADDRESSING_1) {
+                if (assembler_add_fixup(assembler, FIXUP_OPERAND, parsed->params[0], assembler->ic, line_number) != STATUS_SUCCESS) {
+                    return STATUS_FAILURE;
+                }
+            }
+            assembler->code.words[assembler->ic] = src_param_word;
             assembler->ic++;
-            assembler->code[assembler->ic] = dst_param_word;
+
+            if (dst_addressing == ADDRESSING_1) {
+                if (assembler_add_fixup(assembler, FIXUP_OPERAND, parsed->params[1], assembler->ic, line_number) != STATUS_SUCCESS) {
+                    return STATUS_FAILURE;
+                }
+            }
+            assembler->code.words[assembler->ic] = dst_param_word;
             assembler->ic++;
         }
     }
@@ -497,7 +576,7 @@ Status assembler_handle_instruction(Assembler* assembler, ParsedLine* parsed, co
         byte dst_addressing = get_addressing_method(parsed->params[0], filepath, line_number);
 
         if (!(dst_addressing & opcode_entry.valid_dst_operands)) {
-            printf("%s:%d: unsupported addressing method for opcode %s\n", filepath, line_number, opcode_entry.name);
+            print_diagnostic("%s:%d: unsupported addressing method for opcode %s\n", filepath, line_number, opcode_entry.name);
             return STATUS_FAILURE;
         }
 
@@ -505,7 +584,7 @@ Status assembler_handle_instruction(Assembler* assembler, ParsedLine* parsed, co
             return STATUS_FAILURE;
         }
 
-        assembler->code[assembler->ic] = make_instruction_word(
+        assembler->code.words[assembler->ic] = make_instruction_word(
             opcode,
             ADDRESSING_NONE,   /* no source operand */
             dst_addressing,
@@ -513,11 +592,16 @@ Status assembler_handle_instruction(Assembler* assembler, ParsedLine* parsed, co
         );
         assembler->ic++;
 
-        assembler->code[assembler->ic] = param_word;
+        if (dst_addressing == ADDRESSING_1) {
+            if (assembler_add_fixup(assembler, FIXUP_OPERAND, parsed->params[0], assembler->ic, line_number) != STATUS_SUCCESS) {
+                return STATUS_FAILURE;
+            }
+        }
+        assembler->code.words[assembler->ic] = param_word;
         assembler->ic++;
     }
     else if (parsed->num_params == 0) {
-        assembler->code[assembler->ic] = make_instruction_word(
+        assembler->code.words[assembler->ic] = make_instruction_word(
             opcode,
             ADDRESSING_NONE,   /* no source operand */
             ADDRESSING_NONE,   /* no destination operand */
@@ -525,7 +609,7 @@ Status assembler_handle_instruction(Assembler* assembler, ParsedLine* parsed, co
         );
         assembler->ic++;
     } else {
-        printf("%s:%d: unexpected number of parameters\n", filepath, line_number);
+        print_diagnostic("%s:%d: unexpected number of parameters\n", filepath, line_number);
         return STATUS_FAILURE;
     }
 
@@ -533,9 +617,9 @@ Status assembler_handle_instruction(Assembler* assembler, ParsedLine* parsed, co
 }
 
 Status assembler_handle_directive(Assembler* assembler, ParsedLine* parsed, const char* filepath, int line_number) {
-    if (strlen(parsed->label) > 0) {
-        if (strcmp(parsed->instruction, ".data") != 0 && strcmp(parsed->instruction, ".string") != 0) {
-            printf("%s:%d: labels only allowed for .data or .string directives\n", filepath, line_number);
+    if (parsed->label.length > 0) {
+        if (parsed->keyword.id != DIRECTIVE_DATA && parsed->keyword.id != DIRECTIVE_STRING) {
+            print_diagnostic("%s:%d: labels only allowed for .data or .string directives\n", filepath, line_number);
             return STATUS_FAILURE;
         }
 
@@ -544,107 +628,155 @@ Status assembler_handle_directive(Assembler* assembler, ParsedLine* parsed, cons
         }
     }
     
-    if (strcmp(parsed->instruction, ".data") == 0) {
+    if (parsed->keyword.id == DIRECTIVE_DATA) {
         if (handle_data_directive(parsed, assembler, filepath, line_number) != STATUS_SUCCESS) {
             return STATUS_FAILURE;
         }
-    } else if (strcmp(parsed->instruction, ".string") == 0) {
+    } else if (parsed->keyword.id == DIRECTIVE_STRING) {
         if (handle_string_directive(parsed, assembler, filepath, line_number) != STATUS_SUCCESS) {
             return STATUS_FAILURE;
         }
-    } else if (strcmp(parsed->instruction, ".extern") == 0) {
+    } else if (parsed->keyword.id == DIRECTIVE_EXTERN) {
         if (handle_extern_directive(parsed, assembler, filepath, line_number) != STATUS_SUCCESS) {
             return STATUS_FAILURE;
         }
-    } 
-    /* We handle entries in the second pass, when we already know all the addresses of the labels. */
+    } else if (parsed->keyword.id == DIRECTIVE_ENTRY) {
+        /* We handle entries in the second pass, when we already know all the addresses of the labels.
+         * (so a file with other errors doesn't get the errors of its entries) */
+        if (parsed->num_params != 1) {
+            return assembler_add_fixup(assembler, FIXUP_BAD_ENTRY, view_of(""), 0, line_number);
+        }
+
+        if (assembler_add_fixup(assembler, FIXUP_ENTRY, parsed->params[0], 0, line_number) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
 
     return STATUS_SUCCESS;
 }
 
-Status assembler_firstpass(Assembler* assembler, FILE* input_file, const char* preassembled_path) {
-    char* fgets_result = 0;
-    int line_number = 0;
-    bool is_assembly_successfull = TRUE;
-    char line[LINEBUFFER_SIZE] = {0};
-    ParsedLine parsed_line = {0};
+/* The state of the first pass, shared by all the lines it receives from the preassembler. */
+typedef struct {
+    Assembler* assembler;
+    const char* preassembled_path;
+    int line_number;
+    bool is_assembly_successfull;
+    ParsedLine parsed_line;
+    double wall_seconds; /* statistics only: the time spent in the first pass (rather than in the preassembler) */
+} FirstPass;
+
+/* Runs the first pass over a single preassembled line. errors in the line are reported and remembered. */
+void assembler_firstpass_handle_line(FirstPass* firstpass, const char* line, int length) {
+    Assembler* assembler = firstpass->assembler;
+    const char* preassembled_path = firstpass->preassembled_path;
+    ParsedLine* parsed_line = &firstpass->parsed_line;
+
+    firstpass->line_number++;
+
+    if (is_empty_line(line, length)) {
+        return;
+    }
 
-    while (TRUE) {
-        fgets_result = fgets((char*)line, LINEBUFFER_SIZE, input_file);
-        line_number++;
+    if (parse_line(parsed_line, line, length, preassembled_path, firstpass->line_number) != STATUS_SUCCESS) {
+        firstpass->is_assembly_successfull = FALSE;
+        return;
+    }
 
-        if (fgets_result == NULL && !feof(input_file)) {
-            printf("%s: failed reading from file", preassembled_path);
-            return STATUS_FAILURE;
+    if (parsed_line->keyword.kind == KEYWORD_DIRECTIVE) {
+        if (assembler_handle_directive(assembler, parsed_line, preassembled_path, firstpass->line_number) != STATUS_SUCCESS) {
+            firstpass->is_assembly_successfull = FALSE;
         }
-        if (fgets_result == NULL && feof(input_file)) {
-            break;
+    } else {
+        if (assembler_handle_instruction(assembler, parsed_line, preassembled_path, firstpass->line_number) != STATUS_SUCCESS) {
+            firstpass->is_assembly_successfull = FALSE;
         }
+    }
+}
 
-        if (is_empty_line(line)) {
-            continue;
-        }
+/* A LineHandler: the first pass of a line, with its diagnostics held back in 'assembler->diagnostics':
+ * a source the preassembler rejects only gets the preassembler's error (there is no .am file to point to).
+ * errors don't stop the preassembler. */
+Status assembler_firstpass_line(void* context, const char* line, int length) {
+    FirstPass* firstpass = (FirstPass*)context;
+    FILE* stream = NULL;
 
-        if (parse_line(&parsed_line, line, preassembled_path, line_number) != STATUS_SUCCESS) {
-            is_assembly_successfull = FALSE;
-            continue;
-        }
+    stream = diagnostics_set_stream(firstpass->assembler->diagnostics);
+    assembler_firstpass_handle_line(firstpass, line, length);
+    diagnostics_set_stream(stream);
+    return STATUS_SUCCESS;
+}
 
-        if (is_directive(parsed_line.instruction)) {
-            if (assembler_handle_directive(assembler, &parsed_line, preassembled_path, line_number) != STATUS_SUCCESS) {
-                is_assembly_successfull = FALSE;
-                continue;
-            }
-        } else {
-            if (assembler_handle_instruction(assembler, &parsed_line, preassembled_path, line_number) != STATUS_SUCCESS) {
-                is_assembly_successfull = FALSE;
-                continue;
-            }
-        }
-    }
+/* The first pass of a line, when collecting statistics. the preassembler and the first pass run interleaved,
+ * so the time of the first pass is measured line by line.
+ * (only the wall clock: reading the cpu clock of the thread is a system call, that costs more than a line) */
+Status assembler_firstpass_line_timed(void* context, const char* line, int length) {
+    FirstPass* firstpass = (FirstPass*)context;
+    double start = stats_wall_clock();
+    Status status = STATUS_SUCCESS;
 
-    if (!is_assembly_successfull) {
-        return STATUS_FAILURE;
-    }
+    status = assembler_firstpass_line(context, line, length);
+    firstpass->wall_seconds += stats_wall_clock() - start;
+    return status;
+}
 
-    return STATUS_SUCCESS;
+/* Splits the time of preassembling the file (with the first pass streamed into it) between the two phases.
+ * the cpu time is split in the same proportion as the wall time. */
+void split_preassemble_time(FileStats* stats, PhaseTime* total, double firstpass_wall) {
+    double firstpass_share = total->wall > 0 ? firstpass_wall / total->wall : 0;
+
+    stats->phases[STATS_PHASE_FIRSTPASS].wall += firstpass_wall;
+    stats->phases[STATS_PHASE_FIRSTPASS].cpu += total->cpu * firstpass_share;
+    stats->phases[STATS_PHASE_PREASSEMBLE].wall += total->wall - firstpass_wall;
+    stats->phases[STATS_PHASE_PREASSEMBLE].cpu += total->cpu * (1 - firstpass_share);
 }
 
-Status assembler_create_obj_file(Assembler* assembler, const char* objfile_path) {
-    FILE* objfile = 0;
-    int i = 0;
-    
-    objfile = fopen(objfile_path, "wb");
-    if (objfile == NULL) {
-        printf("error opening output file: %s\n", objfile_path);
-        return STATUS_FAILURE;
-    }
+/* Marks the beginning and the end of a phase, in the statistics and in the trace (if any) */
+void assembler_phase_begin(Assembler* assembler, StatsTimer* timer, StatsPhase phase) {
+    trace_begin(stats_phase_names[phase], NULL);
+    stats_phase_begin(assembler->stats, timer);
+}
 
-    if (fprintf(objfile, "%d %d\n", assembler->code_section_size, assembler->dc) < 0) {
-        printf("writing to file %s failed\n", objfile_path);
-        fclose(objfile);
-        return STATUS_FAILURE;
+void assembler_phase_end(Assembler* assembler, StatsTimer* timer, StatsPhase phase) {
+    stats_phase_end(assembler->stats, timer, phase);
+    trace_end(stats_phase_names[phase]);
+}
+
+/* Adds the counts of the file to the statistics */
+void assembler_collect_stats(Assembler* assembler, PreassembleCounts* counts) {
+    FileStats* stats = assembler->stats;
+
+    stats->lines += counts->lines;
+    stats->bytes += counts->bytes;
+    stats->macros += counts->macros;
+    stats->macro_expansions += counts->macro_expansions;
+    stats->labels += assembler->label_table.count;
+    stats->extern_refs += assembler->extern_table.count;
+    stats->name_lookups += assembler->names.lookups;
+    stats->name_probes += assembler->names.probes;
+    stats->bytes_allocated += arena_used(&assembler->arena);
+    stats->peak_rss_kb = stats_peak_rss_kb();
+}
+
+/* Writes the formatted 'output' of the assembler to 'path', or to the output stream of the assembler */
+Status assembler_write_output(Assembler* assembler, OutputKind kind, const char* path) {
+    if (assembler->stream != NULL) {
+        return outstream_write(assembler->stream, kind, assembler->output.buffer, assembler->output.size);
     }
+    return write_bytearray_to_file(&assembler->output, path);
+}
 
+Status assembler_format_obj_file(Assembler* assembler, ByteArray* out) {
     /* TODO: should be the same format as requested... */
-    for (i = 0; i < assembler->code_section_size; i++) {
-        if (fprintf(objfile, "%04d %05o\n", i + LOADING_BASE, assembler->code[i]) < 0) {
-            printf("writing to file %s failed\n", objfile_path);
-            fclose(objfile);
-            return STATUS_FAILURE;
-        }
-    }
-    for (i = 0; i < assembler->dc; i++) {
-        if (fprintf(objfile, "%04d %05o\n", i + LOADING_BASE + assembler->code_section_size, assembler->data[i]) < 0) {
-            printf("writing to file %s failed\n", objfile_path);
-            fclose(objfile);
-            return STATUS_FAILURE;
-        }
-    }
+    return format_object_text(out, assembler->code.words, assembler->code_section_size, assembler->data.words, assembler->dc, LOADING_BASE);
+}
 
-    fclose(objfile);
-    return STATUS_SUCCESS;
+Status assembler_create_obj_file(Assembler* assembler, const char* objfile_path) {
+    assembler->output.size = 0;
+    if (assembler_format_obj_file(assembler, &assembler->output) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
 
+    return assembler_write_output(assembler, OUTPUT_OB, objfile_path);
 }
 
 bool has_entries(Assembler* assembler) {
@@ -657,21 +789,10 @@ bool has_entries(Assembler* assembler) {
     return FALSE;
 }
 
-Status assembler_create_entry_file(Assembler* assembler, char* entryfile_path) {
-    FILE* entryfile = 0;
+Status assembler_format_entry_file(Assembler* assembler, ByteArray* out) {
     int i = 0;
     int address = 0;
 
-    if (!has_entries(assembler)) {
-        return STATUS_SUCCESS;
-    }
-
-    entryfile = fopen(entryfile_path, "wb");
-    if (entryfile == NULL) {
-        printf("error opening entry file: %s\n", entryfile_path);
-        return STATUS_FAILURE;
-    }
-
     for (i = 0; i < assembler->label_table.count; i++) {
         if (assembler->label_table.labels[i].type == LABEL_ENTRY) {
             if (assembler->label_table.labels[i].code_or_data == LABEL_CODE) {
@@ -680,113 +801,230 @@ Status assembler_create_entry_file(Assembler* assembler, char* entryfile_path) {
                 address = assembler->label_table.labels[i].address + LOADING_BASE + assembler->code_section_size;
             }
 
-            if (fprintf(entryfile, "%s %d\n", assembler->label_table.labels[i].label_name, address) < 0) {
-                printf("writing to file %s failed", entryfile_path);
-                fclose(entryfile);
+            if (format_symbol_line(out, interner_view(&assembler->names, assembler->label_table.labels[i].name), address) != STATUS_SUCCESS) {
                 return STATUS_FAILURE;
             }
         }
     }
 
-    fclose(entryfile);
     return STATUS_SUCCESS;
 }
 
-Status assembler_create_extern_file(Assembler* assembler, char* externfile_path) {
-    FILE* externfile = 0;
+Status assembler_create_entry_file(Assembler* assembler, const char* entryfile_path) {
+    if (!has_entries(assembler)) {
+        return STATUS_SUCCESS;
+    }
+
+    assembler->output.size = 0;
+    if (assembler_format_entry_file(assembler, &assembler->output) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    return assembler_write_output(assembler, OUTPUT_ENT, entryfile_path);
+}
+
+Status assembler_format_extern_file(Assembler* assembler, ByteArray* out) {
     int i = 0;
 
+    for (i = 0; i < assembler->extern_table.count; i++) {
+        if (format_symbol_line(out, interner_view(&assembler->names, assembler->extern_table.refs[i].name), assembler->extern_table.refs[i].address) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+Status assembler_create_extern_file(Assembler* assembler, const char* externfile_path) {
     if (assembler->extern_table.count == 0) {
         return STATUS_SUCCESS;
     }
 
-    externfile = fopen(externfile_path, "wb");
-    if (externfile == NULL) {
-        printf("error opening extern file: %s\n", externfile_path);
+    assembler->output.size = 0;
+    if (assembler_format_extern_file(assembler, &assembler->output) != STATUS_SUCCESS) {
         return STATUS_FAILURE;
     }
 
-    for (i = 0; i < assembler->extern_table.count; i++) {
-        if (fprintf(
-                externfile, 
-                "%s %d\n", 
-                assembler->extern_table.refs[i].label_name,
-                assembler->extern_table.refs[i].address) < 0) {
-            
-            printf("writing to file %s failed", externfile_path);
-            fclose(externfile);
-            return STATUS_FAILURE;
+    return assembler_write_output(assembler, OUTPUT_EXT, externfile_path);
+}
+
+/* Describes the outputs of the assembler as an ObjectFile. the symbol arrays are allocated from the arena. */
+Status assembler_object_file(Assembler* assembler, ObjectFile* object) {
+    int i = 0;
+
+    object->load_base = LOADING_BASE;
+    object->code = assembler->code.words;
+    object->code_size = assembler->code_section_size;
+    object->data = assembler->data.words;
+    object->data_size = assembler->dc;
+    object->num_entries = 0;
+    object->num_externs = assembler->extern_table.count;
+
+    object->entries = (ObjectSymbol*)arena_alloc(&assembler->arena, (assembler->label_table.count + assembler->extern_table.count + 1) * sizeof(ObjectSymbol));
+    if (object->entries == NULL) {
+        print_diagnostic("failed to allocate memory for the object file\n");
+        return STATUS_FAILURE;
+    }
+    object->externs = object->entries + assembler->label_table.count;
+
+    for (i = 0; i < assembler->label_table.count; i++) {
+        if (assembler->label_table.labels[i].type == LABEL_ENTRY) {
+            object->entries[object->num_entries].name = interner_view(&assembler->names, assembler->label_table.labels[i].name);
+            object->entries[object->num_entries].address = assembler->label_table.labels[i].address + LOADING_BASE;
+            if (assembler->label_table.labels[i].code_or_data == LABEL_DATA) {
+                object->entries[object->num_entries].address += assembler->code_section_size;
+            }
+            object->num_entries++;
         }
     }
 
-    fclose(externfile);
+    for (i = 0; i < assembler->extern_table.count; i++) {
+        object->externs[i].name = interner_view(&assembler->names, assembler->extern_table.refs[i].name);
+        object->externs[i].address = assembler->extern_table.refs[i].address;
+    }
+
     return STATUS_SUCCESS;
 }
 
-Status assembler_assemble(Assembler* assembler, char* source_file_path) {
+Status assembler_create_obb_file(Assembler* assembler, const char* obbfile_path) {
+    ObjectFile object;
+
+    if (assembler_object_file(assembler, &object) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    assembler->output.size = 0;
+    if (objfile_format_obb(&object, &assembler->arena, &assembler->output) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    return assembler_write_output(assembler, OUTPUT_OBB, obbfile_path);
+}
+
+/* Assembles the source that is open in 'reader'. 'source_name' names it in diagnostics, and unless the outputs
+ * go to the output stream of the assembler, the output files are named after it. */
+Status assembler_assemble_reader(Assembler* assembler, LineReader* reader, char* source_name, bool emit_am, bool emit_obb) {
     char* preassembled_path = 0;
     char* objfile_path = 0;
     char* entryfile_path = 0;
     char* externfile_path = 0;
-    FILE* input_file = 0;
+    char* obbfile_path = 0;
+    FirstPass* firstpass = 0;
+    PreassembleCounts counts = {0};
+    PhaseTime preassemble_time = {0};
+    StatsTimer timer;
     Status status = 0;
 
-    preassembled_path = change_extension(source_file_path, "am");
-    if (preassembled_path == NULL) {
-        goto FAILURE;
-    }
-    objfile_path = change_extension(source_file_path, "ob");
-    if (objfile_path == NULL) {
-        goto FAILURE;
+    /* The passes report the lines of the preassembled source (a source without an .as name, e.g. stdin, keeps its name) */
+    preassembled_path = source_name;
+    if (has_extension(source_name, "as")) {
+        preassembled_path = change_extension(&assembler->arena, source_name, "am");
+        if (preassembled_path == NULL) {
+            goto FAILURE;
+        }
     }
-    entryfile_path = change_extension(source_file_path, "ent");
-    if (entryfile_path == NULL) {
-        goto FAILURE;
+
+    if (assembler->stream == NULL) {
+        objfile_path = change_extension(&assembler->arena, source_name, "ob");
+        if (objfile_path == NULL) {
+            goto FAILURE;
+        }
+        entryfile_path = change_extension(&assembler->arena, source_name, "ent");
+        if (entryfile_path == NULL) {
+            goto FAILURE;
+        }
+
+        externfile_path = change_extension(&assembler->arena, source_name, "ext");
+        if (externfile_path == NULL) {
+            goto FAILURE;
+        }
+
+        obbfile_path = change_extension(&assembler->arena, source_name, "obb");
+        if (obbfile_path == NULL) {
+            goto FAILURE;
+        }
     }
 
-    externfile_path = change_extension(source_file_path, "ext");
-    if (externfile_path == NULL) {
+    firstpass = (FirstPass*)arena_alloc(&assembler->arena, sizeof(FirstPass));
+    if (firstpass == NULL) {
+        print_diagnostic("failed to allocate memory for the first pass\n");
         goto FAILURE;
     }
-
-    input_file = fopen(preassembled_path, "rb");
-    if (input_file == NULL) {
-        printf("%s: cannot open file\n", preassembled_path);
+    firstpass->assembler = assembler;
+    firstpass->preassembled_path = preassembled_path;
+    firstpass->line_number = 0;
+    firstpass->is_assembly_successfull = TRUE;
+    firstpass->wall_seconds = 0;
+    parsed_line_init(&firstpass->parsed_line, &assembler->arena);
+
+    /* The preassembled lines are fed straight into the first pass (the .am file is written only if requested). */
+    trace_begin("preassemble+firstpass", NULL);
+    if (assembler->stats != NULL) {
+        stats_timer_start(&timer, FALSE);
+        status = preassemble_reader(&assembler->arena, &assembler->names, reader, source_name, emit_am, assembler->stream, assembler_firstpass_line_timed, firstpass, &counts);
+        stats_timer_stop(&timer, &preassemble_time);
+        split_preassemble_time(assembler->stats, &preassemble_time, firstpass->wall_seconds);
+    } else {
+        status = preassemble_reader(&assembler->arena, &assembler->names, reader, source_name, emit_am, assembler->stream, assembler_firstpass_line, firstpass, NULL);
+    }
+    trace_end("preassemble+firstpass");
+    if (status != STATUS_SUCCESS) {
         goto FAILURE;
     }
 
-    if (assembler_firstpass(assembler, input_file, preassembled_path) != STATUS_SUCCESS) {
-        goto FAILURE;
+    /* Like the preassembler ran to the end before the first pass started */
+    fflush(assembler->diagnostics);
+    if (assembler->diagnostics_size > 0) {
+        print_diagnostic("%.*s", (int)assembler->diagnostics_size, assembler->diagnostics_buffer);
     }
 
-    if (fseek(input_file, 0, SEEK_SET) != 0) {
-        printf("%s: cannot seek to the beginning of the file\n", preassembled_path);
+    if (!firstpass->is_assembly_successfull) {
         goto FAILURE;
     }
 
     if (assembler->ic + assembler->dc + LOADING_BASE > MAX_MEMORY_SIZE) {
-        printf("error: Code and data exceed memory limit\n");
-        return STATUS_FAILURE;
+        print_diagnostic("error: Code and data exceed memory limit\n");
+        goto FAILURE;
     }
     assembler->code_section_size = assembler->ic;
-    assembler->ic = 0;
 
-    if (assembler_secondpass(assembler, input_file, preassembled_path) != STATUS_SUCCESS) {
+    assembler_phase_begin(assembler, &timer, STATS_PHASE_SECONDPASS);
+    status = assembler_secondpass(assembler, preassembled_path);
+    assembler_phase_end(assembler, &timer, STATS_PHASE_SECONDPASS);
+    if (status != STATUS_SUCCESS) {
         goto FAILURE;
     }
 
-    if (assembler_create_obj_file(assembler, objfile_path) != STATUS_SUCCESS) {
+    assembler_phase_begin(assembler, &timer, STATS_PHASE_WRITE_OB);
+    status = assembler_create_obj_file(assembler, objfile_path);
+    assembler_phase_end(assembler, &timer, STATS_PHASE_WRITE_OB);
+    if (status != STATUS_SUCCESS) {
         goto FAILURE;
     }
 
-    if (assembler_create_entry_file(assembler, entryfile_path) != STATUS_SUCCESS) {
+    assembler_phase_begin(assembler, &timer, STATS_PHASE_WRITE_ENT);
+    status = assembler_create_entry_file(assembler, entryfile_path);
+    assembler_phase_end(assembler, &timer, STATS_PHASE_WRITE_ENT);
+    if (status != STATUS_SUCCESS) {
         goto FAILURE;
     }
 
-    if (assembler_create_extern_file(assembler, externfile_path) != STATUS_SUCCESS) {
+    assembler_phase_begin(assembler, &timer, STATS_PHASE_WRITE_EXT);
+    status = assembler_create_extern_file(assembler, externfile_path);
+    assembler_phase_end(assembler, &timer, STATS_PHASE_WRITE_EXT);
+    if (status != STATUS_SUCCESS) {
         goto FAILURE;
     }
 
+    if (emit_obb) {
+        assembler_phase_begin(assembler, &timer, STATS_PHASE_WRITE_OBB);
+        status = assembler_create_obb_file(assembler, obbfile_path);
+        assembler_phase_end(assembler, &timer, STATS_PHASE_WRITE_OBB);
+        if (status != STATUS_SUCCESS) {
+            goto FAILURE;
+        }
+    }
+
     goto SUCCESS;
 SUCCESS:
     status = STATUS_SUCCESS;
@@ -794,12 +1032,45 @@ SUCCESS:
 FAILURE:
     status = STATUS_FAILURE;
 CLEANUP:
-    if (input_file != NULL) {
-        fclose(input_file);
+    if (assembler->stats != NULL) {
+        assembler_collect_stats(assembler, &counts);
     }
-    free(preassembled_path);
-    free(objfile_path);
-    free(entryfile_path);
-    free(externfile_path);
+    /* All the memory is released by assembler_reset */
     return status;
 }
+
+Status assembler_assemble(Assembler* assembler, char* source_file_path, bool emit_am, bool emit_obb) {
+    LineReader reader;
+    Status status = STATUS_SUCCESS;
+    bool is_stdin = (strcmp(source_file_path, STDIN_PATH) == 0);
+
+    /* A source from stdin has no paths to write its outputs to */
+    if (is_stdin && assembler->stream == NULL) {
+        print_diagnostic("the source from stdin needs an output stream\n");
+        return STATUS_FAILURE;
+    }
+
+    if (!is_stdin && validate_extension(source_file_path, "as") != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (linereader_open(&reader, source_file_path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    status = assembler_assemble_reader(assembler, &reader, is_stdin ? STDIN_NAME : source_file_path, emit_am, emit_obb);
+    linereader_close(&reader);
+    return status;
+}
+
+Status assembler_assemble_buffer(Assembler* assembler, char* source_name, const char* source, long size, bool emit_am, bool emit_obb) {
+    LineReader reader;
+
+    if (assembler->stream == NULL) {
+        print_diagnostic("%s: a source in memory needs an output stream\n", source_name);
+        return STATUS_FAILURE;
+    }
+
+    linereader_open_buffer(&reader, source, size);
+    return assembler_assemble_reader(assembler, &reader, source_name, emit_am, emit_obb);
+}
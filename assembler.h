@@ -2,11 +2,16 @@
 #define _ASSEMBLER_H
 
 #include "common.h"
-
-#define MAX_WORDS_IN_OBJFILE 4096
+#include "interner.h"
+#include "objfile.h"
+#include "stats.h"
+#include "outstream.h"
 
 #define LOADING_BASE 100
 
+#define OPCODE_NUM 16
+#define REGISTERS_NUM 8
+
 #define ARE_ABSOLUTE 4 /* 0b100*/
 #define ARE_RELATIVE 2 /* 0b010*/
 #define ARE_EXTERNAL 1 /* 0b001*/
@@ -30,7 +35,7 @@ typedef enum {
 } SrcOrDst;
 
 typedef struct {
-    char* name;
+    const char* name;
     byte code;
     byte valid_src_operands; /* bitfield */
     byte valid_dst_operands; /* bitfield */
@@ -38,9 +43,9 @@ typedef struct {
 } OpcodeTableEntry;
 
 typedef struct {
-    char label_name[LINEBUFFER_SIZE];
-    LabelType type;
-    CodeOrData code_or_data;
+    unsigned int name; /* the id of the label name in the 'names' of the table */
+    byte type; /* LabelType */
+    byte code_or_data; /* CodeOrData */
     /* this is the ic/dc. when writing to a RELATIVE operand, add LOADING_BASE to this value. (and maybe code_section_size)*/
     int address;  
 } LabelTableEntry;
@@ -49,40 +54,108 @@ typedef struct {
     LabelTableEntry* labels;
     int count;
     int capacity;
+    IdMap by_name; /* the position of every label in 'labels', by the id of its name */
+    Interner* names;
+    Arena* arena; /* the memory of the table is allocated from here */
 } LabelTable;
 
 typedef struct {
-    char label_name[LINEBUFFER_SIZE];
+    unsigned int name; /* the id of the extern label name */
     int address; /* The address in the codesection (already includes LOADING_BASE) */
 } ExternTableEntry;
 
 typedef struct {
-    ExternTableEntry refs[MAX_WORDS_IN_OBJFILE];
+    ExternTableEntry* refs;
     int count;
+    int capacity;
+    Arena* arena;
 } ExternTable;
 
+/* A growable array of words (the code or the data section). the number of used words is kept by the Assembler (ic / dc) */
+typedef struct {
+    Word* words;
+    int capacity;
+    Arena* arena;
+} Section;
+
+typedef enum {
+    FIXUP_OPERAND, /* a direct-addressing operand word that should hold the address of a label */
+    FIXUP_ENTRY,   /* an .entry directive, that marks a label as an entry */
+    FIXUP_BAD_ENTRY /* an .entry directive without exactly one parameter. reported by the second pass, like the other .entry errors */
+} FixupKind;
+
+/* A reference to a label that can only be resolved after the first pass (when all the labels are known). */
+typedef struct {
+    FixupKind kind;
+    unsigned int name; /* the id of the label name */
+    int slot; /* FIXUP_OPERAND only: the index of the operand word in 'code' */
+    int line_number; /* for error messages */
+} Fixup;
+
+typedef struct {
+    Fixup* fixups;
+    int count;
+    int capacity;
+    Arena* arena;
+} FixupTable;
+
 typedef struct assembler_t {
-  Word code[MAX_WORDS_IN_OBJFILE];
-  Word data[MAX_WORDS_IN_OBJFILE];
+  Arena arena; /* All the memory of the current file. released (and recycled) by assembler_reset */
+  Interner names; /* The names of the labels and the macros of the current file */
+  Section code;
+  Section data;
   int ic;
   int dc;
   int code_section_size;
   LabelTable label_table;
   ExternTable extern_table; /* All the references to externs in the code. filled during second pass */
-  
+  FixupTable fixup_table; /* All the label references in the code and the .entry directives. filled during first pass */
+  ByteArray output; /* The output files are formatted here, and then written with a single write */
+  FileStats* stats; /* The statistics of the current file are collected here. NULL (the default) skips them. kept by assembler_reset */
+  OutputStream* stream; /* NULL (the default): the outputs are written to files next to the source. kept by assembler_reset */
+  /* The diagnostics of the first pass are held back here until the preassembler is done with the whole file.
+   * a memory stream that lives as long as the assembler, and is rewound by assembler_reset */
+  FILE* diagnostics;
+  char* diagnostics_buffer;
+  size_t diagnostics_size;
 } Assembler;
 
 Status assembler_init(Assembler* assembler);
 void assembler_free(Assembler* assembler);
+/* Empties the assembler so it can assemble another file. the memory of the previous file is reused. */
+Status assembler_reset(Assembler* assembler);
+
+/* Preassembles 'source_file_path' ("-" is stdin) and assembles it. the preassembled lines are streamed straight
+ * into the first pass, the .am file is only written if 'emit_am' is TRUE.
+ * If 'assembler->stream' is not NULL, all the outputs go there instead of to files.
+ * If 'assembler->stats' is not NULL, the statistics of the file are added to it.
+ * The binary .obb file is written (in addition to the textual files) if 'emit_obb' is TRUE. */
+Status assembler_assemble(Assembler* assembler, char* source_file_path, bool emit_am, bool emit_obb);
+
+/* Assembles the 'size' bytes of 'source', named 'source_name' in diagnostics. the outputs go to 'assembler->stream'
+ * (which must be set), so nothing is read from or written to the file system. */
+Status assembler_assemble_buffer(Assembler* assembler, char* source_name, const char* source, long size, bool emit_am, bool emit_obb);
+
+Status get_opcode(StringView token, int* out_opcode);
+
+/* Makes sure 'section' has room for 'size' words. */
+Status section_reserve(Section* section, int size);
+Status externtable_add(ExternTable* table, unsigned int name, int address);
 
-/* The assembler assumes that the .am file was not tampered with, and pre-assembly was successfull. */
-Status assembler_assemble(Assembler* assembler, char* source_file_path);
+/* Format the contents of the .ob, .ent and .ext files, and append them to 'out'. */
+Status assembler_format_obj_file(Assembler* assembler, ByteArray* out);
+Status assembler_format_entry_file(Assembler* assembler, ByteArray* out);
+Status assembler_format_extern_file(Assembler* assembler, ByteArray* out);
 
-Status get_opcode(const char* tokens, int* out_opcode);
+/* Describes the assembled file (after the second pass) as an ObjectFile, e.g. for objfile_format_obb. */
+Status assembler_object_file(Assembler* assembler, ObjectFile* object);
 
-extern OpcodeTableEntry opcodeTable[];
+extern const OpcodeTableEntry opcodeTable[];
 
-Status labeltable_get_entry(LabelTable* table, const char* label, LabelTableEntry* out);
-byte get_addressing_method(const char* param, const char* filepath, int linenumber);
+/* returns a pointer to the entry of 'label' inside the table, or NULL if it's not there. */
+LabelTableEntry* labeltable_find(LabelTable* table, StringView label);
+/* same, by the id of the label name */
+LabelTableEntry* labeltable_find_id(LabelTable* table, unsigned int name);
+byte get_addressing_method(StringView param, const char* filepath, int linenumber);
 
 #endif
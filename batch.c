@@ -0,0 +1,367 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "assembler.h"
+#include "batch.h"
+
+typedef struct {
+    char* source_path;
+    long size; /* the size of the source file, used for largest-first scheduling */
+    int position; /* the position of the file in the batch */
+    Status status;
+    bool is_done;
+    char* diagnostics; /* the messages printed while assembling the file (an open_memstream buffer) */
+    size_t diagnostics_size;
+} Job;
+
+/* The jobs of a single worker, sorted largest-first.
+ * The worker takes jobs from the head, other workers steal from the tail. */
+typedef struct {
+    Job** jobs;
+    int head;
+    int tail;
+    pthread_mutex_t lock;
+} JobQueue;
+
+typedef struct {
+    Job* jobs;
+    int num_jobs;
+    JobQueue* queues;
+    int num_workers;
+    BatchOptions* options;
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond; /* signaled whenever a job is done */
+} Batch;
+
+typedef struct {
+    Batch* batch;
+    int id;
+    pthread_t thread;
+} Worker;
+
+/* 'assembler' is initialized once and reused for all the files of a worker.
+ * 'position' is the position of the file in the batch. */
+Status assemble_file(Assembler* assembler, char* source_path, int position, BatchOptions* options) {
+    char key[CACHE_KEY_SIZE];
+    bool has_key = FALSE;
+    OutputStream outputs;
+    char* am_path = NULL;
+    Status status = STATUS_SUCCESS;
+
+    if (assembler_reset(assembler) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    assembler->stats = (options->stats != NULL) ? &options->stats[position] : NULL;
+    assembler->stream = options->stream;
+    trace_begin("assemble", source_path);
+
+    if (options->cache != NULL) {
+        has_key = (cache_key(source_path, options->emit_am, options->emit_obb, key) == STATUS_SUCCESS);
+        if (has_key && cache_restore(options->cache, &assembler->arena, source_path, key)) {
+            if (assembler->stats != NULL) {
+                assembler->stats->is_cached = TRUE;
+            }
+            trace_end("assemble");
+            return STATUS_SUCCESS;
+        }
+    }
+
+    if (!has_key) {
+        status = assembler_assemble(assembler, source_path, options->emit_am, options->emit_obb);
+        trace_end("assemble");
+        return status;
+    }
+
+    /* The outputs are kept in memory and written from there, so the cache entry holds exactly what this
+     * assembly produced (and not a stale file of an earlier run, e.g. a .ent of a source that lost its entries) */
+    outstream_init_memory(&outputs, &assembler->arena);
+    assembler->stream = &outputs;
+    status = assembler_assemble(assembler, source_path, options->emit_am, options->emit_obb);
+    assembler->stream = options->stream;
+
+    if (outstream_write_files(&outputs, &assembler->arena, source_path) != STATUS_SUCCESS) {
+        status = STATUS_FAILURE;
+    }
+    /* Like a .am file written directly, a failed preassembly leaves none behind */
+    if (options->emit_am && outputs.buffers[OUTPUT_AM].buffer == NULL) {
+        am_path = change_extension(&assembler->arena, source_path, "am");
+        if (am_path != NULL) {
+            remove(am_path);
+        }
+    }
+
+    /* Only successful files are cached, so a hit never has to replay diagnostics */
+    if (status == STATUS_SUCCESS) {
+        cache_store(options->cache, &assembler->arena, key, &outputs, options->emit_am, options->emit_obb);
+    }
+    trace_end("assemble");
+    return status;
+}
+
+Job* jobqueue_take(JobQueue* queue, bool from_tail) {
+    Job* job = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+        if (from_tail) {
+            queue->tail--;
+            job = queue->jobs[queue->tail];
+        } else {
+            job = queue->jobs[queue->head];
+            queue->head++;
+        }
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+/* Returns the next job of the worker: its own largest job, or a job stolen from another worker.
+ * Returns NULL when there are no jobs left. (jobs are never added once the batch started) */
+Job* batch_next_job(Batch* batch, int worker_id) {
+    Job* job = NULL;
+    int i = 0;
+
+    job = jobqueue_take(&batch->queues[worker_id], FALSE);
+    for (i = 1; job == NULL && i < batch->num_workers; i++) {
+        job = jobqueue_take(&batch->queues[(worker_id + i) % batch->num_workers], TRUE);
+    }
+    return job;
+}
+
+void* batch_worker(void* arg) {
+    Worker* worker = (Worker*)arg;
+    Batch* batch = worker->batch;
+    Assembler assembler;
+    Status init_status = STATUS_SUCCESS;
+    Job* job = NULL;
+    FILE* diagnostics = NULL;
+    char thread_name[32];
+
+    init_status = assembler_init(&assembler);
+    if (batch->options->tracer != NULL) {
+        sprintf(thread_name, "worker %d", worker->id);
+        trace_attach_thread(batch->options->tracer, thread_name);
+    }
+
+    while ((job = batch_next_job(batch, worker->id)) != NULL) {
+        diagnostics = open_memstream(&job->diagnostics, &job->diagnostics_size);
+        if (diagnostics == NULL) {
+            job->status = STATUS_FAILURE;
+        } else {
+            diagnostics_set_stream(diagnostics);
+            if (init_status != STATUS_SUCCESS) {
+                /* Every job of a worker that failed to start says so, instead of failing silently */
+                print_diagnostic("%s: the assembler failed to start\n", job->source_path);
+                job->status = STATUS_FAILURE;
+            } else {
+                job->status = assemble_file(&assembler, job->source_path, job->position, batch->options);
+            }
+            diagnostics_set_stream(NULL);
+        }
+        if (diagnostics != NULL) {
+            fclose(diagnostics);
+        }
+
+        pthread_mutex_lock(&batch->done_lock);
+        job->is_done = TRUE;
+        pthread_cond_broadcast(&batch->done_cond);
+        pthread_mutex_unlock(&batch->done_lock);
+    }
+
+    if (init_status == STATUS_SUCCESS) {
+        assembler_free(&assembler);
+    }
+    trace_detach_thread();
+    return NULL;
+}
+
+int compare_jobs_largest_first(const void* a, const void* b) {
+    const Job* job_a = *(const Job**)a;
+    const Job* job_b = *(const Job**)b;
+
+    if (job_a->size != job_b->size) {
+        return job_a->size > job_b->size ? -1 : 1;
+    }
+    return job_a->position - job_b->position;
+}
+
+Status batch_assemble_sequential(char** source_paths, int num_files, BatchOptions* options) {
+    Assembler assembler;
+    Status status = STATUS_SUCCESS;
+    int i = 0;
+
+    if (assembler_init(&assembler) != STATUS_SUCCESS) {
+        for (i = 0; i < num_files; i++) {
+            print_diagnostic("%s: the assembler failed to start\n", source_paths[i]);
+        }
+        return STATUS_FAILURE;
+    }
+    if (options->tracer != NULL) {
+        trace_attach_thread(options->tracer, "main");
+    }
+
+    for (i = 0; i < num_files; i++) {
+        if (assemble_file(&assembler, source_paths[i], i, options) != STATUS_SUCCESS) {
+            status = STATUS_FAILURE;
+        }
+    }
+
+    trace_detach_thread();
+    assembler_free(&assembler);
+    return status;
+}
+
+Status batch_assemble(char** source_paths, int num_files, BatchOptions* options) {
+    Batch batch = {0};
+    Worker* workers = NULL;
+    Job** sorted_jobs = NULL;
+    Job** queue_storage = NULL;
+    JobQueue* queue = NULL;
+    struct stat file_stat;
+    Status status = STATUS_SUCCESS;
+    int queue_size = 0;
+    int num_started = 0;
+    int i = 0;
+
+    if (options->num_workers <= 1 || num_files <= 1) {
+        return batch_assemble_sequential(source_paths, num_files, options);
+    }
+
+    batch.num_jobs = num_files;
+    batch.num_workers = options->num_workers < num_files ? options->num_workers : num_files;
+    batch.options = options;
+    queue_size = (num_files + batch.num_workers - 1) / batch.num_workers;
+
+    batch.jobs = (Job*)calloc(num_files, sizeof(Job));
+    sorted_jobs = (Job**)malloc(num_files * sizeof(Job*));
+    queue_storage = (Job**)malloc(batch.num_workers * queue_size * sizeof(Job*));
+    batch.queues = (JobQueue*)calloc(batch.num_workers, sizeof(JobQueue));
+    workers = (Worker*)calloc(batch.num_workers, sizeof(Worker));
+    if (batch.jobs == NULL || sorted_jobs == NULL || queue_storage == NULL || batch.queues == NULL || workers == NULL) {
+        print_diagnostic("failed to allocate memory for the batch\n");
+        status = STATUS_FAILURE;
+        goto CLEANUP;
+    }
+
+    for (i = 0; i < num_files; i++) {
+        batch.jobs[i].source_path = source_paths[i];
+        batch.jobs[i].position = i;
+        batch.jobs[i].size = (stat(source_paths[i], &file_stat) == 0) ? (long)file_stat.st_size : 0;
+        sorted_jobs[i] = &batch.jobs[i];
+    }
+    qsort(sorted_jobs, num_files, sizeof(Job*), compare_jobs_largest_first);
+
+    /* Deal the jobs round-robin, so every queue is sorted largest-first and gets a similar amount of work. */
+    for (i = 0; i < batch.num_workers; i++) {
+        batch.queues[i].jobs = queue_storage + i * queue_size;
+        pthread_mutex_init(&batch.queues[i].lock, NULL);
+    }
+    for (i = 0; i < num_files; i++) {
+        queue = &batch.queues[i % batch.num_workers];
+        queue->jobs[queue->tail] = sorted_jobs[i];
+        queue->tail++;
+    }
+
+    pthread_mutex_init(&batch.done_lock, NULL);
+    pthread_cond_init(&batch.done_cond, NULL);
+
+    for (i = 0; i < batch.num_workers; i++) {
+        workers[i].batch = &batch;
+        workers[i].id = i;
+        if (pthread_create(&workers[i].thread, NULL, batch_worker, &workers[i]) != 0) {
+            break;
+        }
+        num_started++;
+    }
+
+    if (num_started == 0) { /* The queues are still full, run everything here. */
+        print_diagnostic("failed to start worker threads, assembling sequentially\n");
+        status = batch_assemble_sequential(source_paths, num_files, options);
+    } else {
+        /* Workers that failed to start get their queues stolen by the others. Print the results in order, as they complete. */
+        for (i = 0; i < num_files; i++) {
+            pthread_mutex_lock(&batch.done_lock);
+            while (!batch.jobs[i].is_done) {
+                pthread_cond_wait(&batch.done_cond, &batch.done_lock);
+            }
+            pthread_mutex_unlock(&batch.done_lock);
+
+            if (batch.jobs[i].diagnostics_size > 0) {
+                fwrite(batch.jobs[i].diagnostics, 1, batch.jobs[i].diagnostics_size, stdout);
+            }
+            free(batch.jobs[i].diagnostics);
+            if (batch.jobs[i].status != STATUS_SUCCESS) {
+                status = STATUS_FAILURE;
+            }
+        }
+
+        for (i = 0; i < num_started; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+    fflush(stdout);
+
+    pthread_cond_destroy(&batch.done_cond);
+    pthread_mutex_destroy(&batch.done_lock);
+    for (i = 0; i < batch.num_workers; i++) {
+        pthread_mutex_destroy(&batch.queues[i].lock);
+    }
+
+CLEANUP:
+    free(batch.jobs);
+    free(sorted_jobs);
+    free(queue_storage);
+    free(batch.queues);
+    free(workers);
+    return status;
+}
+
+Status batch_assemble_stdin(BatchOptions* options) {
+    Assembler assembler;
+    FILE* diagnostics = NULL;
+    char* diagnostics_buffer = NULL;
+    size_t diagnostics_size = 0;
+    Status status = STATUS_SUCCESS;
+    Status init_status = STATUS_SUCCESS;
+
+    init_status = assembler_init(&assembler);
+    if (options->tracer != NULL) {
+        trace_attach_thread(options->tracer, "main");
+    }
+
+    /* The diagnostics are collected, and written as an output of their own */
+    diagnostics = open_memstream(&diagnostics_buffer, &diagnostics_size);
+    if (diagnostics == NULL) {
+        status = STATUS_FAILURE;
+    } else {
+        diagnostics_set_stream(diagnostics);
+        if (init_status != STATUS_SUCCESS) {
+            print_diagnostic("%s: the assembler failed to start\n", STDIN_PATH);
+            status = STATUS_FAILURE;
+        } else {
+            status = assemble_file(&assembler, STDIN_PATH, 0, options);
+        }
+        diagnostics_set_stream(NULL);
+        fclose(diagnostics);
+    }
+
+    if (diagnostics_size > 0 &&
+        outstream_write(options->stream, OUTPUT_DIAGNOSTICS, (byte*)diagnostics_buffer, (long)diagnostics_size) != STATUS_SUCCESS) {
+        status = STATUS_FAILURE;
+    }
+    if (outstream_finish(options->stream, status) != STATUS_SUCCESS) {
+        status = STATUS_FAILURE;
+    }
+
+    free(diagnostics_buffer);
+    trace_detach_thread();
+    if (init_status == STATUS_SUCCESS) {
+        assembler_free(&assembler);
+    }
+    return status;
+}
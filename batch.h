@@ -0,0 +1,30 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include "common.h"
+#include "cache.h"
+#include "stats.h"
+#include "trace.h"
+#include "outstream.h"
+
+typedef struct {
+    bool emit_am;
+    bool emit_obb; /* also write the binary .obb object file */
+    int num_workers; /* 1 means assembling the files one after the other, on the main thread */
+    Cache* cache; /* NULL if the build cache is disabled */
+    FileStats* stats; /* NULL, or the (zeroed) statistics of every file, in the order of the sources */
+    Tracer* tracer; /* NULL, or the trace that every thread of the batch records its events into */
+    OutputStream* stream; /* batch_assemble_stdin only: where the outputs and the diagnostics go */
+} BatchOptions;
+
+/* Assembles all the files in 'source_paths', using 'options->num_workers' threads.
+ * Files are scheduled largest-first, and idle workers steal work from busy ones.
+ * The diagnostics of every file are printed in the order of 'source_paths'.
+ * Returns STATUS_FAILURE if any of the files failed. */
+Status batch_assemble(char** source_paths, int num_files, BatchOptions* options);
+
+/* Assembles the source in stdin, and writes all its outputs and its diagnostics to 'options->stream',
+ * followed by its status. (the build cache doesn't apply to it) */
+Status batch_assemble_stdin(BatchOptions* options);
+
+#endif
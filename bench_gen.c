@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+
+/* Generates synthetic .as sources for the benchmark (see bench.c and 'make bench'):
+ *   bench_gen [options] <output directory>
+ * writes <directory>/bench_<n>.as for every file, and <directory>/files.txt, a manifest that lists them.
+ * The same options (and seed) always generate the same files. */
+
+#define MAX_FILES 100000
+#define MAX_GEN_LINES 100000
+#define LABEL_NAME_SIZE 16
+/* The words a file may use: the memory, without the loading base */
+#define WORD_BUDGET (MAX_MEMORY_SIZE - 100)
+
+typedef struct {
+    int files;
+    int lines; /* per file, including the macro definitions */
+    int label_percent; /* of the instruction and data lines, that define a label */
+    int forward_percent; /* of the label operands, that refer to a label that is defined later */
+    int macros; /* per file */
+    int macro_percent; /* of the lines, that invoke a macro */
+    int data_percent; /* of the lines, that are .data or .string */
+    int externs; /* per file */
+    int extern_percent; /* of the label operands, that refer to an extern */
+    unsigned long seed;
+} GenOptions;
+
+typedef enum {
+    LINE_INSTRUCTION,
+    LINE_DATA,
+    LINE_MACRO_CALL
+} LineKind;
+
+/* The plan of a file: the kind of every body line, and which of them define a label */
+typedef struct {
+    LineKind kinds[MAX_GEN_LINES];
+    int label_of_line[MAX_GEN_LINES]; /* the number of the label defined on the line, or -1 */
+    int next_label[MAX_GEN_LINES]; /* the number of the first label defined on the line or after it (num_labels if none) */
+    int num_lines;
+    int num_labels;
+} FilePlan;
+
+unsigned long random_state = 1;
+
+/* A small LCG, so the files don't depend on the rand() of the platform */
+int random_below(int n) {
+    random_state = (random_state * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return (int)((random_state >> 8) % (unsigned long)n);
+}
+
+bool random_percent(int percent) {
+    return random_below(100) < percent;
+}
+
+void print_usage(void) {
+    printf("usage: bench_gen [options] <output directory>\n");
+    printf("       --files N        the number of files (default 50)\n");
+    printf("       --lines N        the lines of every file (default 1000)\n");
+    printf("       --labels P       the percent of the lines that define a label (default 20)\n");
+    printf("       --forward P      the percent of the label operands that refer to a later label (default 50)\n");
+    printf("       --macros N       the macros of every file (default 8)\n");
+    printf("       --macro-rate P   the percent of the lines that invoke a macro (default 10)\n");
+    printf("       --data P         the percent of the lines that are .data or .string (default 15)\n");
+    printf("       --externs N      the externs of every file (default 4)\n");
+    printf("       --extern-rate P  the percent of the label operands that refer to an extern (default 10)\n");
+    printf("       --seed N         the seed of the generated programs (default 1)\n");
+}
+
+/* Parses the value of an option into '*out', which must be in [min, max] */
+Status parse_option_value(const char* option, const char* str, long min, long max, long* out) {
+    if (view_to_long(view_of(str), min, max, out) != STATUS_SUCCESS) {
+        printf("invalid value '%s' for %s (expected %ld ... %ld)\n", str, option, min, max);
+        return STATUS_FAILURE;
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Writes a label operand to 'out': an extern, or a label that is defined before or after 'line'.
+ * returns FALSE if the file has no labels and no externs to refer to. */
+bool label_operand(GenOptions* options, FilePlan* plan, int line, char* out) {
+    /* The labels are numbered in the order they are defined, so the first label from 'line' on splits them */
+    int label = plan->next_label[line];
+
+    if (options->externs > 0 && (plan->num_labels == 0 || random_percent(options->extern_percent))) {
+        sprintf(out, "EXT%d", random_below(options->externs));
+    } else if (label < plan->num_labels && (label == 0 || random_percent(options->forward_percent))) {
+        sprintf(out, "L%d", label + random_below(plan->num_labels - label));
+    } else if (label > 0) {
+        sprintf(out, "L%d", random_below(label));
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Writes a random instruction to 'out', and returns the number of words it takes */
+int generate_instruction(GenOptions* options, FilePlan* plan, int line, char* out) {
+    /* The instructions without a label operand, for a file that has no labels */
+    static const int without_label[] = {0, 2, 7, 8, 10, 11};
+    char label[LABEL_NAME_SIZE];
+    int choice = random_below(12);
+
+    if (!label_operand(options, plan, line, label)) {
+        choice = without_label[random_below(sizeof(without_label) / sizeof(without_label[0]))];
+    }
+
+    switch (choice) {
+    case 0:
+        sprintf(out, "mov #%d, r%d", random_below(2000) - 1000, random_below(8));
+        return 3;
+    case 1:
+        sprintf(out, "add %s, r%d", label, random_below(8));
+        return 3;
+    case 2:
+        sprintf(out, "cmp r%d, #%d", random_below(8), random_below(100));
+        return 3;
+    case 3:
+        sprintf(out, "lea %s, r%d", label, random_below(8));
+        return 3;
+    case 4:
+        sprintf(out, "inc %s", label);
+        return 2;
+    case 5:
+        sprintf(out, "bne %s", label);
+        return 2;
+    case 6:
+        sprintf(out, "jsr %s", label);
+        return 2;
+    case 7:
+        sprintf(out, "sub r%d, *r%d", random_below(8), random_below(8));
+        return 2;
+    case 8:
+        sprintf(out, "prn #%d", random_below(100));
+        return 2;
+    case 9:
+        sprintf(out, "mov %s, %s", label, label);
+        return 3;
+    case 10:
+        sprintf(out, "clr *r%d", random_below(8));
+        return 2;
+    }
+    sprintf(out, "rts");
+    return 1;
+}
+
+/* Writes a random .data or .string directive to 'out', and returns the number of words it takes */
+int generate_data(char* out) {
+    int count = 1 + random_below(6);
+    int length = 0;
+    int i = 0;
+
+    if (random_below(2) == 0) {
+        length = sprintf(out, ".data %d", random_below(1000) - 500);
+        for (i = 1; i < count; i++) {
+            length += sprintf(out + length, ", %d", random_below(1000) - 500);
+        }
+        return count;
+    }
+
+    length = sprintf(out, ".string \"");
+    for (i = 0; i < count * 2; i++) {
+        out[length++] = (char)('a' + random_below(26));
+    }
+    sprintf(out + length, "\"");
+    return count * 2 + 1;
+}
+
+Status generate_file(GenOptions* options, FilePlan* plan, const char* path) {
+    FILE* file = NULL;
+    char text[MAX_LINE_SIZE + 1];
+    int header_lines = options->externs + 1 + options->macros * 4;
+    int words = 0;
+    int i = 0;
+
+    if (options->lines <= header_lines) {
+        printf("%s: --lines must be more than the %d lines of the externs, the entry and the macros\n", path, header_lines);
+        return STATUS_FAILURE;
+    }
+
+    plan->num_lines = options->lines - header_lines;
+    plan->num_labels = 0;
+    for (i = 0; i < plan->num_lines; i++) {
+        if (options->macros > 0 && random_percent(options->macro_percent)) {
+            plan->kinds[i] = LINE_MACRO_CALL;
+        } else {
+            plan->kinds[i] = random_percent(options->data_percent) ? LINE_DATA : LINE_INSTRUCTION;
+        }
+        plan->label_of_line[i] = (plan->kinds[i] != LINE_MACRO_CALL && random_percent(options->label_percent)) ? plan->num_labels++ : -1;
+    }
+    for (i = plan->num_lines - 1; i >= 0; i--) {
+        plan->next_label[i] = plan->label_of_line[i] >= 0 ? plan->label_of_line[i]
+                            : (i + 1 < plan->num_lines ? plan->next_label[i + 1] : plan->num_labels);
+    }
+
+    file = fopen(path, "w");
+    if (file == NULL) {
+        printf("%s: cannot open file for writing\n", path);
+        return STATUS_FAILURE;
+    }
+
+    for (i = 0; i < options->externs; i++) {
+        fprintf(file, ".extern EXT%d\n", i);
+    }
+    if (plan->num_labels > 0) {
+        fprintf(file, ".entry L0\n");
+    } else {
+        fprintf(file, "; no labels to export\n");
+    }
+
+    /* The macros don't use labels, so they can be defined before all the labels */
+    for (i = 0; i < options->macros; i++) {
+        fprintf(file, "macr M%d\ninc r%d\nmov #%d, r%d\nendmacr\n", i, random_below(8), random_below(100), random_below(8));
+    }
+
+    for (i = 0; i < plan->num_lines; i++) {
+        if (plan->label_of_line[i] >= 0) {
+            fprintf(file, "L%d: ", plan->label_of_line[i]);
+        }
+
+        switch (plan->kinds[i]) {
+        case LINE_MACRO_CALL:
+            fprintf(file, "M%d\n", random_below(options->macros));
+            words += 5;
+            break;
+        case LINE_DATA:
+            words += generate_data(text);
+            fprintf(file, "%s\n", text);
+            break;
+        case LINE_INSTRUCTION:
+            words += generate_instruction(options, plan, i, text);
+            fprintf(file, "%s\n", text);
+            break;
+        }
+    }
+
+    fclose(file);
+
+    if (words > WORD_BUDGET) {
+        printf("%s: the program takes %d words, more than the %d words of memory (use less --lines or --data)\n", path, words, WORD_BUDGET);
+        return STATUS_FAILURE;
+    }
+    return STATUS_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    GenOptions options;
+    FilePlan* plan = NULL;
+    FILE* manifest = NULL;
+    char* directory = NULL;
+    char* path = NULL;
+    long value = 0;
+    int status = 0;
+    int i = 0;
+
+    options.files = 50;
+    options.lines = 1000;
+    options.label_percent = 20;
+    options.forward_percent = 50;
+    options.macros = 8;
+    options.macro_percent = 10;
+    options.data_percent = 15;
+    options.externs = 4;
+    options.extern_percent = 10;
+    options.seed = 1;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == '-') {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+
+            if (strcmp(argv[i], "--files") == 0 && parse_option_value(argv[i], argv[i + 1], 1, MAX_FILES, &value) == STATUS_SUCCESS) {
+                options.files = value;
+            } else if (strcmp(argv[i], "--lines") == 0 && parse_option_value(argv[i], argv[i + 1], 1, MAX_GEN_LINES, &value) == STATUS_SUCCESS) {
+                options.lines = value;
+            } else if (strcmp(argv[i], "--labels") == 0 && parse_option_value(argv[i], argv[i + 1], 0, 100, &value) == STATUS_SUCCESS) {
+                options.label_percent = value;
+            } else if (strcmp(argv[i], "--forward") == 0 && parse_option_value(argv[i], argv[i + 1], 0, 100, &value) == STATUS_SUCCESS) {
+                options.forward_percent = value;
+            } else if (strcmp(argv[i], "--macros") == 0 && parse_option_value(argv[i], argv[i + 1], 0, 1000, &value) == STATUS_SUCCESS) {
+                options.macros = value;
+            } else if (strcmp(argv[i], "--macro-rate") == 0 && parse_option_value(argv[i], argv[i + 1], 0, 100, &value) == STATUS_SUCCESS) {
+                options.macro_percent = value;
+            } else if (strcmp(argv[i], "--data") == 0 && parse_option_value(argv[i], argv[i + 1], 0, 100, &value) == STATUS_SUCCESS) {
+                options.data_percent = value;
+            } else if (strcmp(argv[i], "--externs") == 0 && parse_option_value(argv[i], argv[i + 1], 0, 1000, &value) == STATUS_SUCCESS) {
+                options.externs = value;
+            } else if (strcmp(argv[i], "--extern-rate") == 0 && parse_option_value(argv[i], argv[i + 1], 0, 100, &value) == STATUS_SUCCESS) {
+                options.extern_percent = value;
+            } else if (strcmp(argv[i], "--seed") == 0 && parse_option_value(argv[i], argv[i + 1], 0, 0x7fffffffL, &value) == STATUS_SUCCESS) {
+                options.seed = value;
+            } else {
+                print_usage();
+                return 1;
+            }
+            i++;
+        } else if (directory == NULL) {
+            directory = argv[i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (directory == NULL) {
+        print_usage();
+        return 1;
+    }
+
+    plan = (FilePlan*)malloc(sizeof(FilePlan));
+    path = (char*)malloc(strlen(directory) + 32);
+    if (plan == NULL || path == NULL) {
+        printf("failed to allocate memory\n");
+        status = 1;
+        goto CLEANUP;
+    }
+
+    sprintf(path, "%s/files.txt", directory);
+    manifest = fopen(path, "w");
+    if (manifest == NULL) {
+        printf("%s: cannot open file for writing\n", path);
+        status = 1;
+        goto CLEANUP;
+    }
+
+    random_state = options.seed;
+    for (i = 0; i < options.files; i++) {
+        sprintf(path, "%s/bench_%d.as", directory, i);
+        if (generate_file(&options, plan, path) != STATUS_SUCCESS) {
+            status = 1;
+            break;
+        }
+        fprintf(manifest, "%s\n", path);
+    }
+
+CLEANUP:
+    if (manifest != NULL) {
+        fclose(manifest);
+    }
+    free(path);
+    free(plan);
+    return status;
+}
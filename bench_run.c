@@ -0,0 +1,261 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "linereader.h"
+#include "assembler.h"
+#include "outstream.h"
+#include "stats.h"
+#include "filelist.h"
+
+/* Measures the throughput of the assembler over a set of sources (e.g. the ones bench_gen generates):
+ *   bench_run [--repeat N] [--baseline FILE] [--save-baseline FILE] <file1.as> ... <fileN.as>
+ * All the files are assembled (with the .obb output, and without the file system: the outputs are kept in memory),
+ * and the whole assembly and every phase of it (as timed by the statistics of the assembler) is reported,
+ * the best of N runs, in lines and megabytes of source per second.
+ * With --baseline, every phase is compared to the numbers saved by an earlier --save-baseline. */
+
+/* The whole assembly, followed by the phases of StatsPhase */
+#define PHASE_ASSEMBLE 0
+#define NUM_PHASES (1 + STATS_NUM_PHASES)
+#define PHASE_NAME_SIZE 32
+/* A phase that is slower than its baseline by more than this (in percent) is marked */
+#define REGRESSION_PERCENT 5.0
+
+const char* phase_name(int phase) {
+    return phase == PHASE_ASSEMBLE ? "assemble" : stats_phase_names[phase - 1];
+}
+
+typedef struct {
+    double seconds; /* the best run */
+    double lines_per_second;
+    double mb_per_second;
+    double baseline_lines_per_second; /* 0 if there is no baseline */
+} PhaseResult;
+
+void print_usage(void) {
+    printf("usage: bench_run [--repeat N] [--baseline FILE] [--save-baseline FILE] <file1.as> ... <fileN.as>\n");
+    printf("       a source file named @<manifest> is replaced by the paths listed in <manifest> (one per line)\n");
+}
+
+double now_seconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Counts the lines and the bytes of all the sources. */
+Status measure_sources(char** paths, int count, long* lines, long* bytes) {
+    LineReader reader = {0};
+    const char* line = NULL;
+    int length = 0;
+    int line_number = 0;
+    int i = 0;
+
+    *lines = 0;
+    *bytes = 0;
+    for (i = 0; i < count; i++) {
+        if (linereader_open(&reader, paths[i]) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+        while (linereader_next(&reader, &line, &length, &line_number)) {
+            (*lines)++;
+        }
+        *bytes += reader.size;
+        linereader_close(&reader);
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Assembles all the sources once, and returns the time of every phase in 'seconds' (NUM_PHASES of them). */
+Status run_assembly(Assembler* assembler, char** paths, int count, double* seconds) {
+    FileStats stats;
+    OutputStream stream;
+    Status status = STATUS_SUCCESS;
+    double start = 0;
+    int phase = 0;
+    int i = 0;
+
+    memset(&stats, 0, sizeof(FileStats));
+    assembler->stats = &stats;
+    assembler->stream = &stream;
+
+    start = now_seconds();
+    for (i = 0; i < count && status == STATUS_SUCCESS; i++) {
+        status = assembler_reset(assembler);
+        if (status == STATUS_SUCCESS) {
+            /* The outputs of the previous file were released by assembler_reset */
+            outstream_init_memory(&stream, &assembler->arena);
+            status = assembler_assemble(assembler, paths[i], FALSE, TRUE);
+            if (status != STATUS_SUCCESS) {
+                print_diagnostic("%s: assembly failed\n", paths[i]);
+            }
+        }
+    }
+    seconds[PHASE_ASSEMBLE] = now_seconds() - start;
+
+    for (phase = 0; phase < STATS_NUM_PHASES; phase++) {
+        seconds[phase + 1] = stats.phases[phase].wall;
+    }
+    assembler->stats = NULL;
+    assembler->stream = NULL;
+    return status;
+}
+
+/* Reads the lines/s of every phase from a baseline file. a missing file is reported, but isn't an error. */
+void read_baseline(const char* path, PhaseResult* results) {
+    FILE* file = NULL;
+    char name[PHASE_NAME_SIZE];
+    double lines_per_second = 0;
+    double mb_per_second = 0;
+    int phase = 0;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        printf("no baseline in %s (save one with --save-baseline)\n", path);
+        return;
+    }
+
+    while (fscanf(file, "%31s %lf %lf", name, &lines_per_second, &mb_per_second) == 3) {
+        for (phase = 0; phase < NUM_PHASES; phase++) {
+            if (strcmp(name, phase_name(phase)) == 0) {
+                results[phase].baseline_lines_per_second = lines_per_second;
+            }
+        }
+    }
+    fclose(file);
+}
+
+Status save_baseline(const char* path, PhaseResult* results) {
+    FILE* file = NULL;
+    int phase = 0;
+
+    file = fopen(path, "w");
+    if (file == NULL) {
+        printf("%s: cannot open file for writing\n", path);
+        return STATUS_FAILURE;
+    }
+    for (phase = 0; phase < NUM_PHASES; phase++) {
+        fprintf(file, "%s %.0f %.3f\n", phase_name(phase), results[phase].lines_per_second, results[phase].mb_per_second);
+    }
+    fclose(file);
+    printf("saved the baseline to %s\n", path);
+    return STATUS_SUCCESS;
+}
+
+void print_results(PhaseResult* results) {
+    double change = 0;
+    int phase = 0;
+
+    printf("%-12s %10s %14s %10s %12s\n", "phase", "seconds", "lines/s", "MB/s", "vs baseline");
+    for (phase = 0; phase < NUM_PHASES; phase++) {
+        printf("%-12s %10.6f %14.0f %10.2f", phase_name(phase), results[phase].seconds,
+               results[phase].lines_per_second, results[phase].mb_per_second);
+        if (results[phase].baseline_lines_per_second > 0 && results[phase].lines_per_second > 0) {
+            change = 100.0 * (results[phase].lines_per_second / results[phase].baseline_lines_per_second - 1.0);
+            printf(" %+11.1f%%%s", change, change < -REGRESSION_PERCENT ? "  (slower)" : "");
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    Assembler assembler;
+    PhaseResult results[NUM_PHASES];
+    char** paths = NULL;
+    char* baseline_path = NULL;
+    char* save_path = NULL;
+    int num_files = 0;
+    int paths_capacity = 0;
+    long repeat = 5;
+    long lines = 0;
+    long bytes = 0;
+    double seconds[NUM_PHASES];
+    int status = 0;
+    int phase = 0;
+    int i = 0;
+
+    memset(results, 0, sizeof(results));
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 || strcmp(argv[i], "--baseline") == 0 || strcmp(argv[i], "--save-baseline") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                status = 1;
+                goto CLEANUP;
+            }
+            if (strcmp(argv[i], "--repeat") == 0 && view_to_long(view_of(argv[i + 1]), 1, 1000, &repeat) != STATUS_SUCCESS) {
+                printf("invalid number of runs '%s'\n", argv[i + 1]);
+                status = 1;
+                goto CLEANUP;
+            }
+            if (strcmp(argv[i], "--baseline") == 0) {
+                baseline_path = argv[i + 1];
+            } else if (strcmp(argv[i], "--save-baseline") == 0) {
+                save_path = argv[i + 1];
+            }
+            i++;
+        } else if (argv[i][0] == '@') {
+            if (read_manifest(argv[i] + 1, &paths, &num_files, &paths_capacity) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+        } else if (append_path(argv[i], &paths, &num_files, &paths_capacity) != STATUS_SUCCESS) {
+            status = 1;
+            goto CLEANUP;
+        }
+    }
+
+    if (num_files == 0) {
+        print_usage();
+        status = 1;
+        goto CLEANUP;
+    }
+
+    if (measure_sources(paths, num_files, &lines, &bytes) != STATUS_SUCCESS || assembler_init(&assembler) != STATUS_SUCCESS) {
+        status = 1;
+        goto CLEANUP;
+    }
+
+    /* Every phase keeps its own best run */
+    for (i = 0; i < repeat && status == 0; i++) {
+        if (run_assembly(&assembler, paths, num_files, seconds) != STATUS_SUCCESS) {
+            status = 1;
+            break;
+        }
+        for (phase = 0; phase < NUM_PHASES; phase++) {
+            if (i == 0 || seconds[phase] < results[phase].seconds) {
+                results[phase].seconds = seconds[phase];
+            }
+        }
+    }
+    for (phase = 0; phase < NUM_PHASES; phase++) {
+        if (results[phase].seconds > 0) {
+            results[phase].lines_per_second = lines / results[phase].seconds;
+            results[phase].mb_per_second = bytes / results[phase].seconds / 1e6;
+        }
+    }
+    assembler_free(&assembler);
+
+    if (status == 0) {
+        printf("%d files, %ld lines, %.2f MB, best of %ld runs\n", num_files, lines, bytes / 1e6, repeat);
+        if (baseline_path != NULL) {
+            read_baseline(baseline_path, results);
+        }
+        print_results(results);
+        if (save_path != NULL && save_baseline(save_path, results) != STATUS_SUCCESS) {
+            status = 1;
+        }
+    }
+
+CLEANUP:
+    for (i = 0; i < num_files; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    return status;
+}
@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "linereader.h"
+#include "cache.h"
+
+/* The first line of every entry. (format 2 records the outputs that weren't produced, as "<extension> -\n") */
+#define CACHE_FORMAT_VERSION "2"
+#define CACHE_ENTRY_HEADER "asm-cache " CACHE_FORMAT_VERSION " " ASSEMBLER_VERSION "\n"
+
+/* The outputs of a source, in the order they are stored */
+const char* cache_extensions[] = {"am", "ob", "ent", "ext", "obb"};
+const OutputKind cache_kinds[] = {OUTPUT_AM, OUTPUT_OB, OUTPUT_ENT, OUTPUT_EXT, OUTPUT_OBB};
+#define CACHE_NUM_EXTENSIONS 5
+
+Status cache_open(Cache* cache, const char* directory) {
+    memset(cache, 0, sizeof(Cache));
+
+    if (mkdir(directory, 0777) != 0 && errno != EEXIST) {
+        print_diagnostic("%s: cannot create the cache directory\n", directory);
+        return STATUS_FAILURE;
+    }
+
+    cache->directory = my_strdup(directory);
+    if (cache->directory == NULL) {
+        print_diagnostic("failed to allocate memory for the cache\n");
+        return STATUS_FAILURE;
+    }
+
+    pthread_mutex_init(&cache->lock, NULL);
+    return STATUS_SUCCESS;
+}
+
+void cache_close(Cache* cache) {
+    free(cache->directory);
+    pthread_mutex_destroy(&cache->lock);
+    memset(cache, 0, sizeof(Cache));
+}
+
+/* Two different 32-bit hashes (FNV-1a, and a murmur-style mix), so the key has 64 bits. */
+void cache_hash_update(unsigned int* hash1, unsigned int* hash2, const char* bytes, long size) {
+    unsigned int h1 = *hash1;
+    unsigned int h2 = *hash2;
+    long i = 0;
+
+    for (i = 0; i < size; i++) {
+        h1 ^= (byte)bytes[i];
+        h1 *= 16777619u;
+        h2 ^= (byte)bytes[i];
+        h2 *= 0x5bd1e995u;
+        h2 ^= h2 >> 15;
+    }
+    *hash1 = h1;
+    *hash2 = h2;
+}
+
+Status cache_key(const char* source_path, bool emit_am, bool emit_obb, char key[CACHE_KEY_SIZE]) {
+    /* Any rebuild of the assembler invalidates the cache, not only a new ASSEMBLER_VERSION */
+    const char* version = ASSEMBLER_VERSION " " __DATE__ " " __TIME__;
+    LineReader reader = {0};
+    struct stat source_stat;
+    unsigned int hash1 = 2166136261u;
+    unsigned int hash2 = 0x9747b28cu;
+
+    /* A missing source is reported by the assembler, don't report it twice */
+    if (stat(source_path, &source_stat) != 0 || !S_ISREG(source_stat.st_mode)) {
+        return STATUS_FAILURE;
+    }
+
+    if (linereader_open(&reader, source_path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    cache_hash_update(&hash1, &hash2, version, strlen(version));
+    cache_hash_update(&hash1, &hash2, emit_am ? "+am" : "-am", 3);
+    cache_hash_update(&hash1, &hash2, emit_obb ? "+obb" : "-obb", 4);
+    cache_hash_update(&hash1, &hash2, reader.buffer, reader.size);
+    sprintf(key, "%08x%08x-%lx", hash1, hash2, (unsigned long)reader.size);
+
+    linereader_close(&reader);
+    return STATUS_SUCCESS;
+}
+
+/* returns "<directory>/<key><suffix>", allocated from 'arena' */
+char* cache_entry_path(Cache* cache, Arena* arena, const char* key, const char* suffix) {
+    char* path = NULL;
+
+    path = (char*)arena_alloc(arena, strlen(cache->directory) + strlen(key) + strlen(suffix) + 2);
+    if (path != NULL) {
+        sprintf(path, "%s/%s%s", cache->directory, key, suffix);
+    }
+    return path;
+}
+
+/* Parses a "<extension> <size>\n" record header at 'position'. returns the position of the record contents, or -1.
+ * the size of a "<extension> -\n" record (an output that wasn't produced) is -1, and it has no contents. */
+long cache_parse_record(const char* buffer, long size, long position, const char** extension, int* extension_length, long* record_size) {
+    long start = position;
+
+    while (position < size && buffer[position] != ' ') {
+        position++;
+    }
+    if (position == size || position == start) {
+        return -1;
+    }
+    *extension = buffer + start;
+    *extension_length = position - start;
+    position++;
+
+    *record_size = 0;
+    if (position < size && buffer[position] == '-') {
+        *record_size = -1;
+        position++;
+    }
+    while (*record_size >= 0 && position < size && buffer[position] >= '0' && buffer[position] <= '9') {
+        *record_size = *record_size * 10 + (buffer[position] - '0');
+        position++;
+    }
+    if (position == size || buffer[position] != '\n' || *record_size > size - position - 1) {
+        return -1;
+    }
+    return position + 1;
+}
+
+/* Returns FALSE if the entry is damaged (nothing was written then), or if an output could not be written. */
+bool cache_write_outputs(Arena* arena, const char* source_path, const char* buffer, long size) {
+    const char* extension = NULL;
+    int extension_length = 0;
+    long record_size = 0;
+    long position = strlen(CACHE_ENTRY_HEADER);
+    char* output_path = NULL;
+    int i = 0;
+
+    if (size < position || memcmp(buffer, CACHE_ENTRY_HEADER, position) != 0) {
+        return FALSE;
+    }
+
+    /* Validate the whole entry before writing anything */
+    while (position < size) {
+        position = cache_parse_record(buffer, size, position, &extension, &extension_length, &record_size);
+        if (position < 0) {
+            return FALSE;
+        }
+        if (record_size > 0) {
+            position += record_size;
+        }
+    }
+
+    position = strlen(CACHE_ENTRY_HEADER);
+    while (position < size) {
+        position = cache_parse_record(buffer, size, position, &extension, &extension_length, &record_size);
+        for (i = 0; i < CACHE_NUM_EXTENSIONS; i++) {
+            if (strlen(cache_extensions[i]) == extension_length && memcmp(cache_extensions[i], extension, extension_length) == 0) {
+                break;
+            }
+        }
+        if (i == CACHE_NUM_EXTENSIONS) {
+            return FALSE;
+        }
+
+        /* Not produced: like a run that assembles the source, leave whatever file is there alone */
+        if (record_size < 0) {
+            continue;
+        }
+
+        output_path = change_extension(arena, (char*)source_path, (char*)cache_extensions[i]);
+        if (output_path == NULL || write_buffer_to_file((const byte*)buffer + position, record_size, output_path) != STATUS_SUCCESS) {
+            return FALSE;
+        }
+        position += record_size;
+    }
+
+    return TRUE;
+}
+
+bool cache_restore(Cache* cache, Arena* arena, const char* source_path, const char* key) {
+    LineReader reader = {0};
+    struct stat entry_stat;
+    char* entry_path = NULL;
+    bool is_hit = FALSE;
+
+    entry_path = cache_entry_path(cache, arena, key, "");
+    if (entry_path != NULL && stat(entry_path, &entry_stat) == 0 && linereader_open(&reader, entry_path) == STATUS_SUCCESS) {
+        is_hit = cache_write_outputs(arena, source_path, reader.buffer, reader.size);
+        linereader_close(&reader);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    if (is_hit) {
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return is_hit;
+}
+
+/* Appends the "<extension> <size>\n<contents>" record of an output, or "<extension> -\n" if it wasn't produced. */
+Status cache_append_output(ByteArray* entry, const char* extension, OutputBuffer* output) {
+    char record_header[64];
+
+    if (output->buffer == NULL) {
+        sprintf(record_header, "%s -\n", extension);
+        return bytearray_append(entry, (byte*)record_header, strlen(record_header));
+    }
+
+    sprintf(record_header, "%s %ld\n", extension, output->size);
+    if (bytearray_append(entry, (byte*)record_header, strlen(record_header)) != STATUS_SUCCESS ||
+        bytearray_append(entry, output->buffer, output->size) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    return STATUS_SUCCESS;
+}
+
+void cache_store(Cache* cache, Arena* arena, const char* key, OutputStream* outputs, bool emit_am, bool emit_obb) {
+    ByteArray entry = {0};
+    char* entry_path = NULL;
+    char* temp_path = NULL;
+    char temp_suffix[64];
+    int temp_id = 0;
+    int i = 0;
+
+    if (bytearray_init(&entry, arena) != STATUS_SUCCESS ||
+        bytearray_append(&entry, (byte*)CACHE_ENTRY_HEADER, strlen(CACHE_ENTRY_HEADER)) != STATUS_SUCCESS) {
+        return;
+    }
+
+    /* Exactly what this assembly produced (the outputs that weren't requested get no record at all) */
+    for (i = 0; i < CACHE_NUM_EXTENSIONS; i++) {
+        if ((!emit_am && cache_kinds[i] == OUTPUT_AM) || (!emit_obb && cache_kinds[i] == OUTPUT_OBB)) {
+            continue;
+        }
+
+        if (cache_append_output(&entry, cache_extensions[i], &outputs->buffers[cache_kinds[i]]) != STATUS_SUCCESS) {
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    temp_id = cache->next_temp_id;
+    cache->next_temp_id++;
+    pthread_mutex_unlock(&cache->lock);
+
+    /* Written to a temporary file and renamed, so other processes never see a partial entry */
+    sprintf(temp_suffix, ".tmp.%ld.%d", (long)getpid(), temp_id);
+    entry_path = cache_entry_path(cache, arena, key, "");
+    temp_path = cache_entry_path(cache, arena, key, temp_suffix);
+    if (entry_path == NULL || temp_path == NULL) {
+        return;
+    }
+
+    if (write_bytearray_to_file(&entry, temp_path) != STATUS_SUCCESS) {
+        remove(temp_path);
+        return;
+    }
+
+    if (rename(temp_path, entry_path) != 0) {
+        print_diagnostic("%s: failed to store the cache entry\n", entry_path);
+        remove(temp_path);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stores++;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void cache_print_stats(Cache* cache) {
+    print_diagnostic("cache: %d hits, %d misses, %d stored\n", cache->hits, cache->misses, cache->stores);
+}
@@ -0,0 +1,44 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <pthread.h>
+#include "common.h"
+#include "outstream.h"
+
+/* The version of the outputs. change it whenever the output of the assembler changes. */
+#define ASSEMBLER_VERSION "1.1"
+
+/* "<hash1><hash2>-<size>": 2 x 8 hex digits, a '-', up to 16 hex digits of the source size, and a '\0' */
+#define CACHE_KEY_SIZE 36
+
+/* A build cache: the outputs of every successfully assembled source are stored in 'directory',
+ * under a key computed from the source bytes, the assembler version and the options.
+ * Assembling an unchanged source again restores the outputs instead. */
+typedef struct {
+    char* directory;
+    int hits;
+    int misses;
+    int stores;
+    int next_temp_id; /* makes the temporary file of every store unique */
+    pthread_mutex_t lock; /* protects the counters, the cache is shared by all the workers */
+} Cache;
+
+/* Opens the cache in 'directory', creating the directory if needed. */
+Status cache_open(Cache* cache, const char* directory);
+void cache_close(Cache* cache);
+
+/* Computes the key of 'source_path' into 'key'. Returns STATUS_FAILURE (quietly) if the source can't be read. */
+Status cache_key(const char* source_path, bool emit_am, bool emit_obb, char key[CACHE_KEY_SIZE]);
+
+/* Writes the cached outputs of 'key' next to 'source_path'. Returns FALSE on a miss.
+ * Temporary strings are allocated from 'arena'. */
+bool cache_restore(Cache* cache, Arena* arena, const char* source_path, const char* key);
+
+/* Stores the outputs of a successfully assembled source (kept in memory by 'outputs') under 'key'.
+ * the ones that weren't produced are recorded too, so a hit never restores a stale file. Failures are reported, but are not errors. */
+void cache_store(Cache* cache, Arena* arena, const char* key, OutputStream* outputs, bool emit_am, bool emit_obb);
+
+/* Prints the number of hits, misses and stores. */
+void cache_print_stats(Cache* cache);
+
+#endif
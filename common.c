@@ -1,62 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include "common.h"
+#include "scan.h"
 
-const char* reserved_words[NUM_RESERVED_WORDS] = {
-    "mov", "cmp", "add", "sub", "lea", "clr", "not", "inc", "dec", 
-    "jmp", "bne", "red", "prn", "jsr", "rts", "stop",
-    "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
-    "macr", "endmacr", 
-    "data", "string", "entry", "extern"
-};
+/* The number of views written by a single writev. POSIX only guarantees IOV_MAX >= 16, Linux allows 1024 */
+#ifdef __linux__
+#define WRITEV_MAX_VIEWS 1024
+#else
+#define WRITEV_MAX_VIEWS 16
+#endif
+
+pthread_key_t diagnostics_key;
+pthread_once_t diagnostics_key_once = PTHREAD_ONCE_INIT;
 
 bool is_whitespace(char ch) {
     return ch == ' ' || ch == '\n' || ch == '\t';
 }
 
-void tokens_init(Tokens* tokens, char* line) {
+unsigned int hash_bytes(const char* bytes, int length) {
+    unsigned int hash = 2166136261u;
+    int i = 0;
+
+    for (i = 0; i < length; i++) {
+        hash ^= (byte)bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+unsigned int hash_string(const char* str) {
+    return hash_bytes(str, strlen(str));
+}
+
+StringView view_of(const char* str) {
+    StringView view;
+    view.start = str;
+    view.length = strlen(str);
+    return view;
+}
+
+bool view_equals(StringView view, const char* str) {
+    int i = 0;
+    for (i = 0; i < view.length; i++) {
+        if (str[i] == '\0' || str[i] != view.start[i]) {
+            return FALSE;
+        }
+    }
+    return str[view.length] == '\0';
+}
+
+Status view_to_long(StringView view, long min, long max, long* out) {
+    int i = 0;
+    long value = 0;
+    bool is_negative = FALSE;
+
+    if (view.length > 0 && (view.start[0] == '-' || view.start[0] == '+')) {
+        is_negative = (view.start[0] == '-');
+        i++;
+    }
+
+    if (i == view.length) {
+        return STATUS_FAILURE;
+    }
+
+    for (; i < view.length; i++) {
+        if (!isdigit((byte)view.start[i])) {
+            return STATUS_FAILURE;
+        }
+
+        value = value * 10 + (view.start[i] - '0');
+        if (value > max - min) { /* out of range anyway, stop before it overflows */
+            return STATUS_FAILURE;
+        }
+    }
+
+    if (is_negative) {
+        value = -value;
+    }
+
+    if (value < min || value > max) {
+        return STATUS_FAILURE;
+    }
+
+    *out = value;
+    return STATUS_SUCCESS;
+}
+
+void tokens_init(Tokens* tokens, const char* line, int line_len) {
   int i = 0;
-  int token_start_index = -1;
-  int token_length = 0;
-  int line_len = strlen(line);
+  int token_end = 0;
 
   tokens->size = 0;
-  memset(tokens->tokens, 0, LINEBUFFER_SIZE * LINEBUFFER_SIZE);
-
-  for (i = 0; i < line_len; i++) {
-        if (token_start_index == -1) { /* The case where we are not reading a token right now */
-            if (is_whitespace(line[i])) {
-                continue;
-            } else {
-                token_start_index = i;
-                continue;
-            }
-        } 
-
-        /* We are reading a token right now */
-        if (is_whitespace(line[i])) {
-            token_length = i - token_start_index;
-            memcpy(tokens->tokens[tokens->size], line + token_start_index, token_length);
-            tokens->size += 1;
-            token_start_index = -1;
-        } else {
-            continue;
-        }   
-  }
 
-  if (token_start_index != -1) {
-    token_length = i - token_start_index;
-    memcpy(tokens->tokens[tokens->size], line + token_start_index, token_length);
-    tokens->size += 1;
+  i = scan_skip_whitespace(line, 0, line_len);
+  while (i < line_len) {
+      token_end = scan_find(line, i, line_len, SCAN_WHITESPACE);
+      tokens->tokens[tokens->size].start = line + i;
+      tokens->tokens[tokens->size].length = token_end - i;
+      tokens->size += 1;
+      i = scan_skip_whitespace(line, token_end, line_len);
   }
 }
 
-Status bytearray_init(ByteArray* bytearray) {
-    bytearray->buffer = malloc(1024);
+Status bytearray_init(ByteArray* bytearray, Arena* arena) {
+    bytearray->arena = arena;
+    bytearray->buffer = arena_alloc(arena, 1024);
     if (bytearray->buffer == NULL) {
-      printf("failed to initialize bytearray");
+      print_diagnostic("failed to initialize bytearray");
       return STATUS_FAILURE;
     }
 
@@ -65,27 +123,33 @@ Status bytearray_init(ByteArray* bytearray) {
     return STATUS_SUCCESS;
 }
 
-void bytearray_free(ByteArray* bytearray) {
-  free(bytearray->buffer);
-  bytearray->buffer = NULL;
-  bytearray->size = 0;
-  bytearray->capacity = 0;
-}
-
-Status bytearray_append(ByteArray* bytearray, byte* bytes_to_append, int size_to_append) {
+/* When 'buffer' is the last allocation of the arena (e.g. a macro content that is being collected) it grows in place. */
+Status bytearray_reserve(ByteArray* bytearray, int size_to_reserve) {
     byte* new_buffer = NULL;
+    int new_capacity = bytearray->capacity;
 
-    while (bytearray->size + size_to_append > bytearray->capacity) {
-        new_buffer = malloc(2 * bytearray->capacity);
-        if (new_buffer == NULL) {
-            printf("malloc failed\n");
-            return STATUS_FAILURE;
-        }
+    if (bytearray->size + size_to_reserve <= bytearray->capacity) {
+        return STATUS_SUCCESS;
+    }
+
+    while (bytearray->size + size_to_reserve > new_capacity) {
+        new_capacity *= 2;
+    }
+
+    new_buffer = arena_resize(bytearray->arena, bytearray->buffer, bytearray->size, new_capacity);
+    if (new_buffer == NULL) {
+        print_diagnostic("malloc failed\n");
+        return STATUS_FAILURE;
+    }
+
+    bytearray->buffer = new_buffer;
+    bytearray->capacity = new_capacity;
+    return STATUS_SUCCESS;
+}
 
-        memcpy(new_buffer, bytearray->buffer, bytearray->size);
-        free(bytearray->buffer);
-        bytearray->buffer = new_buffer;
-        bytearray->capacity *= 2;
+Status bytearray_append(ByteArray* bytearray, byte* bytes_to_append, int size_to_append) {
+    if (bytearray_reserve(bytearray, size_to_append) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
     }
 
     memcpy(bytearray->buffer + bytearray->size, bytes_to_append, size_to_append);
@@ -93,39 +157,89 @@ Status bytearray_append(ByteArray* bytearray, byte* bytes_to_append, int size_to
     return STATUS_SUCCESS;
 }
 
-Status write_bytearray_to_file(ByteArray* bytearray, char* file_path) {
-    FILE* file = 0;
+Status write_bytearray_to_file(ByteArray* bytearray, const char* file_path) {
+    return write_buffer_to_file(bytearray->buffer, bytearray->size, file_path);
+}
+
+Status write_buffer_to_file(const byte* buffer, long size, const char* file_path) {
+    int fd = -1;
+    long written = 0;
+    ssize_t result = 0;
 
-    file = fopen(file_path, "wb");
-    if (file == NULL) {
-        printf("failed to open file %s for writing\n", file_path);
+    fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        print_diagnostic("failed to open file %s for writing\n", file_path);
         return STATUS_FAILURE;
     }
 
-    if (fwrite(bytearray->buffer, 1, bytearray->size, file) != bytearray->size) {
-        printf("failed to write to file %s\n", file_path);
-        fclose(file);
+    while (written < size) {
+        result = write(fd, buffer + written, size - written);
+        if (result < 0) {
+            print_diagnostic("failed to write to file %s\n", file_path);
+            close(fd);
+            return STATUS_FAILURE;
+        }
+        written += result;
+    }
+
+    if (close(fd) != 0) {
+        print_diagnostic("failed to write to file %s\n", file_path);
         return STATUS_FAILURE;
     }
+    return STATUS_SUCCESS;
+}
+
+Status write_views(int fd, StringView* views, int count) {
+    struct iovec iov[WRITEV_MAX_VIEWS];
+    int num_iov = 0;
+    int i = 0;
+    ssize_t written = 0;
+
+    while (count > 0) {
+        num_iov = count < WRITEV_MAX_VIEWS ? count : WRITEV_MAX_VIEWS;
+        for (i = 0; i < num_iov; i++) {
+            iov[i].iov_base = (void*)views[i].start;
+            iov[i].iov_len = views[i].length;
+        }
+
+        written = writev(fd, iov, num_iov);
+        if (written < 0) {
+            return STATUS_FAILURE;
+        }
+
+        /* Skip the views that were written. a partially written view is shortened and written again */
+        for (i = 0; i < num_iov && written >= views[i].length; i++) {
+            written -= views[i].length;
+        }
+        if (i < num_iov) {
+            views[i].start += written;
+            views[i].length -= written;
+        }
+        views += i;
+        count -= i;
+    }
 
-    fclose(file);
     return STATUS_SUCCESS;
 }
 
+bool has_extension(const char* path, const char* extension) {
+    const char* dot = strrchr(path, '.');
+    return dot != NULL && strcmp(dot + 1, extension) == 0;
+}
 
 Status validate_extension(char* str, char* extension) {
   if (strlen(str) <= strlen(extension)) {
-    printf("%s: invalid extension (should be %s)\n", str, extension);
+    print_diagnostic("%s: invalid extension (should be %s)\n", str, extension);
     return STATUS_FAILURE;
   }
 
   if (str[strlen(str) - strlen(extension) - 1] != '.') {
-    printf("%s: invalid extension (should be %s)\n", str, extension);
+    print_diagnostic("%s: invalid extension (should be %s)\n", str, extension);
     return STATUS_FAILURE;
   }
 
   if (strcmp(str + strlen(str) - strlen(extension), extension) != 0) {
-        printf("%s: invalid extension (should be %s)\n", str, extension);
+        print_diagnostic("%s: invalid extension (should be %s)\n", str, extension);
         return STATUS_FAILURE;
     }
 
@@ -140,51 +254,94 @@ char* my_strdup(const char* src) {
     return dest;
 }
 
-char* base_name(char* path){
+void print_json_string(FILE* out, const char* str) {
+    fputc('"', out);
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf(out, "\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*str);
+        } else {
+            fputc(*str, out);
+        }
+    }
+    fputc('"', out);
+}
+
+char* base_name(Arena* arena, char* path){
     char* result = NULL;
     int size = 0;
     int i = 0;
 
     size = strlen(path);
-    result = malloc(size + 1);
-    if (result == NULL) {
-        printf("base_name: malloc failed\n");
-        return NULL;
-    }
-    memcpy(result, path, size + 1);
-
     for (i = size - 1; i >= 0; i--) {
-        if (result[i] == '.') {
-            result[i] = '\0';
-            return result;
+        if (path[i] == '.') {
+            break;
         }
     }
 
-    printf("base_name: no '.' charachter found\n");
-    free(result);
-    return NULL;
+    if (i < 0) {
+        print_diagnostic("base_name: no '.' charachter found\n");
+        return NULL;
+    }
+
+    result = arena_alloc(arena, i + 1);
+    if (result == NULL) {
+        print_diagnostic("base_name: malloc failed\n");
+        return NULL;
+    }
+    memcpy(result, path, i);
+    result[i] = '\0';
+    return result;
 }
 
-char* change_extension(char* path, char* new_extension) {
+char* change_extension(Arena* arena, char* path, char* new_extension) {
     char* base = 0;
     char* result = 0;
+    int base_length = 0;
 
-    base = base_name(path);
+    base = base_name(arena, path);
     if (base == NULL) {
         return NULL;
     }
 
-    result = malloc(strlen(base) + strlen(new_extension) + 2); /* extra space for a '.' and a '\0' */
+    /* 'base' is the last allocation, so it can grow in place into the result */
+    base_length = strlen(base);
+    result = arena_resize(arena, base, base_length + 1, base_length + strlen(new_extension) + 2); /* extra space for a '.' and a '\0' */
     if (result == NULL) {
-        printf("change_extension: malloc failed\n");
-        free(base);
+        print_diagnostic("change_extension: malloc failed\n");
         return NULL;
     }
 
-    strcpy(result, base);
     strcat(result, ".");
     strcat(result, new_extension);
-
-    free(base);
     return result;
 }
+
+void diagnostics_key_init(void) {
+    pthread_key_create(&diagnostics_key, NULL);
+}
+
+FILE* diagnostics_set_stream(FILE* stream) {
+    FILE* previous = NULL;
+
+    pthread_once(&diagnostics_key_once, diagnostics_key_init);
+    previous = (FILE*)pthread_getspecific(diagnostics_key);
+    pthread_setspecific(diagnostics_key, stream);
+    return previous;
+}
+
+void print_diagnostic(const char* format, ...) {
+    FILE* stream = NULL;
+    va_list args;
+
+    pthread_once(&diagnostics_key_once, diagnostics_key_init);
+    stream = (FILE*)pthread_getspecific(diagnostics_key);
+    if (stream == NULL) {
+        stream = stdout;
+    }
+
+    va_start(args, format);
+    vfprintf(stream, format, args);
+    va_end(args);
+}
@@ -1,6 +1,9 @@
 #ifndef _COMMON_H
 #define _COMMON_H
 
+#include <stdio.h>
+#include "arena.h"
+
 #define TRUE 1
 #define FALSE 0
 
@@ -9,8 +12,9 @@
 #define LINEBUFFER_SIZE (MAX_LINE_SIZE + 2)
 #define INITIAL_CAPACITY 1024
 
-#define NUM_RESERVED_WORDS 30
-extern const char* reserved_words[NUM_RESERVED_WORDS];
+/* The source path that means stdin, and its name in diagnostics */
+#define STDIN_PATH "-"
+#define STDIN_NAME "<stdin>"
 
 typedef unsigned char Status;
 #define STATUS_SUCCESS 0
@@ -22,10 +26,17 @@ typedef unsigned char byte;
 /* a word the 15 least-significant bits in an 'unsigned short'*/
 typedef unsigned short Word;
 
+/* A part of a string (e.g. a token inside a source line). it is not null-terminated. */
+typedef struct {
+    const char* start;
+    int length;
+} StringView;
+
 typedef struct bytearray_t {
     byte* buffer;
     int capacity;
     int size;
+    Arena* arena; /* 'buffer' is allocated from here, and released with it */
 } ByteArray;
 
 typedef enum {
@@ -39,39 +50,68 @@ typedef enum {
     LABEL_DATA
 } CodeOrData;
 
-Status bytearray_init(ByteArray* bytearray);
-void bytearray_free(ByteArray* bytearray);
+Status bytearray_init(ByteArray* bytearray, Arena* arena);
 Status bytearray_append(ByteArray* bytearray, byte* bytes_to_append, int size_to_append);
+/* Makes sure there is room for 'size_to_reserve' more bytes after the current 'size'. */
+Status bytearray_reserve(ByteArray* bytearray, int size_to_reserve);
 
 typedef struct {
-    char tokens[LINEBUFFER_SIZE][LINEBUFFER_SIZE]; /* A 2d-array to hold tokens. rows are tokens, cols are token characthers. */
+    StringView tokens[LINEBUFFER_SIZE]; /* views into the line. a line that fits in LINEBUFFER_SIZE has less tokens than that */
     int size;
 } Tokens;
 
-/* Reads the line 'line' and splits is to tokens from whitespaces.
- * e.g. "   hello   world"  -> ["hello", "world"].
- * the caller must call tokens_free on the 'tokens' struct. */
-void tokens_init(Tokens* tokens, char* line);
+/* Reads the first 'line_len' characters of 'line' and splits them to tokens from whitespaces.
+ * e.g. "   hello   world"  -> ["hello", "world"]. the tokens point into 'line', nothing is copied. */
+void tokens_init(Tokens* tokens, const char* line, int line_len);
 
-Status write_bytearray_to_file(ByteArray* bytearray, char* file_path);
+/* Writes 'size' bytes to 'file_path' with a single write (unless the system writes it partially). */
+Status write_buffer_to_file(const byte* buffer, long size, const char* file_path);
+/* Writes the contents of 'bytearray' to 'file_path', like write_buffer_to_file. */
+Status write_bytearray_to_file(ByteArray* bytearray, const char* file_path);
 
-/* returns a new string, identical to the input, but without an extension.
+/* Writes 'count' views, one after the other, to 'fd' with as few writev calls as possible. */
+Status write_views(int fd, StringView* views, int count);
+
+/* returns a new string (allocated from 'arena'), identical to the input, but without an extension.
  * e.g. testdata/example1.as -> testdata/example1 /
  * returns NULL on failure (e.g. if no '.' was found)
- * the caller must call free() on the returned pointer.
  * */
-char* base_name(char* path);
+char* base_name(Arena* arena, char* path);
 
-/* returns a new string, identical to the input, but with a new extension.
- * e.g. change_extension("testdata/example1.as", "txt") -> "testdata/example1.txt"
+/* returns a new string (allocated from 'arena'), identical to the input, but with a new extension.
+ * e.g. change_extension(arena, "testdata/example1.as", "txt") -> "testdata/example1.txt"
  * returns NULL on failure (e.g. if no '.' was found)
- * the caller must call free() on the returned pointer.
  * */
-char* change_extension(char* path, char* new_extension);
+char* change_extension(Arena* arena, char* path, char* new_extension);
 Status validate_extension(char* str, char* extension);
+/* TRUE if the extension of 'path' (after the last '.') is 'extension'. unlike validate_extension, nothing is printed. */
+bool has_extension(const char* path, const char* extension);
 
 bool is_whitespace(char ch);
 
+/* FNV-1a hash of 'length' bytes. used by the hash-indexed tables. */
+unsigned int hash_bytes(const char* bytes, int length);
+unsigned int hash_string(const char* str);
+
+/* returns a view of the whole null-terminated string 'str'. */
+StringView view_of(const char* str);
+/* TRUE if 'view' holds exactly the null-terminated string 'str'. */
+bool view_equals(StringView view, const char* str);
+
+/* Parses a decimal integer with an optional sign, that must take the whole view.
+ * returns STATUS_FAILURE if the view is not a number, or if the number is out of [min, max]. */
+Status view_to_long(StringView view, long min, long max, long* out);
+
 char* my_strdup(const char* src);
 
+/* Writes 'str' to 'out' as a JSON string (quoted and escaped). */
+void print_json_string(FILE* out, const char* str);
+
+/* Prints an error message (printf-style) to the diagnostics stream of the calling thread. */
+void print_diagnostic(const char* format, ...);
+
+/* Sets the diagnostics stream of the calling thread, and returns the one it replaces. NULL (the default) means stdout.
+ * this lets the batch driver collect the messages of every file separately. */
+FILE* diagnostics_set_stream(FILE* stream);
+
 #endif
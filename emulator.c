@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "common.h"
+#include "objfile.h"
+#include "assembler.h"
+#include "emulator.h"
+
+/* With gcc (and clang), every handler jumps straight to the next one through a table of label addresses
+ * (a "computed goto"), instead of going back to a single switch. it's an extension (see emulator_run). */
+#if defined(__GNUC__)
+#define EMULATOR_THREADED
+#endif
+
+#define WORD_MASK 077777
+#define ARE_MASK 7
+#define ADDRESS_SHIFT 3
+#define IMMEDIATE_SIGN 04000 /* the sign bit of a 12-bit immediate value */
+
+/* The opcodes, in the order of opcodeTable */
+#define OP_MOV 0
+#define OP_CMP 1
+#define OP_ADD 2
+#define OP_SUB 3
+#define OP_LEA 4
+#define OP_CLR 5
+#define OP_NOT 6
+#define OP_INC 7
+#define OP_DEC 8
+#define OP_JMP 9
+#define OP_BNE 10
+#define OP_RED 11
+#define OP_PRN 12
+#define OP_JSR 13
+#define OP_RTS 14
+#define OP_STOP 15
+
+/* TRUE if 'addressing' is exactly one of the addressings in 'valid' */
+bool is_single_addressing(byte addressing, byte valid) {
+    return addressing != ADDRESSING_NONE && (addressing & (addressing - 1)) == 0 && (addressing & valid) != 0;
+}
+
+/* Decodes an operand word. 'register_shift' is the position of the register number in the word.
+ * 'is_address' is TRUE for the operands that are used as addresses (lea's source, the target of a jump),
+ * so a label gives its address and "*r" gives the value of the register, instead of the words they point to.
+ * Returns FALSE if the word is not a valid operand (e.g. an extern that wasn't resolved). */
+bool decode_operand(Emulator* emulator, byte addressing, Word word, int register_shift, bool is_address,
+                    Word** operand, Word* value, byte* indirect) {
+    int number = word >> ADDRESS_SHIFT;
+
+    *indirect = FALSE;
+    switch (addressing) {
+    case ADDRESSING_0:
+        *value = (Word)((number & IMMEDIATE_SIGN) ? (number | ~07777) & WORD_MASK : number);
+        *operand = value;
+        return TRUE;
+    case ADDRESSING_1:
+        if ((word & ARE_MASK) == ARE_EXTERNAL) {
+            return FALSE;
+        }
+        if (is_address) {
+            *value = (Word)number;
+            *operand = value;
+        } else {
+            *operand = &emulator->memory[number];
+        }
+        return TRUE;
+    case ADDRESSING_2:
+        *operand = &emulator->registers[(word >> register_shift) & 7];
+        *indirect = !is_address;
+        return TRUE;
+    case ADDRESSING_3:
+        *operand = &emulator->registers[(word >> register_shift) & 7];
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* Decodes the instruction at 'address' into 'decoded[address]'. an invalid instruction is decoded as EMU_OP_ILLEGAL. */
+void emulator_decode(Emulator* emulator, int address) {
+    DecodedInstruction* instruction = &emulator->decoded[address];
+    Word word = emulator->memory[address];
+    int opcode = word >> 11;
+    byte src = (word >> 7) & 0xf;
+    byte dst = (word >> 3) & 0xf;
+    const OpcodeTableEntry* entry = &opcodeTable[opcode];
+    bool is_jump = (opcode == OP_JMP || opcode == OP_BNE || opcode == OP_JSR);
+    int position = address + 1;
+
+    instruction->op = EMU_OP_ILLEGAL;
+    instruction->length = 1;
+    instruction->src = &instruction->src_value;
+    instruction->dst = &instruction->dst_value;
+    instruction->src_indirect = FALSE;
+    instruction->dst_indirect = FALSE;
+
+    if ((word & ARE_MASK) != ARE_ABSOLUTE) {
+        return;
+    }
+    if (entry->operands_num == 2 ? !is_single_addressing(src, entry->valid_src_operands) : src != ADDRESSING_NONE) {
+        return;
+    }
+    if (entry->operands_num >= 1 ? !is_single_addressing(dst, entry->valid_dst_operands) : dst != ADDRESSING_NONE) {
+        return;
+    }
+    if (position + (entry->operands_num == 2 && src >= ADDRESSING_2 && dst >= ADDRESSING_2 ? 1 : entry->operands_num) > MAX_MEMORY_SIZE) {
+        return;
+    }
+
+    if (entry->operands_num == 2 && src >= ADDRESSING_2 && dst >= ADDRESSING_2) {
+        /* Two register operands share a single word */
+        decode_operand(emulator, src, emulator->memory[position], 6, FALSE, &instruction->src, &instruction->src_value, &instruction->src_indirect);
+        decode_operand(emulator, dst, emulator->memory[position], 3, FALSE, &instruction->dst, &instruction->dst_value, &instruction->dst_indirect);
+        position++;
+    } else {
+        if (entry->operands_num == 2) {
+            if (!decode_operand(emulator, src, emulator->memory[position], 6, opcode == OP_LEA,
+                                &instruction->src, &instruction->src_value, &instruction->src_indirect)) {
+                return;
+            }
+            position++;
+        }
+        if (entry->operands_num >= 1) {
+            if (!decode_operand(emulator, dst, emulator->memory[position], 3, is_jump,
+                                &instruction->dst, &instruction->dst_value, &instruction->dst_indirect)) {
+                return;
+            }
+            position++;
+        }
+    }
+
+    instruction->op = opcode;
+    instruction->length = position - address;
+    if (address < emulator->decoded_low) {
+        emulator->decoded_low = address;
+    }
+    if (position > emulator->decoded_high) {
+        emulator->decoded_high = position;
+    }
+}
+
+/* Drops the decoded instructions that contain the word at 'address', after it was overwritten. */
+void emulator_invalidate(Emulator* emulator, int address) {
+    int i = 0;
+
+    for (i = address - (EMULATOR_MAX_INSTRUCTION_SIZE - 1); i <= address; i++) {
+        if (i >= 0) {
+            emulator->decoded[i].op = EMU_OP_DECODE;
+        }
+    }
+}
+
+Status emulator_load(Emulator* emulator, ObjectFile* object, const char* path) {
+    int i = 0;
+
+    if (object->num_externs > 0) {
+        print_diagnostic("%s: the program references externs (e.g. '%.*s'), link it with oblink first\n", path,
+                         object->externs[0].name.length, object->externs[0].name.start);
+        return STATUS_FAILURE;
+    }
+    if (object->load_base < 0 || object->code_size < 1 ||
+        (long)object->load_base + object->code_size + object->data_size > MAX_MEMORY_SIZE) {
+        print_diagnostic("%s: the program doesn't fit in the memory\n", path);
+        return STATUS_FAILURE;
+    }
+
+    memset(emulator->memory, 0, sizeof(emulator->memory));
+    memset(emulator->registers, 0, sizeof(emulator->registers));
+    memcpy(emulator->memory + object->load_base, object->code, object->code_size * sizeof(Word));
+    memcpy(emulator->memory + object->load_base + object->code_size, object->data, object->data_size * sizeof(Word));
+
+    for (i = 0; i < MAX_MEMORY_SIZE; i++) {
+        emulator->decoded[i].op = EMU_OP_DECODE;
+    }
+    for (i = MAX_MEMORY_SIZE; i < MAX_MEMORY_SIZE + EMULATOR_MAX_INSTRUCTION_SIZE; i++) {
+        emulator->decoded[i].op = EMU_OP_OUTSIDE;
+        emulator->decoded[i].length = 1;
+    }
+    emulator->decoded_low = MAX_MEMORY_SIZE;
+    emulator->decoded_high = 0;
+
+    /* The code is decoded ahead, instruction after instruction */
+    i = object->load_base;
+    while (i < object->load_base + object->code_size) {
+        emulator_decode(emulator, i);
+        i += emulator->decoded[i].length;
+    }
+
+    emulator->zero = FALSE;
+    emulator->pc = object->load_base;
+    emulator->stack_size = 0;
+    emulator->steps = 0;
+    if (emulator->input == NULL) {
+        emulator->input = stdin;
+    }
+    if (emulator->output == NULL) {
+        emulator->output = stdout;
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Resolves an operand that may be indirect ("*r"). jumps to ADDRESS_FAULT if the register doesn't hold an address. */
+#define LOAD_OPERAND(operand, pointer, indirect) \
+    do { \
+        operand = (pointer); \
+        if (indirect) { \
+            if (*operand >= MAX_MEMORY_SIZE) { \
+                fault_address = *operand; \
+                goto ADDRESS_FAULT; \
+            } \
+            operand = memory + *operand; \
+        } \
+    } while (0)
+
+#define LOAD_SRC() LOAD_OPERAND(src, instruction->src, instruction->src_indirect)
+#define LOAD_DST() LOAD_OPERAND(dst, instruction->dst, instruction->dst_indirect)
+
+/* Stores to a word that may hold a decoded instruction drop that instruction */
+#define STORE(operand, value) \
+    do { \
+        *(operand) = (Word)((value) & WORD_MASK); \
+        if ((operand) >= watch_low && (operand) < watch_high) { \
+            emulator_invalidate(emulator, (operand) - memory); \
+        } \
+    } while (0)
+
+#ifdef EMULATOR_THREADED
+#define HANDLER(op) HANDLE_##op:
+#define DISPATCH() goto *handlers[instruction->op]
+#else
+#define HANDLER(op) case op:
+#define DISPATCH() goto DISPATCH
+#endif
+
+/* Every instruction that ran (but stop) ends with NEXT or JUMP */
+#define COUNT_STEP() \
+    do { \
+        if (--budget == 0) { \
+            result = EMULATOR_STEP_LIMIT; \
+            goto EXIT; \
+        } \
+    } while (0)
+
+#define NEXT() \
+    do { \
+        instruction += instruction->length; \
+        COUNT_STEP(); \
+        DISPATCH(); \
+    } while (0)
+
+/* 'address' is evaluated once, it may pop the stack */
+#define JUMP(address) \
+    do { \
+        target = (address); \
+        if (target >= MAX_MEMORY_SIZE) { \
+            fault_address = target; \
+            goto ADDRESS_FAULT; \
+        } \
+        instruction = decoded + target; \
+        COUNT_STEP(); \
+        DISPATCH(); \
+    } while (0)
+
+/* -pedantic is told about the computed gotos of this function only, the rest of the file stays ANSI C */
+#ifdef EMULATOR_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+EmulatorResult emulator_run(Emulator* emulator) {
+#ifdef EMULATOR_THREADED
+    static void* handlers[] = {
+        &&HANDLE_OP_MOV, &&HANDLE_OP_CMP, &&HANDLE_OP_ADD, &&HANDLE_OP_SUB,
+        &&HANDLE_OP_LEA, &&HANDLE_OP_CLR, &&HANDLE_OP_NOT, &&HANDLE_OP_INC,
+        &&HANDLE_OP_DEC, &&HANDLE_OP_JMP, &&HANDLE_OP_BNE, &&HANDLE_OP_RED,
+        &&HANDLE_OP_PRN, &&HANDLE_OP_JSR, &&HANDLE_OP_RTS, &&HANDLE_OP_STOP,
+        &&HANDLE_EMU_OP_DECODE, &&HANDLE_EMU_OP_ILLEGAL, &&HANDLE_EMU_OP_OUTSIDE
+    };
+#endif
+    DecodedInstruction* decoded = emulator->decoded;
+    DecodedInstruction* instruction = decoded + emulator->pc;
+    Word* memory = emulator->memory;
+    Word* watch_low = memory + emulator->decoded_low;
+    Word* watch_high = memory + emulator->decoded_high;
+    Word* src = NULL;
+    Word* dst = NULL;
+    unsigned long start_budget = ULONG_MAX;
+    unsigned long budget = 0;
+    int fault_address = 0;
+    int target = 0;
+    int ch = 0;
+    EmulatorResult result = EMULATOR_STOPPED;
+
+    if (emulator->max_steps > 0) {
+        if (emulator->steps >= emulator->max_steps) {
+            return EMULATOR_STEP_LIMIT;
+        }
+        start_budget = emulator->max_steps - emulator->steps;
+    }
+    budget = start_budget;
+
+#ifdef EMULATOR_THREADED
+    DISPATCH();
+#else
+DISPATCH:
+    switch (instruction->op) {
+#endif
+
+    HANDLER(OP_MOV)
+        LOAD_SRC();
+        LOAD_DST();
+        STORE(dst, *src);
+        NEXT();
+
+    HANDLER(OP_CMP)
+        LOAD_SRC();
+        LOAD_DST();
+        emulator->zero = (*src == *dst);
+        NEXT();
+
+    HANDLER(OP_ADD)
+        LOAD_SRC();
+        LOAD_DST();
+        STORE(dst, (unsigned int)*dst + *src);
+        NEXT();
+
+    HANDLER(OP_SUB)
+        LOAD_SRC();
+        LOAD_DST();
+        STORE(dst, (unsigned int)*dst - *src);
+        NEXT();
+
+    HANDLER(OP_LEA)
+        LOAD_DST();
+        STORE(dst, *instruction->src);
+        NEXT();
+
+    HANDLER(OP_CLR)
+        LOAD_DST();
+        STORE(dst, 0);
+        NEXT();
+
+    HANDLER(OP_NOT)
+        LOAD_DST();
+        STORE(dst, ~(unsigned int)*dst);
+        NEXT();
+
+    HANDLER(OP_INC)
+        LOAD_DST();
+        STORE(dst, (unsigned int)*dst + 1);
+        NEXT();
+
+    HANDLER(OP_DEC)
+        LOAD_DST();
+        STORE(dst, (unsigned int)*dst - 1);
+        NEXT();
+
+    HANDLER(OP_JMP)
+        JUMP(*instruction->dst);
+
+    HANDLER(OP_BNE)
+        if (!emulator->zero) {
+            JUMP(*instruction->dst);
+        }
+        NEXT();
+
+    HANDLER(OP_RED)
+        LOAD_DST();
+        ch = getc(emulator->input);
+        STORE(dst, ch == EOF ? WORD_MASK : (unsigned int)ch);
+        NEXT();
+
+    HANDLER(OP_PRN)
+        LOAD_DST();
+        putc(*dst & 0xff, emulator->output);
+        NEXT();
+
+    HANDLER(OP_JSR)
+        if (emulator->stack_size >= EMULATOR_STACK_SIZE) {
+            print_diagnostic("stack overflow at address %04d\n", (int)(instruction - decoded));
+            goto FAULT;
+        }
+        emulator->stack[emulator->stack_size++] = (Word)(instruction - decoded + instruction->length);
+        JUMP(*instruction->dst);
+
+    HANDLER(OP_RTS)
+        if (emulator->stack_size == 0) {
+            print_diagnostic("rts with an empty stack at address %04d\n", (int)(instruction - decoded));
+            goto FAULT;
+        }
+        JUMP(emulator->stack[--emulator->stack_size]);
+
+    HANDLER(OP_STOP)
+        budget--;
+        result = EMULATOR_STOPPED;
+        goto EXIT;
+
+    HANDLER(EMU_OP_DECODE)
+        emulator_decode(emulator, instruction - decoded);
+        watch_low = memory + emulator->decoded_low;
+        watch_high = memory + emulator->decoded_high;
+        DISPATCH();
+
+    HANDLER(EMU_OP_ILLEGAL)
+        print_diagnostic("illegal instruction %05o at address %04d\n", memory[instruction - decoded], (int)(instruction - decoded));
+        goto FAULT;
+
+    HANDLER(EMU_OP_OUTSIDE)
+        print_diagnostic("the program ran past the end of the memory\n");
+        goto FAULT;
+
+#ifndef EMULATOR_THREADED
+    }
+#endif
+
+ADDRESS_FAULT:
+    print_diagnostic("address %d is outside of the memory (at address %04d)\n", fault_address, (int)(instruction - decoded));
+FAULT:
+    result = EMULATOR_FAULT;
+EXIT:
+    emulator->pc = instruction - decoded;
+    emulator->steps += start_budget - budget;
+    fflush(emulator->output);
+    return result;
+}
+#ifdef EMULATOR_THREADED
+#pragma GCC diagnostic pop
+#endif
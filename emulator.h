@@ -0,0 +1,67 @@
+#ifndef _EMULATOR_H
+#define _EMULATOR_H
+
+#include <stdio.h>
+#include "common.h"
+#include "objfile.h"
+#include "assembler.h"
+
+/* Runs assembled (and linked) programs.
+ * Every instruction is decoded once into a DecodedInstruction, at the address of its first word, so running it
+ * doesn't look at the bits of its words again. The code section is decoded when the program is loaded, any other
+ * address the first time it is executed. A store to a decoded word drops the instructions that contain it,
+ * so self-modifying programs still run correctly. */
+
+#define EMULATOR_STACK_SIZE 1024
+/* The longest instruction: the first word and two operand words */
+#define EMULATOR_MAX_INSTRUCTION_SIZE 3
+
+/* The operations of a DecodedInstruction: the opcodes (0 ... 15), and then these */
+#define EMU_OP_DECODE (OPCODE_NUM)      /* not decoded yet (or dropped by a store) */
+#define EMU_OP_ILLEGAL (OPCODE_NUM + 1) /* the words are not a valid instruction */
+#define EMU_OP_OUTSIDE (OPCODE_NUM + 2) /* past the end of the memory */
+
+typedef struct {
+    byte op;
+    byte length; /* in words */
+    byte src_indirect; /* TRUE if 'src' is a register that holds the address of the operand (*r) */
+    byte dst_indirect;
+    /* The operands: a register, a word of the memory, or 'src_value' / 'dst_value' (an immediate value,
+     * or the address of a label for the operands of lea, jmp, bne and jsr) */
+    Word* src;
+    Word* dst;
+    Word src_value;
+    Word dst_value;
+} DecodedInstruction;
+
+typedef enum {
+    EMULATOR_STOPPED,   /* the program ran a stop instruction */
+    EMULATOR_STEP_LIMIT,/* the program ran 'max_steps' instructions without stopping */
+    EMULATOR_FAULT      /* the program ran an invalid instruction or accessed memory that doesn't exist (already reported) */
+} EmulatorResult;
+
+typedef struct {
+    Word memory[MAX_MEMORY_SIZE];
+    /* Indexed by address. the extra entries are EMU_OP_OUTSIDE, for an instruction that runs past the end of the memory */
+    DecodedInstruction decoded[MAX_MEMORY_SIZE + EMULATOR_MAX_INSTRUCTION_SIZE];
+    int decoded_low; /* the addresses in [decoded_low, decoded_high) may be decoded. stores to them drop instructions */
+    int decoded_high;
+    Word registers[REGISTERS_NUM];
+    bool zero; /* the Z flag of the status word, set by cmp */
+    int pc;
+    Word stack[EMULATOR_STACK_SIZE]; /* the return addresses of jsr */
+    int stack_size;
+    unsigned long steps; /* the number of instructions that were run */
+    unsigned long max_steps; /* 0 for no limit */
+    FILE* input; /* red reads characters from here */
+    FILE* output; /* prn writes characters here */
+} Emulator;
+
+/* Resets the machine and loads 'object' into the memory. the program starts at its first code word.
+ * The program must not have extern references (they are resolved by linking it with oblink). 'path' is only used in error messages. */
+Status emulator_load(Emulator* emulator, ObjectFile* object, const char* path);
+
+/* Runs the program from 'pc' until it stops, faults or reaches 'max_steps'. */
+EmulatorResult emulator_run(Emulator* emulator);
+
+#endif
@@ -0,0 +1,68 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "common.h"
+#include "filelist.h"
+
+Status append_path(const char* path, char*** paths, int* count, int* capacity) {
+    char** new_paths = NULL;
+
+    if (*count >= *capacity) {
+        new_paths = (char**)malloc((*capacity > 0 ? *capacity * 2 : INITIAL_CAPACITY) * sizeof(char*));
+        if (new_paths == NULL) {
+            print_diagnostic("failed to allocate memory for the file list\n");
+            return STATUS_FAILURE;
+        }
+        if (*count > 0) {
+            memcpy(new_paths, *paths, *count * sizeof(char*));
+        }
+        free(*paths);
+        *paths = new_paths;
+        *capacity = (*capacity > 0 ? *capacity * 2 : INITIAL_CAPACITY);
+    }
+
+    (*paths)[*count] = my_strdup(path);
+    if ((*paths)[*count] == NULL) {
+        print_diagnostic("failed to allocate memory for the file list\n");
+        return STATUS_FAILURE;
+    }
+    (*count)++;
+    return STATUS_SUCCESS;
+}
+
+Status read_manifest(const char* manifest_path, char*** paths, int* count, int* capacity) {
+    FILE* manifest = NULL;
+    char* line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length = 0;
+    Status status = STATUS_SUCCESS;
+
+    manifest = fopen(manifest_path, "rb");
+    if (manifest == NULL) {
+        print_diagnostic("%s: cannot open file\n", manifest_path);
+        return STATUS_FAILURE;
+    }
+
+    /* getline, since paths in a manifest are not limited to the length of a source line */
+    while ((length = getline(&line, &line_capacity, manifest)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            length--;
+        }
+        line[length] = '\0';
+        if (length == 0) {
+            continue;
+        }
+
+        if (append_path(line, paths, count, capacity) != STATUS_SUCCESS) {
+            status = STATUS_FAILURE;
+            break;
+        }
+    }
+
+    free(line);
+    fclose(manifest);
+    return status;
+}
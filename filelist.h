@@ -0,0 +1,13 @@
+#ifndef _FILELIST_H
+#define _FILELIST_H
+
+#include "common.h"
+
+/* Appends a copy of 'path' to '*paths' (a malloc'ed array of malloc'ed strings, grown as needed). */
+Status append_path(const char* path, char*** paths, int* count, int* capacity);
+
+/* Reads a manifest (response) file: one path per line, empty lines are ignored.
+ * The paths are appended to '*paths', like append_path does. */
+Status read_manifest(const char* manifest_path, char*** paths, int* count, int* capacity);
+
+#endif
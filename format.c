@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "format.h"
+
+/* "00" ... "99": the two decimal digits of n are decimal_pairs[2n], decimal_pairs[2n + 1] */
+const char decimal_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* "00" ... "77": the two octal digits of a 6-bit n are octal_pairs[2n], octal_pairs[2n + 1] */
+const char octal_pairs[] =
+    "0001020304050607"
+    "1011121314151617"
+    "2021222324252627"
+    "3031323334353637"
+    "4041424344454647"
+    "5051525354555657"
+    "6061626364656667"
+    "7071727374757677";
+
+int format_address(char* out, int value) {
+    if (value < 0 || value > 9999) {
+        return sprintf(out, "%04d", value);
+    }
+
+    memcpy(out, &decimal_pairs[2 * (value / 100)], 2);
+    memcpy(out + 2, &decimal_pairs[2 * (value % 100)], 2);
+    return 4;
+}
+
+int format_octal_word(char* out, Word word) {
+    if (word > 0x7fff) { /* more than 5 octal digits */
+        return sprintf(out, "%05o", word);
+    }
+
+    out[0] = '0' + (word >> 12);
+    memcpy(out + 1, &octal_pairs[2 * ((word >> 6) & 0x3f)], 2);
+    memcpy(out + 3, &octal_pairs[2 * (word & 0x3f)], 2);
+    return 5;
+}
+
+int format_decimal(char* out, long value) {
+    char digits[24];
+    int length = 0;
+    int i = 0;
+    unsigned long magnitude = 0;
+
+    if (value < 0) {
+        out[i] = '-';
+        i++;
+        magnitude = -(unsigned long)value;
+    } else {
+        magnitude = value;
+    }
+
+    /* Fill 'digits' from the end, two digits at a time */
+    length = sizeof(digits);
+    while (magnitude >= 100) {
+        length -= 2;
+        memcpy(&digits[length], &decimal_pairs[2 * (magnitude % 100)], 2);
+        magnitude /= 100;
+    }
+    if (magnitude >= 10) {
+        length -= 2;
+        memcpy(&digits[length], &decimal_pairs[2 * magnitude], 2);
+    } else {
+        length -= 1;
+        digits[length] = '0' + magnitude;
+    }
+
+    memcpy(out + i, &digits[length], sizeof(digits) - length);
+    return i + sizeof(digits) - length;
+}
+
+/* The longest "<address> <word>\n" line of the .ob file (addresses have 4 digits, but the fallbacks may write more). */
+#define OBJ_LINE_MAX_SIZE 24
+/* The longest " <address>\n" suffix of the .ent and .ext lines */
+#define SYMBOL_ADDRESS_MAX_SIZE 26
+
+/* Appends "<address> <word>\n" lines for 'count' words, starting at 'first_address'. 'out' must have room for them. */
+void format_words(ByteArray* out, Word* words, int count, int first_address) {
+    char* cursor = (char*)out->buffer + out->size;
+    int i = 0;
+
+    for (i = 0; i < count; i++) {
+        cursor += format_address(cursor, first_address + i);
+        *cursor++ = ' ';
+        cursor += format_octal_word(cursor, words[i]);
+        *cursor++ = '\n';
+    }
+    out->size = cursor - (char*)out->buffer;
+}
+
+/* Appends a "<name> <address>\n" line. */
+Status format_symbol_line(ByteArray* out, StringView name, int address) {
+    char* cursor = 0;
+
+    if (bytearray_reserve(out, name.length + SYMBOL_ADDRESS_MAX_SIZE) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    cursor = (char*)out->buffer + out->size;
+    memcpy(cursor, name.start, name.length);
+    cursor += name.length;
+    *cursor++ = ' ';
+    cursor += format_decimal(cursor, address);
+    *cursor++ = '\n';
+    out->size = cursor - (char*)out->buffer;
+    return STATUS_SUCCESS;
+}
+
+Status format_object_text(ByteArray* out, Word* code, int code_size, Word* data, int data_size, int first_address) {
+    char* cursor = 0;
+
+    if (bytearray_reserve(out, SYMBOL_ADDRESS_MAX_SIZE * 2 + (code_size + data_size) * OBJ_LINE_MAX_SIZE) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    cursor = (char*)out->buffer + out->size;
+    cursor += format_decimal(cursor, code_size);
+    *cursor++ = ' ';
+    cursor += format_decimal(cursor, data_size);
+    *cursor++ = '\n';
+    out->size = cursor - (char*)out->buffer;
+
+    format_words(out, code, code_size, first_address);
+    format_words(out, data, data_size, first_address + code_size);
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,29 @@
+#ifndef _FORMAT_H
+#define _FORMAT_H
+
+#include "common.h"
+
+/* Fast replacements for the printf formats of the output files, using precomputed digit tables.
+ * Each function writes to 'out' (without a '\0') and returns the number of characters written.
+ * 'out' must have room for at least 24 characters. */
+
+/* printf("%04d") */
+int format_address(char* out, int value);
+
+/* printf("%05o") */
+int format_octal_word(char* out, Word word);
+
+/* printf("%d") */
+int format_decimal(char* out, long value);
+
+/* Appends "<address> <word>\n" lines for 'count' words, starting at 'first_address'. 'out' must have room for them. */
+void format_words(ByteArray* out, Word* words, int count, int first_address);
+
+/* Appends a "<name> <address>\n" line (a line of the .ent and .ext files). */
+Status format_symbol_line(ByteArray* out, StringView name, int address);
+
+/* Appends the contents of a .ob file: the "<code size> <data size>" header, then the code words and the data words,
+ * numbered from 'first_address'. */
+Status format_object_text(ByteArray* out, Word* code, int code_size, Word* data, int data_size, int first_address);
+
+#endif
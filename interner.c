@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "interner.h"
+
+Status interner_init(Interner* interner, Arena* arena) {
+    interner->arena = arena;
+    interner->count = 0;
+    interner->lookups = 0;
+    interner->probes = 0;
+    interner->capacity = INITIAL_CAPACITY;
+    interner->strings = (InternedString*)arena_alloc(arena, interner->capacity * sizeof(InternedString));
+    if (interner->strings == NULL) {
+        print_diagnostic("failed to allocate memory for names\n");
+        return STATUS_FAILURE;
+    }
+
+    interner->index_capacity = 2 * INITIAL_CAPACITY;
+    interner->index = (int*)arena_alloc(arena, interner->index_capacity * sizeof(int));
+    if (interner->index == NULL) {
+        print_diagnostic("failed to allocate memory for names\n");
+        return STATUS_FAILURE;
+    }
+    memset(interner->index, 0, interner->index_capacity * sizeof(int));
+
+    return bytearray_init(&interner->bytes, arena);
+}
+
+/* returns the slot in the index that holds 'str', or the empty slot where it should be inserted. */
+int interner_probe(Interner* interner, StringView str, unsigned int hash) {
+    int mask = interner->index_capacity - 1;
+    int slot = hash & mask;
+    InternedString* entry = NULL;
+
+    interner->lookups++;
+    while (interner->index[slot] != 0) {
+        entry = &interner->strings[interner->index[slot] - 1];
+        if (entry->hash == hash && entry->length == str.length &&
+            memcmp(interner->bytes.buffer + entry->offset, str.start, str.length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+        interner->probes++;
+    }
+    return slot;
+}
+
+/* Doubles the index and re-inserts all the strings, using their stored hashes. */
+Status expand_interner_index(Interner* interner) {
+    int* new_index = NULL;
+    int new_capacity = interner->index_capacity * 2;
+    int mask = new_capacity - 1;
+    int slot = 0;
+    int i = 0;
+
+    new_index = (int*)arena_alloc(interner->arena, new_capacity * sizeof(int));
+    if (new_index == NULL) {
+        print_diagnostic("failed to allocate memory for names\n");
+        return STATUS_FAILURE;
+    }
+    memset(new_index, 0, new_capacity * sizeof(int));
+
+    for (i = 0; i < interner->count; i++) {
+        slot = interner->strings[i].hash & mask;
+        while (new_index[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        new_index[slot] = i + 1;
+    }
+
+    interner->index = new_index;
+    interner->index_capacity = new_capacity;
+    return STATUS_SUCCESS;
+}
+
+Status interner_intern(Interner* interner, StringView str, unsigned int* out_id) {
+    InternedString* new_strings = NULL;
+    InternedString* entry = NULL;
+    unsigned int hash = hash_bytes(str.start, str.length);
+    int slot = 0;
+
+    slot = interner_probe(interner, str, hash);
+    if (interner->index[slot] != 0) {
+        *out_id = interner->index[slot] - 1;
+        return STATUS_SUCCESS;
+    }
+
+    if (interner->count >= interner->capacity) {
+        new_strings = (InternedString*)arena_resize(interner->arena, interner->strings, interner->capacity * sizeof(InternedString), interner->capacity * 2 * sizeof(InternedString));
+        if (new_strings == NULL) {
+            print_diagnostic("failed to allocate memory for names\n");
+            return STATUS_FAILURE;
+        }
+        interner->strings = new_strings;
+        interner->capacity *= 2;
+    }
+
+    if (2 * (interner->count + 1) > interner->index_capacity) {
+        if (expand_interner_index(interner) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+        slot = interner_probe(interner, str, hash);
+    }
+
+    entry = &interner->strings[interner->count];
+    entry->offset = interner->bytes.size;
+    entry->length = str.length;
+    entry->hash = hash;
+    if (bytearray_append(&interner->bytes, (byte*)str.start, str.length) != STATUS_SUCCESS ||
+        bytearray_append(&interner->bytes, (byte*)"", 1) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    *out_id = interner->count;
+    interner->count++;
+    interner->index[slot] = interner->count;
+    return STATUS_SUCCESS;
+}
+
+bool interner_find(Interner* interner, StringView str, unsigned int* out_id) {
+    int slot = interner_probe(interner, str, hash_bytes(str.start, str.length));
+
+    if (interner->index[slot] == 0) {
+        return FALSE;
+    }
+    *out_id = interner->index[slot] - 1;
+    return TRUE;
+}
+
+StringView interner_view(Interner* interner, unsigned int id) {
+    StringView view;
+
+    view.start = (const char*)interner->bytes.buffer + interner->strings[id].offset;
+    view.length = interner->strings[id].length;
+    return view;
+}
+
+Status idmap_init(IdMap* map, Arena* arena) {
+    map->arena = arena;
+    map->capacity = INITIAL_CAPACITY;
+    map->positions = (int*)arena_alloc(arena, map->capacity * sizeof(int));
+    if (map->positions == NULL) {
+        print_diagnostic("failed to allocate memory for names\n");
+        return STATUS_FAILURE;
+    }
+    memset(map->positions, 0, map->capacity * sizeof(int));
+    return STATUS_SUCCESS;
+}
+
+int idmap_get(IdMap* map, unsigned int id) {
+    if (id >= (unsigned int)map->capacity) {
+        return -1;
+    }
+    return map->positions[id] - 1;
+}
+
+Status idmap_set(IdMap* map, unsigned int id, int position) {
+    int* new_positions = NULL;
+    int new_capacity = map->capacity;
+
+    if (id >= (unsigned int)map->capacity) {
+        while (id >= (unsigned int)new_capacity) {
+            new_capacity *= 2;
+        }
+
+        new_positions = (int*)arena_resize(map->arena, map->positions, map->capacity * sizeof(int), new_capacity * sizeof(int));
+        if (new_positions == NULL) {
+            print_diagnostic("failed to allocate memory for names\n");
+            return STATUS_FAILURE;
+        }
+        memset(new_positions + map->capacity, 0, (new_capacity - map->capacity) * sizeof(int));
+        map->positions = new_positions;
+        map->capacity = new_capacity;
+    }
+
+    map->positions[id] = position + 1;
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,54 @@
+#ifndef _INTERNER_H
+#define _INTERNER_H
+
+#include "common.h"
+
+/* A string pool for the identifiers of a single file (labels, externs and macro names).
+ * Every distinct string is stored once and gets a small id (0, 1, 2, ...), so the tables store
+ * and compare ids instead of names. */
+
+typedef struct {
+    int offset; /* the position of the string in 'bytes' */
+    int length;
+    unsigned int hash; /* hash_bytes() of the string */
+} InternedString;
+
+typedef struct {
+    ByteArray bytes; /* all the strings, each followed by a '\0' */
+    InternedString* strings; /* indexed by id */
+    int count;
+    int capacity;
+    /* Open-addressing index over 'strings', like the other tables: slots hold (id + 1), 0 marks an empty slot. */
+    int* index;
+    int index_capacity;
+    long lookups; /* statistics (see stats.h): the number of lookups, */
+    long probes; /* and the number of slots they visited beyond the first one */
+    Arena* arena;
+} Interner;
+
+Status interner_init(Interner* interner, Arena* arena);
+
+/* Returns the id of 'str' in '*out_id', adding it to the pool if it's not there yet. */
+Status interner_intern(Interner* interner, StringView str, unsigned int* out_id);
+
+/* Returns the id of 'str' in '*out_id' without adding it. returns FALSE if it's not in the pool. */
+bool interner_find(Interner* interner, StringView str, unsigned int* out_id);
+
+/* Returns the string of 'id'. it is null-terminated, and is valid until the next interner_intern. */
+StringView interner_view(Interner* interner, unsigned int id);
+
+/* Maps interned ids to positions in a table (e.g. a label id to the position of the label). */
+typedef struct {
+    int* positions; /* (position + 1) of every id, 0 if the id is not mapped */
+    int capacity;
+    Arena* arena;
+} IdMap;
+
+Status idmap_init(IdMap* map, Arena* arena);
+
+/* Returns the position of 'id', or -1 if it is not mapped. */
+int idmap_get(IdMap* map, unsigned int id);
+
+Status idmap_set(IdMap* map, unsigned int id, int position);
+
+#endif
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "keywords.h"
+
+/* Returns a keyword of the given kind and id if 'word' is 'keyword' (which has the same length), or a KEYWORD_NONE keyword. */
+Keyword keyword_match(const char* word, int length, const char* keyword, KeywordKind kind, int id) {
+    Keyword result;
+
+    result.kind = KEYWORD_NONE;
+    result.id = 0;
+    if (memcmp(word, keyword, length) == 0) {
+        result.kind = kind;
+        result.id = id;
+    }
+    return result;
+}
+
+Keyword keyword_lookup(const char* word, int length) {
+    Keyword result;
+
+    result.kind = KEYWORD_NONE;
+    result.id = 0;
+
+    switch (length) {
+    case 2:
+        if (word[0] == 'r' && word[1] >= '0' && word[1] <= '7') {
+            result.kind = KEYWORD_REGISTER;
+            result.id = word[1] - '0';
+        }
+        break;
+    case 3:
+        switch (word[0]) {
+        case 'a': return keyword_match(word, length, "add", KEYWORD_OPCODE, 2);
+        case 'b': return keyword_match(word, length, "bne", KEYWORD_OPCODE, 10);
+        case 'c': return (word[1] == 'm') ? keyword_match(word, length, "cmp", KEYWORD_OPCODE, 1)
+                                          : keyword_match(word, length, "clr", KEYWORD_OPCODE, 5);
+        case 'd': return keyword_match(word, length, "dec", KEYWORD_OPCODE, 8);
+        case 'i': return keyword_match(word, length, "inc", KEYWORD_OPCODE, 7);
+        case 'j': return (word[1] == 'm') ? keyword_match(word, length, "jmp", KEYWORD_OPCODE, 9)
+                                          : keyword_match(word, length, "jsr", KEYWORD_OPCODE, 13);
+        case 'l': return keyword_match(word, length, "lea", KEYWORD_OPCODE, 4);
+        case 'm': return keyword_match(word, length, "mov", KEYWORD_OPCODE, 0);
+        case 'n': return keyword_match(word, length, "not", KEYWORD_OPCODE, 6);
+        case 'p': return keyword_match(word, length, "prn", KEYWORD_OPCODE, 12);
+        case 'r': return (word[1] == 'e') ? keyword_match(word, length, "red", KEYWORD_OPCODE, 11)
+                                          : keyword_match(word, length, "rts", KEYWORD_OPCODE, 14);
+        case 's': return keyword_match(word, length, "sub", KEYWORD_OPCODE, 3);
+        }
+        break;
+    case 4:
+        switch (word[0]) {
+        case 's': return keyword_match(word, length, "stop", KEYWORD_OPCODE, 15);
+        case 'm': return keyword_match(word, length, "macr", KEYWORD_MACRO, MACRO_START);
+        case 'd': return keyword_match(word, length, "data", KEYWORD_DIRECTIVE_NAME, DIRECTIVE_DATA);
+        }
+        break;
+    case 5:
+        switch (word[0]) {
+        case '.': return keyword_match(word, length, ".data", KEYWORD_DIRECTIVE, DIRECTIVE_DATA);
+        case 'e': return keyword_match(word, length, "entry", KEYWORD_DIRECTIVE_NAME, DIRECTIVE_ENTRY);
+        }
+        break;
+    case 6:
+        switch (word[0]) {
+        case '.': return keyword_match(word, length, ".entry", KEYWORD_DIRECTIVE, DIRECTIVE_ENTRY);
+        case 's': return keyword_match(word, length, "string", KEYWORD_DIRECTIVE_NAME, DIRECTIVE_STRING);
+        case 'e': return keyword_match(word, length, "extern", KEYWORD_DIRECTIVE_NAME, DIRECTIVE_EXTERN);
+        }
+        break;
+    case 7:
+        switch (word[0]) {
+        case '.': return (word[1] == 's') ? keyword_match(word, length, ".string", KEYWORD_DIRECTIVE, DIRECTIVE_STRING)
+                                          : keyword_match(word, length, ".extern", KEYWORD_DIRECTIVE, DIRECTIVE_EXTERN);
+        case 'e': return keyword_match(word, length, "endmacr", KEYWORD_MACRO, MACRO_END);
+        }
+        break;
+    }
+
+    return result;
+}
+
+bool is_reserved_word(const char* word, int length) {
+    KeywordKind kind = keyword_lookup(word, length).kind;
+    return kind != KEYWORD_NONE && kind != KEYWORD_DIRECTIVE;
+}
@@ -0,0 +1,36 @@
+#ifndef _KEYWORDS_H
+#define _KEYWORDS_H
+
+#include "common.h"
+
+typedef enum {
+    KEYWORD_NONE,
+    KEYWORD_OPCODE,         /* "mov" ... "stop". the id is the opcode */
+    KEYWORD_REGISTER,       /* "r0" ... "r7". the id is the register number */
+    KEYWORD_DIRECTIVE,      /* ".data", ".string", ".entry", ".extern". the id is a DIRECTIVE_* value */
+    KEYWORD_DIRECTIVE_NAME, /* a directive without the '.' (reserved, but not a directive). the id is a DIRECTIVE_* value */
+    KEYWORD_MACRO           /* "macr", "endmacr". the id is a MACRO_* value */
+} KeywordKind;
+
+#define DIRECTIVE_DATA   0
+#define DIRECTIVE_STRING 1
+#define DIRECTIVE_ENTRY  2
+#define DIRECTIVE_EXTERN 3
+
+#define MACRO_START 0
+#define MACRO_END   1
+
+typedef struct {
+    KeywordKind kind;
+    int id;
+} Keyword;
+
+/* Classifies 'word' with a single switch on its length and first character, and one comparison.
+ * returns a keyword of kind KEYWORD_NONE if 'word' is not a keyword. */
+Keyword keyword_lookup(const char* word, int length);
+
+/* TRUE for the words that can't be used as label or macro names:
+ * opcodes, registers, "macr", "endmacr", and the directive names without the '.' */
+bool is_reserved_word(const char* word, int length);
+
+#endif
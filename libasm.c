@@ -0,0 +1,144 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "assembler.h"
+#include "outstream.h"
+#include "libasm.h"
+
+struct asm_context_t {
+    Assembler assembler;
+    /* The diagnostics of the current source are collected here. the stream lives as long as the context */
+    FILE* diagnostics;
+    char* diagnostics_buffer;
+    size_t diagnostics_size;
+};
+
+AsmContext* asm_context_new(void) {
+    AsmContext* context = NULL;
+
+    context = (AsmContext*)malloc(sizeof(AsmContext));
+    if (context == NULL) {
+        return NULL;
+    }
+    context->diagnostics_buffer = NULL;
+    context->diagnostics = open_memstream(&context->diagnostics_buffer, &context->diagnostics_size);
+    if (context->diagnostics == NULL) {
+        free(context);
+        return NULL;
+    }
+    if (assembler_init(&context->assembler) != STATUS_SUCCESS) {
+        fclose(context->diagnostics);
+        free(context->diagnostics_buffer);
+        free(context);
+        return NULL;
+    }
+    return context;
+}
+
+void asm_context_free(AsmContext* context) {
+    if (context == NULL) {
+        return;
+    }
+    assembler_free(&context->assembler);
+    fclose(context->diagnostics);
+    free(context->diagnostics_buffer);
+    free(context);
+}
+
+/* Splits the collected diagnostics into lines, copied into 'arena'. */
+Status split_diagnostics(Arena* arena, const char* text, size_t size, AsmResult* result) {
+    const char* line = text;
+    const char* end = text + size;
+    const char* newline = NULL;
+    char* copy = NULL;
+    int count = 0;
+    size_t i = 0;
+
+    for (i = 0; i < size; i++) {
+        if (text[i] == '\n') {
+            count++;
+        }
+    }
+    if (size > 0 && text[size - 1] != '\n') {
+        count++; /* the last message didn't end with a '\n' */
+    }
+    if (count == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    result->diagnostics = (const char**)arena_alloc(arena, count * sizeof(char*));
+    if (result->diagnostics == NULL) {
+        return STATUS_FAILURE;
+    }
+
+    while (line < end) {
+        newline = (const char*)memchr(line, '\n', end - line);
+        if (newline == NULL) {
+            newline = end;
+        }
+        copy = (char*)arena_alloc(arena, newline - line + 1);
+        if (copy == NULL) {
+            return STATUS_FAILURE;
+        }
+        memcpy(copy, line, newline - line);
+        copy[newline - line] = '\0';
+        result->diagnostics[result->num_diagnostics++] = copy;
+        line = newline + 1;
+    }
+    return STATUS_SUCCESS;
+}
+
+/* The public view of an output kept in memory */
+AsmBuffer buffer_of_output(OutputBuffer* output) {
+    AsmBuffer buffer;
+
+    buffer.data = output->buffer;
+    buffer.size = output->size;
+    return buffer;
+}
+
+int asm_assemble(AsmContext* context, const char* name, const char* source, long size, int emit_am, int emit_obb, AsmResult* result) {
+    Assembler* assembler = &context->assembler;
+    OutputStream stream;
+    FILE* previous_diagnostics = NULL;
+    char* source_name = NULL;
+    Status status = STATUS_SUCCESS;
+
+    memset(result, 0, sizeof(AsmResult));
+
+    /* Everything the previous source left (its outputs included) is released here */
+    if (assembler_reset(assembler) != STATUS_SUCCESS) {
+        return ASM_FAILURE;
+    }
+    source_name = arena_strdup(&assembler->arena, name);
+    if (source_name == NULL) {
+        return ASM_FAILURE;
+    }
+
+    outstream_init_memory(&stream, &assembler->arena);
+    assembler->stream = &stream;
+
+    /* The diagnostics of this thread are collected (and the caller's own stream is restored after) */
+    fseek(context->diagnostics, 0, SEEK_SET);
+    previous_diagnostics = diagnostics_set_stream(context->diagnostics);
+    status = assembler_assemble_buffer(assembler, source_name, source, size, emit_am ? TRUE : FALSE, emit_obb ? TRUE : FALSE);
+    diagnostics_set_stream(previous_diagnostics);
+    fflush(context->diagnostics);
+    assembler->stream = NULL;
+
+    if (split_diagnostics(&assembler->arena, context->diagnostics_buffer, context->diagnostics_size, result) != STATUS_SUCCESS) {
+        status = STATUS_FAILURE;
+    }
+
+    result->preassembled = buffer_of_output(&stream.buffers[OUTPUT_AM]);
+    if (status == STATUS_SUCCESS) {
+        result->object = buffer_of_output(&stream.buffers[OUTPUT_OB]);
+        result->entries = buffer_of_output(&stream.buffers[OUTPUT_ENT]);
+        result->externs = buffer_of_output(&stream.buffers[OUTPUT_EXT]);
+        result->obb = buffer_of_output(&stream.buffers[OUTPUT_OBB]);
+    }
+    return status == STATUS_SUCCESS ? ASM_SUCCESS : ASM_FAILURE;
+}
@@ -0,0 +1,59 @@
+#ifndef _LIBASM_H
+#define _LIBASM_H
+
+/* The assembler as a library (libasm.a): assembles sources in memory, without touching the file system or
+ * stdout. There is no global state, so every thread can assemble on a context of its own:
+ *
+ *   AsmContext* context = asm_context_new();
+ *   AsmResult result;
+ *   if (asm_assemble(context, "snippet.as", source, strlen(source), 0, 0, &result) == ASM_SUCCESS)
+ *       ... result.object.data, result.object.size ...
+ *   asm_context_free(context);
+ *
+ * A context is reused from one source to the next (like the workers of the batch driver do), so assembling many
+ * small sources allocates almost nothing.
+ * This header needs nothing else (it can be included from C89, C99 or C++), and the library exports only the asm_
+ * functions: the internals of the assembler are local to libasm.a, so they never clash with the names of a program. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ASM_SUCCESS 0
+#define ASM_FAILURE 1
+
+/* An assembler, with its memory and its tables (opaque) */
+typedef struct asm_context_t AsmContext;
+
+/* An output. 'data' is NULL if it wasn't produced (e.g. the entries of a source without .entry) */
+typedef struct {
+    const unsigned char* data;
+    long size;
+} AsmBuffer;
+
+/* The outputs of a source. everything is owned by the context, and valid until its next asm_assemble or
+ * asm_context_free. */
+typedef struct {
+    AsmBuffer object;       /* the .ob file */
+    AsmBuffer entries;      /* the .ent file */
+    AsmBuffer externs;      /* the .ext file */
+    AsmBuffer preassembled; /* the .am file, if 'emit_am' */
+    AsmBuffer obb;          /* the binary .obb object file, if 'emit_obb' */
+    const char** diagnostics; /* the messages (the ones a.out prints), one per line, without the '\n' */
+    int num_diagnostics;
+} AsmResult;
+
+/* Returns a new context, or NULL if there isn't enough memory. */
+AsmContext* asm_context_new(void);
+void asm_context_free(AsmContext* context);
+
+/* Assembles the 'size' bytes of 'source' ('name' is the name of the source in the diagnostics). returns ASM_SUCCESS,
+ * or ASM_FAILURE if the source has errors (see result->diagnostics), and then there is no .ob, .ent, .ext or .obb
+ * output. 'emit_am' and 'emit_obb' are 0 or 1. */
+int asm_assemble(AsmContext* context, const char* name, const char* source, long size, int emit_am, int emit_obb, AsmResult* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
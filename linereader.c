@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "linereader.h"
+
+#define READ_CHUNK_SIZE 65536
+
+/* The fallback for inputs that can't be mmap'ed: reads everything into a malloc'ed buffer. */
+Status linereader_read_all(LineReader* reader, int fd, const char* path) {
+    char* buffer = NULL;
+    char* new_buffer = NULL;
+    long capacity = 0;
+    ssize_t bytes_read = 0;
+
+    capacity = READ_CHUNK_SIZE;
+    buffer = (char*)malloc(capacity);
+    if (buffer == NULL) {
+        print_diagnostic("%s: failed to allocate memory for the input\n", path);
+        return STATUS_FAILURE;
+    }
+
+    reader->size = 0;
+    while (TRUE) {
+        if (reader->size == capacity) {
+            new_buffer = (char*)realloc(buffer, capacity * 2);
+            if (new_buffer == NULL) {
+                print_diagnostic("%s: failed to allocate memory for the input\n", path);
+                free(buffer);
+                return STATUS_FAILURE;
+            }
+            buffer = new_buffer;
+            capacity *= 2;
+        }
+
+        bytes_read = read(fd, buffer + reader->size, capacity - reader->size);
+        if (bytes_read == 0) {
+            break;
+        }
+        if (bytes_read < 0) {
+            print_diagnostic("%s: failed reading from file", path);
+            free(buffer);
+            return STATUS_FAILURE;
+        }
+        reader->size += bytes_read;
+    }
+
+    reader->buffer = buffer;
+    reader->is_mapped = FALSE;
+    return STATUS_SUCCESS;
+}
+
+Status linereader_open(LineReader* reader, const char* path) {
+    int fd = -1;
+    struct stat file_stat;
+    void* mapping = NULL;
+    Status status = STATUS_SUCCESS;
+
+    memset(reader, 0, sizeof(LineReader));
+
+    if (strcmp(path, STDIN_PATH) == 0) {
+        fd = dup(STDIN_FILENO); /* closed like any other input, stdin itself stays open */
+    } else {
+        fd = open(path, O_RDONLY);
+    }
+    if (fd < 0) {
+        print_diagnostic("%s: cannot open file\n", path);
+        return STATUS_FAILURE;
+    }
+
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            reader->buffer = (const char*)mapping;
+            reader->size = file_stat.st_size;
+            reader->is_mapped = TRUE;
+            close(fd);
+            return STATUS_SUCCESS;
+        }
+    }
+
+    status = linereader_read_all(reader, fd, path);
+    close(fd);
+    return status;
+}
+
+void linereader_open_buffer(LineReader* reader, const char* buffer, long size) {
+    memset(reader, 0, sizeof(LineReader));
+    reader->buffer = buffer;
+    reader->size = size;
+    reader->is_borrowed = TRUE;
+}
+
+bool linereader_next(LineReader* reader, const char** line, int* length, int* line_number) {
+    const char* start = NULL;
+    const char* line_end = NULL;
+    long remaining = 0;
+
+    if (reader->position >= reader->size) {
+        return FALSE;
+    }
+
+    start = reader->buffer + reader->position;
+    remaining = reader->size - reader->position;
+    line_end = (const char*)memchr(start, '\n', remaining);
+
+    *line = start;
+    *length = (line_end != NULL) ? (int)(line_end - start + 1) : (int)remaining;
+    reader->position += *length;
+    reader->line_number++;
+    *line_number = reader->line_number;
+    return TRUE;
+}
+
+void linereader_close(LineReader* reader) {
+    if (reader->buffer != NULL && !reader->is_borrowed) {
+        if (reader->is_mapped) {
+            munmap((void*)reader->buffer, reader->size);
+        } else {
+            free((void*)reader->buffer);
+        }
+    }
+    memset(reader, 0, sizeof(LineReader));
+}
@@ -0,0 +1,30 @@
+#ifndef _LINEREADER_H
+#define _LINEREADER_H
+
+#include "common.h"
+
+/* Reads an input file line by line, without copying the lines.
+ * Regular files are mmap'ed, other inputs (e.g. pipes) are read into a buffer.
+ * Either way the whole input stays in memory until linereader_close, so the returned lines stay valid until then. */
+typedef struct {
+    const char* buffer; /* the whole input. not null-terminated */
+    long size;
+    long position; /* the start of the next line in 'buffer' */
+    int line_number; /* the number of the last line returned */
+    bool is_mapped; /* TRUE if 'buffer' is mmap'ed, FALSE if it was malloc'ed */
+    bool is_borrowed; /* TRUE if 'buffer' belongs to the caller of linereader_open_buffer */
+} LineReader;
+
+/* Opens 'path' for reading ("-" is stdin). prints an error message on failure. */
+Status linereader_open(LineReader* reader, const char* path);
+
+/* Reads the 'size' bytes of 'buffer', which must stay valid (and unchanged) until linereader_close. */
+void linereader_open_buffer(LineReader* reader, const char* buffer, long size);
+
+/* Returns the next line in '*line' and '*length' (which includes the '\n', if the line has one),
+ * and its number (starting at 1) in '*line_number'. Returns FALSE at the end of the input. */
+bool linereader_next(LineReader* reader, const char** line, int* length, int* line_number);
+
+void linereader_close(LineReader* reader);
+
+#endif
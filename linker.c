@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "interner.h"
+#include "linereader.h"
+#include "objfile.h"
+#include "assembler.h"
+#include "linker.h"
+
+/* The 3 ARE bits of a word, and the address above them */
+#define ARE_MASK 7
+#define ADDRESS_SHIFT 3
+
+/* Makes sure '*array' (of 'element_size' elements, allocated from 'arena') has room for 'size' elements. */
+Status linker_reserve(Arena* arena, void** array, int* capacity, int size, size_t element_size) {
+    void* new_array = NULL;
+    int new_capacity = *capacity > 0 ? *capacity : INITIAL_CAPACITY;
+
+    if (size <= *capacity) {
+        return STATUS_SUCCESS;
+    }
+
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+
+    new_array = arena_resize(arena, *array, *capacity * element_size, new_capacity * element_size);
+    if (new_array == NULL) {
+        print_diagnostic("failed to allocate memory for the linker\n");
+        return STATUS_FAILURE;
+    }
+    *array = new_array;
+    *capacity = new_capacity;
+    return STATUS_SUCCESS;
+}
+
+Status linker_init(Linker* linker) {
+    memset(linker, 0, sizeof(Linker));
+    arena_init(&linker->arena);
+    arena_init(&linker->scratch);
+
+    if (interner_init(&linker->names, &linker->arena) != STATUS_SUCCESS ||
+        idmap_init(&linker->entry_by_name, &linker->arena) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    return STATUS_SUCCESS;
+}
+
+void linker_free(Linker* linker) {
+    arena_free(&linker->scratch);
+    arena_free(&linker->arena);
+}
+
+/* TRUE if 'address' (an address in the object file of 'module') is in its code or its data */
+bool module_contains(LinkModule* module, int address) {
+    return address >= module->load_base && address < module->load_base + module->code_size + module->data_size;
+}
+
+/* Returns the address in the linked program of 'address' (an address in the object file of 'module'),
+ * or -1 if it's outside of the module. */
+int linker_relocate(Linker* linker, LinkModule* module, int address) {
+    int offset = address - module->load_base;
+
+    if (!module_contains(module, address)) {
+        return -1;
+    }
+
+    if (offset < module->code_size) {
+        return LOADING_BASE + module->code_offset + offset;
+    }
+    return LOADING_BASE + linker->code_size + module->data_offset + (offset - module->code_size);
+}
+
+/* Appends the entries of 'object' (the module at 'index') to the entries of the linker. */
+Status linker_add_entries(Linker* linker, ObjectFile* object, int index) {
+    LinkModule* module = &linker->modules[index];
+    LinkEntry* entry = NULL;
+    int i = 0;
+
+    if (linker_reserve(&linker->arena, (void**)&linker->entries, &linker->entries_capacity,
+                       linker->num_entries + object->num_entries, sizeof(LinkEntry)) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    for (i = 0; i < object->num_entries; i++) {
+        if (!module_contains(module, object->entries[i].address)) {
+            print_diagnostic("%s: entry '%.*s' is outside of the module (address %d)\n", module->path,
+                             object->entries[i].name.length, object->entries[i].name.start, object->entries[i].address);
+            return STATUS_FAILURE;
+        }
+
+        entry = &linker->entries[linker->num_entries];
+        if (interner_intern(&linker->names, object->entries[i].name, &entry->name) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+        entry->module = index;
+        entry->address = object->entries[i].address;
+        linker->num_entries++;
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Appends the extern references of 'object' (the module at 'index') to the externs of the linker. */
+Status linker_add_externs(Linker* linker, ObjectFile* object, int index) {
+    LinkModule* module = &linker->modules[index];
+    LinkExtern* ref = NULL;
+    int address = 0;
+    int i = 0;
+
+    if (linker_reserve(&linker->arena, (void**)&linker->externs, &linker->externs_capacity,
+                       linker->num_externs + object->num_externs, sizeof(LinkExtern)) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    for (i = 0; i < object->num_externs; i++) {
+        address = object->externs[i].address;
+
+        /* The reference must be an operand word that the assembler left for the linker */
+        if (address < module->load_base || address >= module->load_base + module->code_size ||
+            (object->code[address - module->load_base] & ARE_MASK) != ARE_EXTERNAL) {
+            print_diagnostic("%s: the reference to '%.*s' at address %d is not an external operand\n", module->path,
+                             object->externs[i].name.length, object->externs[i].name.start, address);
+            return STATUS_FAILURE;
+        }
+
+        ref = &linker->externs[linker->num_externs];
+        if (interner_intern(&linker->names, object->externs[i].name, &ref->name) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+        ref->module = index;
+        ref->slot = module->code_offset + (address - module->load_base);
+        ref->address = address;
+        linker->num_externs++;
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Appends the words and the symbols of 'object' to the program. */
+Status linker_append_module(Linker* linker, const char* path, ObjectFile* object) {
+    LinkModule* module = NULL;
+    int index = linker->num_modules;
+
+    /* The linked program has to fit in memory, just like a single file */
+    if (LOADING_BASE + linker->code_size + linker->data_size + object->code_size + object->data_size > MAX_MEMORY_SIZE) {
+        print_diagnostic("%s: the linked program is too large (more than %d words)\n", path, MAX_MEMORY_SIZE - LOADING_BASE);
+        return STATUS_FAILURE;
+    }
+
+    if (linker_reserve(&linker->arena, (void**)&linker->modules, &linker->modules_capacity, index + 1, sizeof(LinkModule)) != STATUS_SUCCESS ||
+        linker_reserve(&linker->arena, (void**)&linker->code, &linker->code_capacity, linker->code_size + object->code_size, sizeof(Word)) != STATUS_SUCCESS ||
+        linker_reserve(&linker->arena, (void**)&linker->data, &linker->data_capacity, linker->data_size + object->data_size, sizeof(Word)) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    module = &linker->modules[index];
+    module->path = path;
+    module->load_base = object->load_base;
+    module->code_size = object->code_size;
+    module->data_size = object->data_size;
+    module->code_offset = linker->code_size;
+    module->data_offset = linker->data_size;
+
+    if (linker_add_entries(linker, object, index) != STATUS_SUCCESS ||
+        linker_add_externs(linker, object, index) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    memcpy(linker->code + linker->code_size, object->code, object->code_size * sizeof(Word));
+    memcpy(linker->data + linker->data_size, object->data, object->data_size * sizeof(Word));
+    linker->code_size += object->code_size;
+    linker->data_size += object->data_size;
+    linker->num_modules++;
+    return STATUS_SUCCESS;
+}
+
+Status linker_add_module(Linker* linker, const char* path) {
+    LineReader reader = {0};
+    ObbImage obb;
+    ObjectFile object;
+    Status status = 0;
+
+    /* Only the words and the (interned) names are kept, the rest of the module is released before the next one */
+    arena_reset(&linker->scratch);
+
+    if (!has_extension(path, "obb")) {
+        if (objfile_read_text(&object, &linker->scratch, (char*)path) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+        return linker_append_module(linker, path, &object);
+    }
+
+    /* The names of a .obb point into the image, so it stays mapped until they are interned */
+    if (linereader_open(&reader, path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (obb_open(&obb, (const byte*)reader.buffer, reader.size, path) != STATUS_SUCCESS ||
+        objfile_from_obb(&object, &obb, &linker->scratch) != STATUS_SUCCESS ||
+        linker_append_module(linker, path, &object) != STATUS_SUCCESS) {
+        goto FAILURE;
+    }
+
+    goto SUCCESS;
+SUCCESS:
+    status = STATUS_SUCCESS;
+    goto CLEANUP;
+FAILURE:
+    status = STATUS_FAILURE;
+CLEANUP:
+    linereader_close(&reader);
+    return status;
+}
+
+/* Indexes the entries by name. returns the number of duplicate entries (which are reported). */
+int linker_index_entries(Linker* linker) {
+    LinkEntry* entry = NULL;
+    StringView name;
+    int position = 0;
+    int errors = 0;
+    int i = 0;
+
+    for (i = 0; i < linker->num_entries; i++) {
+        entry = &linker->entries[i];
+        position = idmap_get(&linker->entry_by_name, entry->name);
+        if (position >= 0) {
+            name = interner_view(&linker->names, entry->name);
+            print_diagnostic("%s: duplicate entry '%s' (already defined in %s)\n", linker->modules[entry->module].path,
+                             name.start, linker->modules[linker->entries[position].module].path);
+            errors++;
+            continue;
+        }
+
+        if (idmap_set(&linker->entry_by_name, entry->name, i) != STATUS_SUCCESS) {
+            return errors + 1;
+        }
+    }
+    return errors;
+}
+
+/* Moves the relative words of every module to the new addresses of their targets.
+ * returns the number of words that point outside of their module (which are reported). */
+int linker_relocate_words(Linker* linker) {
+    LinkModule* module = NULL;
+    Word* word = NULL;
+    int address = 0;
+    int errors = 0;
+    int i = 0;
+    int j = 0;
+
+    for (i = 0; i < linker->num_modules; i++) {
+        module = &linker->modules[i];
+        for (j = 0; j < module->code_size; j++) {
+            word = &linker->code[module->code_offset + j];
+            if ((*word & ARE_MASK) != ARE_RELATIVE) {
+                continue;
+            }
+
+            address = linker_relocate(linker, module, *word >> ADDRESS_SHIFT);
+            if (address < 0) {
+                print_diagnostic("%s: the word at address %d points outside of the module\n", module->path, module->load_base + j);
+                errors++;
+                continue;
+            }
+            *word = (Word)((address << ADDRESS_SHIFT) | ARE_RELATIVE);
+        }
+    }
+    return errors;
+}
+
+/* Fills every extern reference with the address of its entry. returns the number of undefined references (which are reported). */
+int linker_resolve_externs(Linker* linker) {
+    LinkExtern* ref = NULL;
+    LinkEntry* entry = NULL;
+    StringView name;
+    int position = 0;
+    int errors = 0;
+    int i = 0;
+
+    for (i = 0; i < linker->num_externs; i++) {
+        ref = &linker->externs[i];
+        position = idmap_get(&linker->entry_by_name, ref->name);
+        if (position < 0) {
+            name = interner_view(&linker->names, ref->name);
+            print_diagnostic("%s: undefined symbol '%s' (referenced at address %d)\n", linker->modules[ref->module].path, name.start, ref->address);
+            errors++;
+            continue;
+        }
+
+        entry = &linker->entries[position];
+        linker->code[ref->slot] = (Word)((linker_relocate(linker, &linker->modules[entry->module], entry->address) << ADDRESS_SHIFT) | ARE_RELATIVE);
+    }
+    return errors;
+}
+
+Status linker_link(Linker* linker, ObjectFile* out) {
+    LinkEntry* entry = NULL;
+    int errors = 0;
+    int i = 0;
+
+    /* The words are relocated before the externs are filled, so a resolved reference is never relocated twice */
+    errors += linker_index_entries(linker);
+    errors += linker_relocate_words(linker);
+    errors += linker_resolve_externs(linker);
+    if (errors > 0) {
+        print_diagnostic("linking failed: %d error(s)\n", errors);
+        return STATUS_FAILURE;
+    }
+
+    /* +1 so the array is never an empty allocation */
+    linker->linked_entries = (ObjectSymbol*)arena_alloc(&linker->arena, (linker->num_entries + 1) * sizeof(ObjectSymbol));
+    if (linker->linked_entries == NULL) {
+        print_diagnostic("failed to allocate memory for the linker\n");
+        return STATUS_FAILURE;
+    }
+    for (i = 0; i < linker->num_entries; i++) {
+        entry = &linker->entries[i];
+        linker->linked_entries[i].name = interner_view(&linker->names, entry->name);
+        linker->linked_entries[i].address = linker_relocate(linker, &linker->modules[entry->module], entry->address);
+    }
+
+    memset(out, 0, sizeof(ObjectFile));
+    out->load_base = LOADING_BASE;
+    out->code = linker->code;
+    out->code_size = linker->code_size;
+    out->data = linker->data;
+    out->data_size = linker->data_size;
+    out->entries = linker->linked_entries;
+    out->num_entries = linker->num_entries;
+    return STATUS_SUCCESS;
+}
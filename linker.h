@@ -0,0 +1,73 @@
+#ifndef _LINKER_H
+#define _LINKER_H
+
+#include "common.h"
+#include "interner.h"
+#include "objfile.h"
+
+/* Links assembled modules (.ob/.ent/.ext sets or .obb files) into a single program.
+ * The code of all the modules comes first, in the order they were added, and then the data of all the modules:
+ *
+ *   LOADING_BASE  code of module 0, code of module 1, ... , data of module 0, data of module 1, ...
+ *
+ * Every relative word of a module is relocated to the new address of its target, and every extern reference
+ * is resolved against the entries of all the modules. */
+
+typedef struct {
+    const char* path;
+    int load_base; /* the address of the first word, in the object file of the module */
+    int code_size;
+    int data_size;
+    int code_offset; /* the position of the first code word of the module in the linked code */
+    int data_offset; /* the position of the first data word of the module in the linked data */
+} LinkModule;
+
+typedef struct {
+    unsigned int name; /* the id of the name in the 'names' of the linker */
+    int module;
+    int address; /* the address in the module, like in its .ent file */
+} LinkEntry;
+
+typedef struct {
+    unsigned int name;
+    int module;
+    int slot; /* the index of the operand word in the linked code */
+    int address; /* the address in the module, like in its .ext file (for error messages) */
+} LinkExtern;
+
+typedef struct {
+    Arena arena; /* the memory of everything that is kept until the end of the link */
+    Arena scratch; /* the memory of the module that is being read. reset after every module */
+    Interner names; /* the entry and extern names of all the modules */
+    LinkModule* modules;
+    int num_modules;
+    int modules_capacity;
+    Word* code;
+    int code_size;
+    int code_capacity;
+    Word* data;
+    int data_size;
+    int data_capacity;
+    LinkEntry* entries;
+    int num_entries;
+    int entries_capacity;
+    LinkExtern* externs;
+    int num_externs;
+    int externs_capacity;
+    IdMap entry_by_name; /* the position of the entry of every name in 'entries' (filled by linker_link) */
+    ObjectSymbol* linked_entries; /* the entries of the linked program (filled by linker_link) */
+} Linker;
+
+Status linker_init(Linker* linker);
+void linker_free(Linker* linker);
+
+/* Reads a module and appends its code and data to the program. 'path' is a .obb file, or a .ob file
+ * (with the .ent and .ext files next to it, if they exist). 'path' must stay valid until linker_free. */
+Status linker_add_module(Linker* linker, const char* path);
+
+/* Resolves the extern references of all the modules and relocates their words.
+ * Every duplicate entry and every undefined extern is reported (not just the first one).
+ * On success 'out' describes the linked program: its words and entries are valid until linker_free, and it has no externs. */
+Status linker_link(Linker* linker, ObjectFile* out);
+
+#endif
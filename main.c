@@ -2,39 +2,280 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
 #include "common.h"
 #include "preassembler.h"
 #include "assembler.h"
+#include "batch.h"
+#include "filelist.h"
+#include "stats.h"
+#include "trace.h"
+#include "outstream.h"
+#include "server.h"
+
+void print_usage(void) {
+    printf("usage: a.out [--emit-am] [--emit-obb] [-j N] [--cache-dir DIR] [--stats] [--stats-json FILE] [--trace=FILE] <file1.as> <file2.as> ... <fileN.as>\n");
+    printf("       a.out [--emit-am] [--emit-obb] [--fd KIND=FD]... -\n");
+    printf("       a.out --serve SOCKET [-j N]\n");
+    printf("       a source file named @<manifest> is replaced by the paths listed in <manifest> (one per line)\n");
+    printf("       --emit-obb also writes the binary .obb object file (see obbconv)\n");
+    printf("       --cache-dir DIR restores the outputs of unchanged sources from DIR, instead of assembling them again\n");
+    printf("       --stats prints the time of every phase, and what it went through, for every file and for the whole batch\n");
+    printf("       --stats-json FILE writes the same statistics to FILE, as JSON\n");
+    printf("       --trace=FILE writes a timeline of the phases of every file, on every thread, to FILE (Chrome trace format)\n");
+    printf("       the source - is read from stdin, and its outputs are written to stdout as frames of '<kind> <size>\\n<bytes>'\n");
+    printf("       --fd KIND=FD writes the output KIND (am, ob, ent, ext, obb or diagnostics) to the descriptor FD instead\n");
+    printf("       --serve SOCKET serves sources sent by clients (see asmc) on the Unix socket SOCKET, with N workers\n");
+}
+
+/* Prints the statistics of every file and their total (as text, JSON or both). */
+Status report_stats(char** source_paths, int num_files, FileStats* stats, PhaseTime* batch, bool print_text, char* json_path) {
+    FileStats total;
+    FILE* json_file = NULL;
+    int i = 0;
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < num_files; i++) {
+        stats_add(&total, &stats[i]);
+    }
+
+    if (print_text) {
+        for (i = 0; i < num_files; i++) {
+            stats_print(stdout, source_paths[i], &stats[i]);
+        }
+        stats_print_total(stdout, &total, num_files, batch);
+    }
+
+    if (json_path != NULL) {
+        json_file = fopen(json_path, "w");
+        if (json_file == NULL) {
+            printf("failed to open file %s for writing\n", json_path);
+            return STATUS_FAILURE;
+        }
+        stats_print_json(json_file, source_paths, stats, num_files, &total, batch);
+        if (fclose(json_file) != 0) {
+            printf("failed to write to file %s\n", json_path);
+            return STATUS_FAILURE;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Parses the number of workers of a '-j' option. */
+Status parse_num_workers(const char* str, int* out) {
+    char* endptr = 0;
+    long value = 0;
+
+    value = strtol(str, &endptr, 10);
+    if (endptr == str || *endptr != '\0' || value < 1 || value > 1024) {
+        printf("invalid number of jobs '%s'\n", str);
+        return STATUS_FAILURE;
+    }
+
+    *out = (int)value;
+    return STATUS_SUCCESS;
+}
 
 int main(int argc, char **argv) {
     int i = 0;
-    Assembler assembler = {0};
     int status = 0;
+    BatchOptions options = {0};
+    Cache cache;
+    char* cache_dir = NULL;
+    bool print_stats = FALSE;
+    char* stats_json_path = NULL;
+    StatsTimer batch_timer;
+    PhaseTime batch_time = {0};
+    Tracer tracer;
+    char* trace_path = NULL;
+    char* socket_path = NULL;
+    OutputStream stream;
+    bool has_stream_fds = FALSE;
+    bool is_stdin = FALSE;
+    char** source_paths = NULL;
+    int num_files = 0;
+    int paths_capacity = 0;
 
-    if (argc < 2) {
-        printf("usage: a.out <file1.as> <file2.as> ... <fileN.as>\n");
-        return 1;
-    }
+    options.emit_am = FALSE;
+    options.emit_obb = FALSE;
+    options.num_workers = 1;
+    outstream_init(&stream, STDOUT_FILENO);
 
     for (i = 1; i < argc; i++) {
-        if (assembler_init(&assembler) != STATUS_SUCCESS) {
-            return 1;
+        if (strcmp(argv[i], "--emit-am") == 0) {
+            options.emit_am = TRUE;
+        } else if (strcmp(argv[i], "--emit-obb") == 0) {
+            options.emit_obb = TRUE;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            print_stats = TRUE;
+        } else if (strcmp(argv[i], "--stats-json") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                status = 1;
+                goto CLEANUP;
+            }
+            i++;
+            stats_json_path = argv[i];
+        } else if (strncmp(argv[i], "--trace=", 8) == 0 && argv[i][8] != '\0') {
+            trace_path = argv[i] + 8;
+        } else if (strcmp(argv[i], "--fd") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                status = 1;
+                goto CLEANUP;
+            }
+            i++;
+            if (outstream_parse_fd(&stream, argv[i]) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+            has_stream_fds = TRUE;
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                status = 1;
+                goto CLEANUP;
+            }
+            i++;
+            socket_path = argv[i];
+        } else if (strcmp(argv[i], "--cache-dir") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                status = 1;
+                goto CLEANUP;
+            }
+            i++;
+            cache_dir = argv[i];
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                status = 1;
+                goto CLEANUP;
+            }
+            i++;
+            if (parse_num_workers(argv[i], &options.num_workers) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            if (parse_num_workers(argv[i] + 2, &options.num_workers) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+        } else if (argv[i][0] == '@') {
+            if (read_manifest(argv[i] + 1, &source_paths, &num_files, &paths_capacity) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+        } else {
+            if (append_path(argv[i], &source_paths, &num_files, &paths_capacity) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+        }
+    }
+
+    /* The server gets its sources (and what to emit for them) from its clients */
+    if (socket_path != NULL) {
+        if (num_files > 0 || options.emit_am || options.emit_obb || has_stream_fds ||
+            cache_dir != NULL || print_stats || stats_json_path != NULL || trace_path != NULL) {
+            printf("--serve only takes -j (the clients send the sources and choose the outputs)\n");
+            status = 1;
+        } else if (server_run(socket_path, options.num_workers) != STATUS_SUCCESS) {
+            status = 1;
+        }
+        goto CLEANUP;
+    }
+
+    if (num_files == 0) {
+        print_usage();
+        status = 1;
+        goto CLEANUP;
+    }
+
+    /* stdin can only be read once, and its outputs share stdout with nothing but each other */
+    for (i = 0; i < num_files; i++) {
+        if (strcmp(source_paths[i], STDIN_PATH) == 0) {
+            is_stdin = TRUE;
         }
+    }
+    if (is_stdin && num_files > 1) {
+        printf("the source from stdin (-) must be the only source\n");
+        status = 1;
+        goto CLEANUP;
+    }
+    if (is_stdin && (print_stats || cache_dir != NULL)) {
+        printf("--stats and --cache-dir can't be used with the source from stdin (--stats-json can)\n");
+        status = 1;
+        goto CLEANUP;
+    }
+    if (has_stream_fds && !is_stdin) {
+        printf("--fd only applies to the source from stdin (-)\n");
+        status = 1;
+        goto CLEANUP;
+    }
 
-        if (preassemble(argv[i]) != STATUS_SUCCESS) {
+    if (cache_dir != NULL) {
+        if (cache_open(&cache, cache_dir) != STATUS_SUCCESS) {
             status = 1;
-            assembler_free(&assembler);
-            continue;
+            goto CLEANUP;
         }
+        options.cache = &cache;
+    }
 
-        if (assembler_assemble(&assembler, argv[i]) != STATUS_SUCCESS) {
+    if (trace_path != NULL) {
+        if (tracer_init(&tracer) != STATUS_SUCCESS) {
             status = 1;
-            assembler_free(&assembler);
-            continue;
+            goto CLEANUP;
         }
+        options.tracer = &tracer;
+    }
 
-        assembler_free(&assembler);
+    if (print_stats || stats_json_path != NULL) {
+        options.stats = (FileStats*)calloc(num_files, sizeof(FileStats));
+        if (options.stats == NULL) {
+            printf("failed to allocate memory for the statistics\n");
+            status = 1;
+            goto CLEANUP;
+        }
+        stats_timer_start(&batch_timer, TRUE);
     }
 
+    if (is_stdin) {
+        options.stream = &stream;
+        if (batch_assemble_stdin(&options) != STATUS_SUCCESS) {
+            status = 1;
+        }
+    } else if (batch_assemble(source_paths, num_files, &options) != STATUS_SUCCESS) {
+        status = 1;
+    }
+
+    if (options.stats != NULL) {
+        stats_timer_stop(&batch_timer, &batch_time);
+        if (report_stats(source_paths, num_files, options.stats, &batch_time, print_stats, stats_json_path) != STATUS_SUCCESS) {
+            status = 1;
+        }
+    }
+
+    if (options.tracer != NULL) {
+        if (tracer_write(options.tracer, trace_path) != STATUS_SUCCESS) {
+            status = 1;
+        }
+    }
+
+    if (options.cache != NULL) {
+        cache_print_stats(options.cache);
+        cache_close(options.cache);
+    }
+
+CLEANUP:
+    if (options.tracer != NULL) {
+        tracer_free(options.tracer);
+    }
+    free(options.stats);
+    for (i = 0; i < num_files; i++) {
+        free(source_paths[i]);
+    }
+    free(source_paths);
     return status;
 }
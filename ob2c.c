@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "objfile.h"
+#include "translator.h"
+
+/* Translates an assembled program to C:
+ *   ob2c prog.ob            writes prog.c
+ *   ob2c -o fast.c prog.obb writes fast.c
+ * and then: gcc -O2 -I. -o prog prog.c libobrt.a -pthread */
+
+void print_usage(void) {
+    printf("usage: ob2c [-o <output.c>] <prog.ob | prog.obb>\n");
+    printf("       the output is built with: gcc -O2 -I<assembler directory> -o prog prog.c <assembler directory>/libobrt.a -pthread\n");
+}
+
+int main(int argc, char **argv) {
+    Arena arena;
+    ObjectFile object;
+    ByteArray out = {0};
+    char* program_path = NULL;
+    char* output_path = NULL;
+    int status = 0;
+    int i = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            i++;
+            output_path = argv[i];
+        } else if (program_path == NULL) {
+            program_path = argv[i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (program_path == NULL) {
+        print_usage();
+        return 1;
+    }
+
+    arena_init(&arena);
+    if (output_path == NULL) {
+        output_path = change_extension(&arena, program_path, "c");
+        if (output_path == NULL) {
+            status = 1;
+            goto CLEANUP;
+        }
+    }
+
+    if (objfile_read(&object, &arena, program_path) != STATUS_SUCCESS ||
+        bytearray_init(&out, &arena) != STATUS_SUCCESS ||
+        translate_program(&object, program_path, &out) != STATUS_SUCCESS ||
+        write_bytearray_to_file(&out, output_path) != STATUS_SUCCESS) {
+        status = 1;
+    }
+
+CLEANUP:
+    arena_free(&arena);
+    return status;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "linereader.h"
+#include "objfile.h"
+
+/* Converts between the binary .obb object file and the textual .ob/.ent/.ext files:
+ *   obbconv prog.obb   writes prog.ob (and prog.ent, prog.ext when needed)
+ *   obbconv prog.ob    reads prog.ob (and prog.ent, prog.ext if they exist) and writes prog.obb */
+
+void print_usage(void) {
+    printf("usage: obbconv <file1.obb | file1.ob> ... <fileN.obb | fileN.ob>\n");
+    printf("       a .obb file is converted to .ob/.ent/.ext files, a .ob file (with its .ent/.ext files) to a .obb file\n");
+}
+
+Status convert_obb_to_text(Arena* arena, char* obb_path) {
+    LineReader reader = {0};
+    ObbImage obb;
+    ObjectFile object;
+    char* ob_path = NULL;
+    Status status = 0;
+
+    ob_path = change_extension(arena, obb_path, "ob");
+    if (ob_path == NULL) {
+        return STATUS_FAILURE;
+    }
+
+    /* The image is mmap'ed and decoded in place */
+    if (linereader_open(&reader, obb_path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (obb_open(&obb, (const byte*)reader.buffer, reader.size, obb_path) != STATUS_SUCCESS) {
+        goto FAILURE;
+    }
+
+    if (objfile_from_obb(&object, &obb, arena) != STATUS_SUCCESS) {
+        goto FAILURE;
+    }
+
+    if (objfile_write_text(&object, arena, ob_path) != STATUS_SUCCESS) {
+        goto FAILURE;
+    }
+
+    goto SUCCESS;
+SUCCESS:
+    status = STATUS_SUCCESS;
+    goto CLEANUP;
+FAILURE:
+    status = STATUS_FAILURE;
+CLEANUP:
+    linereader_close(&reader);
+    return status;
+}
+
+Status convert_text_to_obb(Arena* arena, char* ob_path) {
+    ObjectFile object;
+    ByteArray out = {0};
+    char* obb_path = NULL;
+
+    obb_path = change_extension(arena, ob_path, "obb");
+    if (obb_path == NULL) {
+        return STATUS_FAILURE;
+    }
+
+    if (objfile_read_text(&object, arena, ob_path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (bytearray_init(&out, arena) != STATUS_SUCCESS ||
+        objfile_format_obb(&object, arena, &out) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    return write_bytearray_to_file(&out, obb_path);
+}
+
+int main(int argc, char **argv) {
+    Arena arena;
+    int i = 0;
+    int status = 0;
+
+    if (argc < 2) {
+        print_usage();
+        return 1;
+    }
+
+    arena_init(&arena);
+    for (i = 1; i < argc; i++) {
+        arena_reset(&arena);
+
+        if (has_extension(argv[i], "obb")) {
+            if (convert_obb_to_text(&arena, argv[i]) != STATUS_SUCCESS) {
+                status = 1;
+            }
+        } else if (has_extension(argv[i], "ob")) {
+            if (convert_text_to_obb(&arena, argv[i]) != STATUS_SUCCESS) {
+                status = 1;
+            }
+        } else {
+            print_diagnostic("%s: expected a .obb or a .ob file\n", argv[i]);
+            status = 1;
+        }
+    }
+
+    arena_free(&arena);
+    return status;
+}
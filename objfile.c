@@ -0,0 +1,526 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "interner.h"
+#include "linereader.h"
+#include "format.h"
+#include "objfile.h"
+
+/* The largest value of a word (15 bits) */
+#define OBJ_WORD_MAX 077777
+
+void put_u16(byte* out, unsigned int value) {
+    out[0] = (byte)(value & 0xff);
+    out[1] = (byte)((value >> 8) & 0xff);
+}
+
+void put_u32(byte* out, unsigned long value) {
+    out[0] = (byte)(value & 0xff);
+    out[1] = (byte)((value >> 8) & 0xff);
+    out[2] = (byte)((value >> 16) & 0xff);
+    out[3] = (byte)((value >> 24) & 0xff);
+}
+
+unsigned int get_u16(const byte* in) {
+    return (unsigned int)in[0] | ((unsigned int)in[1] << 8);
+}
+
+unsigned long get_u32(const byte* in) {
+    return (unsigned long)in[0] | ((unsigned long)in[1] << 8) | ((unsigned long)in[2] << 16) | ((unsigned long)in[3] << 24);
+}
+
+/* The size of the words, padded so the symbol records that follow are 4-byte aligned */
+long obb_words_size(long num_words) {
+    return (num_words * 2 + 3) & ~3L;
+}
+
+/* Interns the names of 'symbols' and appends their records to 'out' (which must have room for them). */
+Status format_obb_symbols(ByteArray* out, Interner* strings, ObjectSymbol* symbols, int count) {
+    unsigned int id = 0;
+    int i = 0;
+
+    for (i = 0; i < count; i++) {
+        if (interner_intern(strings, symbols[i].name, &id) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+        put_u32(out->buffer + out->size, strings->strings[id].offset);
+        put_u32(out->buffer + out->size + 4, symbols[i].address);
+        out->size += OBB_SYMBOL_SIZE;
+    }
+    return STATUS_SUCCESS;
+}
+
+Status objfile_format_obb(ObjectFile* object, Arena* arena, ByteArray* out) {
+    Interner strings;
+    byte* header = NULL;
+    int header_offset = out->size;
+    byte* cursor = NULL;
+    long num_words = object->code_size + object->data_size;
+    long words_size = obb_words_size(num_words);
+    int i = 0;
+
+    /* The names are interned so every extern is stored once, however many times it is used */
+    if (interner_init(&strings, arena) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (bytearray_reserve(out, OBB_HEADER_SIZE + words_size + (object->num_entries + object->num_externs) * OBB_SYMBOL_SIZE) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    /* The header is completed after the string table is known */
+    header = out->buffer + out->size;
+    memset(header, 0, OBB_HEADER_SIZE);
+    memcpy(header + OBB_OFFSET_MAGIC, OBB_MAGIC, 4);
+    put_u16(header + OBB_OFFSET_VERSION, OBB_VERSION);
+    put_u16(header + OBB_OFFSET_HEADER_SIZE, OBB_HEADER_SIZE);
+    put_u32(header + OBB_OFFSET_LOAD_BASE, object->load_base);
+    put_u32(header + OBB_OFFSET_CODE_SIZE, object->code_size);
+    put_u32(header + OBB_OFFSET_DATA_SIZE, object->data_size);
+    put_u32(header + OBB_OFFSET_NUM_ENTRIES, object->num_entries);
+    put_u32(header + OBB_OFFSET_NUM_EXTERNS, object->num_externs);
+    out->size += OBB_HEADER_SIZE;
+
+    cursor = out->buffer + out->size;
+    for (i = 0; i < object->code_size; i++) {
+        put_u16(cursor, object->code[i]);
+        cursor += 2;
+    }
+    for (i = 0; i < object->data_size; i++) {
+        put_u16(cursor, object->data[i]);
+        cursor += 2;
+    }
+    memset(cursor, 0, words_size - num_words * 2);
+    out->size += words_size;
+
+    if (format_obb_symbols(out, &strings, object->entries, object->num_entries) != STATUS_SUCCESS ||
+        format_obb_symbols(out, &strings, object->externs, object->num_externs) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    put_u32(out->buffer + header_offset + OBB_OFFSET_STRINGS_SIZE, strings.bytes.size);
+    return bytearray_append(out, strings.bytes.buffer, strings.bytes.size);
+}
+
+/* Validates the names of 'count' symbol records. */
+Status obb_check_symbols(const ObbImage* obb, const byte* records, int count, const char* path) {
+    int i = 0;
+
+    for (i = 0; i < count; i++) {
+        if (get_u32(records + i * OBB_SYMBOL_SIZE) >= (unsigned long)obb->strings_size) {
+            print_diagnostic("%s: a symbol name is out of the string table\n", path);
+            return STATUS_FAILURE;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+Status obb_open(ObbImage* obb, const byte* image, long size, const char* path) {
+    unsigned long code_size = 0;
+    unsigned long data_size = 0;
+    unsigned long num_entries = 0;
+    unsigned long num_externs = 0;
+    unsigned long strings_size = 0;
+    long position = OBB_HEADER_SIZE;
+
+    if (size < OBB_HEADER_SIZE || memcmp(image + OBB_OFFSET_MAGIC, OBB_MAGIC, 4) != 0) {
+        print_diagnostic("%s: not a .obb file\n", path);
+        return STATUS_FAILURE;
+    }
+    if (get_u16(image + OBB_OFFSET_VERSION) != OBB_VERSION || get_u16(image + OBB_OFFSET_HEADER_SIZE) != OBB_HEADER_SIZE) {
+        print_diagnostic("%s: unsupported .obb version %u\n", path, get_u16(image + OBB_OFFSET_VERSION));
+        return STATUS_FAILURE;
+    }
+
+    code_size = get_u32(image + OBB_OFFSET_CODE_SIZE);
+    data_size = get_u32(image + OBB_OFFSET_DATA_SIZE);
+    num_entries = get_u32(image + OBB_OFFSET_NUM_ENTRIES);
+    num_externs = get_u32(image + OBB_OFFSET_NUM_EXTERNS);
+    strings_size = get_u32(image + OBB_OFFSET_STRINGS_SIZE);
+
+    /* Every count is checked against the size before it is used, so the sums can't overflow */
+    if (code_size > MAX_MEMORY_SIZE || data_size > MAX_MEMORY_SIZE ||
+        num_entries > (unsigned long)size / OBB_SYMBOL_SIZE || num_externs > (unsigned long)size / OBB_SYMBOL_SIZE ||
+        strings_size > (unsigned long)size) {
+        print_diagnostic("%s: the .obb file is truncated\n", path);
+        return STATUS_FAILURE;
+    }
+
+    obb->image = image;
+    obb->size = size;
+    obb->load_base = get_u32(image + OBB_OFFSET_LOAD_BASE);
+    obb->code_size = code_size;
+    obb->data_size = data_size;
+    obb->num_entries = num_entries;
+    obb->num_externs = num_externs;
+    obb->strings_size = strings_size;
+
+    obb->words = image + position;
+    position += obb_words_size(code_size + data_size);
+    obb->entries = image + position;
+    position += num_entries * OBB_SYMBOL_SIZE;
+    obb->externs = image + position;
+    position += num_externs * OBB_SYMBOL_SIZE;
+    obb->strings = (const char*)image + position;
+    position += strings_size;
+
+    if (position > size) {
+        print_diagnostic("%s: the .obb file is truncated\n", path);
+        return STATUS_FAILURE;
+    }
+
+    /* The last name must be terminated too, so a name never runs out of the image */
+    if (strings_size > 0 && obb->strings[strings_size - 1] != '\0') {
+        print_diagnostic("%s: the string table is not terminated\n", path);
+        return STATUS_FAILURE;
+    }
+
+    if (obb_check_symbols(obb, obb->entries, obb->num_entries, path) != STATUS_SUCCESS ||
+        obb_check_symbols(obb, obb->externs, obb->num_externs, path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+Word obb_word(const ObbImage* obb, int index) {
+    return (Word)get_u16(obb->words + index * 2);
+}
+
+ObjectSymbol obb_symbol(const ObbImage* obb, const byte* record) {
+    ObjectSymbol symbol;
+
+    symbol.name = view_of(obb->strings + get_u32(record));
+    symbol.address = (int)get_u32(record + 4);
+    return symbol;
+}
+
+ObjectSymbol obb_entry(const ObbImage* obb, int index) {
+    return obb_symbol(obb, obb->entries + index * OBB_SYMBOL_SIZE);
+}
+
+ObjectSymbol obb_extern(const ObbImage* obb, int index) {
+    return obb_symbol(obb, obb->externs + index * OBB_SYMBOL_SIZE);
+}
+
+Status objfile_from_obb(ObjectFile* object, const ObbImage* obb, Arena* arena) {
+    int i = 0;
+
+    object->load_base = obb->load_base;
+    object->code_size = obb->code_size;
+    object->data_size = obb->data_size;
+    object->num_entries = obb->num_entries;
+    object->num_externs = obb->num_externs;
+
+    /* +1 so the arrays are never empty allocations */
+    object->code = (Word*)arena_alloc(arena, (obb->code_size + obb->data_size + 1) * sizeof(Word));
+    object->entries = (ObjectSymbol*)arena_alloc(arena, (obb->num_entries + obb->num_externs + 1) * sizeof(ObjectSymbol));
+    if (object->code == NULL || object->entries == NULL) {
+        print_diagnostic("failed to allocate memory for the object file\n");
+        return STATUS_FAILURE;
+    }
+    object->data = object->code + obb->code_size;
+    object->externs = object->entries + obb->num_entries;
+
+    for (i = 0; i < obb->code_size + obb->data_size; i++) {
+        object->code[i] = obb_word(obb, i);
+    }
+    for (i = 0; i < obb->num_entries; i++) {
+        object->entries[i] = obb_entry(obb, i);
+    }
+    for (i = 0; i < obb->num_externs; i++) {
+        object->externs[i] = obb_extern(obb, i);
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Parses an octal word of the .ob file. */
+Status view_to_octal_word(StringView view, Word* out) {
+    long value = 0;
+    int i = 0;
+
+    if (view.length == 0) {
+        return STATUS_FAILURE;
+    }
+
+    for (i = 0; i < view.length; i++) {
+        if (view.start[i] < '0' || view.start[i] > '7') {
+            return STATUS_FAILURE;
+        }
+        value = value * 8 + (view.start[i] - '0');
+        if (value > OBJ_WORD_MAX) {
+            return STATUS_FAILURE;
+        }
+    }
+
+    *out = (Word)value;
+    return STATUS_SUCCESS;
+}
+
+/* Splits the next line of 'reader' into tokens. returns FALSE at the end of the file. */
+bool read_object_line(LineReader* reader, Tokens* tokens, int* line_number) {
+    const char* line = NULL;
+    int length = 0;
+
+    while (linereader_next(reader, &line, &length, line_number)) {
+        /* the lines of the object files are short, a longer line can't be valid anyway */
+        tokens_init(tokens, line, length < MAX_LINE_SIZE ? length : MAX_LINE_SIZE);
+        if (tokens->size > 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+Status read_ob_file(ObjectFile* object, Arena* arena, const char* path) {
+    LineReader reader = {0};
+    Tokens tokens;
+    long code_size = 0;
+    long data_size = 0;
+    long address = 0;
+    int line_number = 0;
+    int i = 0;
+    Status status = 0;
+
+    if (linereader_open(&reader, path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (!read_object_line(&reader, &tokens, &line_number) || tokens.size != 2 ||
+        view_to_long(tokens.tokens[0], 0, MAX_MEMORY_SIZE, &code_size) != STATUS_SUCCESS ||
+        view_to_long(tokens.tokens[1], 0, MAX_MEMORY_SIZE, &data_size) != STATUS_SUCCESS) {
+        print_diagnostic("%s:%d: expected '<code size> <data size>'\n", path, line_number);
+        goto FAILURE;
+    }
+
+    object->code_size = code_size;
+    object->data_size = data_size;
+    object->code = (Word*)arena_alloc(arena, (code_size + data_size + 1) * sizeof(Word));
+    if (object->code == NULL) {
+        print_diagnostic("failed to allocate memory for the object file\n");
+        goto FAILURE;
+    }
+    object->data = object->code + code_size;
+
+    for (i = 0; i < code_size + data_size; i++) {
+        if (!read_object_line(&reader, &tokens, &line_number)) {
+            print_diagnostic("%s: expected %ld words, found %d\n", path, code_size + data_size, i);
+            goto FAILURE;
+        }
+
+        if (tokens.size != 2 || view_to_long(tokens.tokens[0], 0, INT_MAX, &address) != STATUS_SUCCESS ||
+            view_to_octal_word(tokens.tokens[1], &object->code[i]) != STATUS_SUCCESS) {
+            print_diagnostic("%s:%d: expected '<address> <octal word>'\n", path, line_number);
+            goto FAILURE;
+        }
+
+        /* The addresses are consecutive, the first one is the load base */
+        if (i == 0) {
+            object->load_base = address;
+        } else if (address != object->load_base + i) {
+            print_diagnostic("%s:%d: expected address %ld\n", path, line_number, object->load_base + (long)i);
+            goto FAILURE;
+        }
+    }
+
+    if (read_object_line(&reader, &tokens, &line_number)) {
+        print_diagnostic("%s:%d: unexpected line after the last word\n", path, line_number);
+        goto FAILURE;
+    }
+
+    goto SUCCESS;
+SUCCESS:
+    status = STATUS_SUCCESS;
+    goto CLEANUP;
+FAILURE:
+    status = STATUS_FAILURE;
+CLEANUP:
+    linereader_close(&reader);
+    return status;
+}
+
+/* Reads the "<name> <address>" lines of a .ent or .ext file. a missing file has no symbols. */
+Status read_symbol_file(ObjectSymbol** symbols, int* count, Arena* arena, const char* path) {
+    LineReader reader = {0};
+    Tokens tokens;
+    struct stat file_stat;
+    ObjectSymbol* new_symbols = NULL;
+    char* name = NULL;
+    long address = 0;
+    int capacity = INITIAL_CAPACITY;
+    int line_number = 0;
+    Status status = 0;
+
+    *count = 0;
+    *symbols = (ObjectSymbol*)arena_alloc(arena, capacity * sizeof(ObjectSymbol));
+    if (*symbols == NULL) {
+        print_diagnostic("failed to allocate memory for the object file\n");
+        return STATUS_FAILURE;
+    }
+
+    if (stat(path, &file_stat) != 0) {
+        return STATUS_SUCCESS;
+    }
+
+    if (linereader_open(&reader, path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    while (read_object_line(&reader, &tokens, &line_number)) {
+        if (tokens.size != 2 || view_to_long(tokens.tokens[1], 0, INT_MAX, &address) != STATUS_SUCCESS) {
+            print_diagnostic("%s:%d: expected '<name> <address>'\n", path, line_number);
+            goto FAILURE;
+        }
+
+        if (*count >= capacity) {
+            new_symbols = (ObjectSymbol*)arena_resize(arena, *symbols, capacity * sizeof(ObjectSymbol), capacity * 2 * sizeof(ObjectSymbol));
+            if (new_symbols == NULL) {
+                print_diagnostic("failed to allocate memory for the object file\n");
+                goto FAILURE;
+            }
+            *symbols = new_symbols;
+            capacity *= 2;
+        }
+
+        /* The names are copied, the file is closed at the end */
+        name = (char*)arena_alloc(arena, tokens.tokens[0].length + 1);
+        if (name == NULL) {
+            print_diagnostic("failed to allocate memory for the object file\n");
+            goto FAILURE;
+        }
+        memcpy(name, tokens.tokens[0].start, tokens.tokens[0].length);
+        name[tokens.tokens[0].length] = '\0';
+
+        (*symbols)[*count].name.start = name;
+        (*symbols)[*count].name.length = tokens.tokens[0].length;
+        (*symbols)[*count].address = address;
+        (*count)++;
+    }
+
+    goto SUCCESS;
+SUCCESS:
+    status = STATUS_SUCCESS;
+    goto CLEANUP;
+FAILURE:
+    status = STATUS_FAILURE;
+CLEANUP:
+    linereader_close(&reader);
+    return status;
+}
+
+Status objfile_read_text(ObjectFile* object, Arena* arena, char* ob_path) {
+    char* entry_path = NULL;
+    char* extern_path = NULL;
+
+    memset(object, 0, sizeof(ObjectFile));
+
+    entry_path = change_extension(arena, ob_path, "ent");
+    extern_path = change_extension(arena, ob_path, "ext");
+    if (entry_path == NULL || extern_path == NULL) {
+        return STATUS_FAILURE;
+    }
+
+    if (read_ob_file(object, arena, ob_path) != STATUS_SUCCESS ||
+        read_symbol_file(&object->entries, &object->num_entries, arena, entry_path) != STATUS_SUCCESS ||
+        read_symbol_file(&object->externs, &object->num_externs, arena, extern_path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Copies the names of 'symbols' to 'arena', so they don't point into an image that is about to be closed. */
+Status copy_symbol_names(ObjectSymbol* symbols, int count, Arena* arena) {
+    char* name = NULL;
+    int i = 0;
+
+    for (i = 0; i < count; i++) {
+        name = (char*)arena_alloc(arena, symbols[i].name.length + 1);
+        if (name == NULL) {
+            print_diagnostic("failed to allocate memory for the object file\n");
+            return STATUS_FAILURE;
+        }
+        memcpy(name, symbols[i].name.start, symbols[i].name.length);
+        name[symbols[i].name.length] = '\0';
+        symbols[i].name.start = name;
+    }
+    return STATUS_SUCCESS;
+}
+
+Status objfile_read(ObjectFile* object, Arena* arena, char* path) {
+    LineReader reader = {0};
+    ObbImage obb;
+    Status status = 0;
+
+    if (!has_extension(path, "obb")) {
+        return objfile_read_text(object, arena, path);
+    }
+
+    if (linereader_open(&reader, path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (obb_open(&obb, (const byte*)reader.buffer, reader.size, path) != STATUS_SUCCESS ||
+        objfile_from_obb(object, &obb, arena) != STATUS_SUCCESS ||
+        copy_symbol_names(object->entries, object->num_entries, arena) != STATUS_SUCCESS ||
+        copy_symbol_names(object->externs, object->num_externs, arena) != STATUS_SUCCESS) {
+        goto FAILURE;
+    }
+
+    goto SUCCESS;
+SUCCESS:
+    status = STATUS_SUCCESS;
+    goto CLEANUP;
+FAILURE:
+    status = STATUS_FAILURE;
+CLEANUP:
+    linereader_close(&reader);
+    return status;
+}
+
+/* Writes the .ent or .ext file of 'symbols'. nothing is written if there are none, like the assembler does. */
+Status write_symbol_file(ObjectSymbol* symbols, int count, ByteArray* out, const char* path) {
+    int i = 0;
+
+    if (count == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    out->size = 0;
+    for (i = 0; i < count; i++) {
+        if (format_symbol_line(out, symbols[i].name, symbols[i].address) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+    return write_bytearray_to_file(out, path);
+}
+
+Status objfile_write_text(ObjectFile* object, Arena* arena, char* ob_path) {
+    ByteArray out = {0};
+    char* entry_path = NULL;
+    char* extern_path = NULL;
+
+    entry_path = change_extension(arena, ob_path, "ent");
+    extern_path = change_extension(arena, ob_path, "ext");
+    if (entry_path == NULL || extern_path == NULL || bytearray_init(&out, arena) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (format_object_text(&out, object->code, object->code_size, object->data, object->data_size, object->load_base) != STATUS_SUCCESS ||
+        write_bytearray_to_file(&out, ob_path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (write_symbol_file(object->entries, object->num_entries, &out, entry_path) != STATUS_SUCCESS ||
+        write_symbol_file(object->externs, object->num_externs, &out, extern_path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    return STATUS_SUCCESS;
+}
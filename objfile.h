@@ -0,0 +1,94 @@
+#ifndef _OBJFILE_H
+#define _OBJFILE_H
+
+#include "common.h"
+
+/* The .obb file: a binary object file with the same contents as the .ob, .ent and .ext files.
+ * It is laid out so it can be mmap'ed and used in place, without parsing:
+ *
+ *   offset  size                      contents
+ *   0       32                        the header (see below)
+ *   32      2 * num_words             the words, code first and then data. padded with zeros to a multiple of 4 bytes
+ *           8 * num_entries           the entries: {u32 name, u32 address}
+ *           8 * num_externs           the extern references (one per use, like the .ext file): {u32 name, u32 address}
+ *           strings_size              the names, each followed by a '\0'. 'name' is the offset of a name in here
+ *
+ * All the integers are little-endian. The addresses are absolute (they already include the load base),
+ * like in the textual files. */
+
+#define OBB_MAGIC "AOBB"
+#define OBB_VERSION 1
+#define OBB_HEADER_SIZE 32
+#define OBB_SYMBOL_SIZE 8
+
+/* The offsets of the header fields */
+#define OBB_OFFSET_MAGIC 0         /* 4 bytes, OBB_MAGIC */
+#define OBB_OFFSET_VERSION 4       /* u16 */
+#define OBB_OFFSET_HEADER_SIZE 6   /* u16, OBB_HEADER_SIZE */
+#define OBB_OFFSET_LOAD_BASE 8     /* u32, the address of the first code word */
+#define OBB_OFFSET_CODE_SIZE 12    /* u32, in words */
+#define OBB_OFFSET_DATA_SIZE 16    /* u32, in words */
+#define OBB_OFFSET_NUM_ENTRIES 20  /* u32 */
+#define OBB_OFFSET_NUM_EXTERNS 24  /* u32 */
+#define OBB_OFFSET_STRINGS_SIZE 28 /* u32 */
+
+typedef struct {
+    StringView name; /* null-terminated when it comes from an ObbImage */
+    int address;
+} ObjectSymbol;
+
+/* The contents of an object file, however it is stored. */
+typedef struct {
+    int load_base;
+    Word* code;
+    int code_size;
+    Word* data;
+    int data_size;
+    ObjectSymbol* entries;
+    int num_entries;
+    ObjectSymbol* externs;
+    int num_externs;
+} ObjectFile;
+
+/* A validated .obb image (e.g. an mmap'ed file). nothing is copied, all the pointers point into the image. */
+typedef struct {
+    const byte* image;
+    long size;
+    int load_base;
+    int code_size;
+    int data_size;
+    int num_entries;
+    int num_externs;
+    const byte* words;
+    const byte* entries;
+    const byte* externs;
+    const char* strings;
+    long strings_size;
+} ObbImage;
+
+/* Appends the .obb image of 'object' to 'out'. temporary memory is allocated from 'arena'. */
+Status objfile_format_obb(ObjectFile* object, Arena* arena, ByteArray* out);
+
+/* Validates the header and the bounds of a .obb image, so the accessors below can't read outside of it.
+ * 'path' is only used in the error messages. */
+Status obb_open(ObbImage* obb, const byte* image, long size, const char* path);
+
+/* The word at 'index' (0 is the first code word, code_size is the first data word). */
+Word obb_word(const ObbImage* obb, int index);
+ObjectSymbol obb_entry(const ObbImage* obb, int index);
+ObjectSymbol obb_extern(const ObbImage* obb, int index);
+
+/* Decodes 'obb' into 'object'. the words and the symbol arrays are allocated from 'arena', the names point into the image. */
+Status objfile_from_obb(ObjectFile* object, const ObbImage* obb, Arena* arena);
+
+/* Reads 'ob_path' and, if they exist, the .ent and .ext files next to it. everything is allocated from 'arena'. */
+Status objfile_read_text(ObjectFile* object, Arena* arena, char* ob_path);
+
+/* Reads a .obb file, or a .ob file with its .ent and .ext files (like objfile_read_text), by the extension of 'path'.
+ * everything is allocated from 'arena' (the names of a .obb are copied, so the file isn't kept open). */
+Status objfile_read(ObjectFile* object, Arena* arena, char* path);
+
+/* Writes the .ob file of 'object' to 'ob_path', and the .ent and .ext files next to it (when there are entries / externs). */
+Status objfile_write_text(ObjectFile* object, Arena* arena, char* ob_path);
+
+#endif
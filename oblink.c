@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "filelist.h"
+#include "objfile.h"
+#include "linker.h"
+
+/* Links assembled modules into a single program:
+ *   oblink -o prog.ob main.ob lib.obb ...   writes prog.ob (and prog.ent when the modules have entries)
+ *   oblink -o prog.obb main.ob lib.obb ...  writes the linked program as a .obb file */
+
+#define DEFAULT_OUTPUT "linked.ob"
+
+void print_usage(void) {
+    printf("usage: oblink [-o <output.ob | output.obb>] <module1.ob | module1.obb> ... <moduleN.ob | moduleN.obb>\n");
+    printf("       a module named @<manifest> is replaced by the paths listed in <manifest> (one per line)\n");
+    printf("       the default output is %s\n", DEFAULT_OUTPUT);
+}
+
+/* Writes the linked program to 'output_path', in the format of its extension. */
+Status write_output(ObjectFile* program, Arena* arena, char* output_path) {
+    ByteArray out = {0};
+
+    if (has_extension(output_path, "ob")) {
+        return objfile_write_text(program, arena, output_path);
+    }
+
+    if (bytearray_init(&out, arena) != STATUS_SUCCESS ||
+        objfile_format_obb(program, arena, &out) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    return write_bytearray_to_file(&out, output_path);
+}
+
+int main(int argc, char **argv) {
+    Linker linker;
+    ObjectFile program;
+    Arena output_arena;
+    char* output_path = DEFAULT_OUTPUT;
+    char** module_paths = NULL;
+    int num_modules = 0;
+    int paths_capacity = 0;
+    int status = 0;
+    int i = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                status = 1;
+                goto CLEANUP;
+            }
+            i++;
+            output_path = argv[i];
+        } else if (argv[i][0] == '@') {
+            if (read_manifest(argv[i] + 1, &module_paths, &num_modules, &paths_capacity) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+        } else {
+            if (append_path(argv[i], &module_paths, &num_modules, &paths_capacity) != STATUS_SUCCESS) {
+                status = 1;
+                goto CLEANUP;
+            }
+        }
+    }
+
+    if (num_modules == 0) {
+        print_usage();
+        status = 1;
+        goto CLEANUP;
+    }
+
+    if (!has_extension(output_path, "ob") && !has_extension(output_path, "obb")) {
+        print_diagnostic("%s: expected a .ob or a .obb output file\n", output_path);
+        status = 1;
+        goto CLEANUP;
+    }
+
+    if (linker_init(&linker) != STATUS_SUCCESS) {
+        linker_free(&linker);
+        status = 1;
+        goto CLEANUP;
+    }
+
+    /* Every module is read even after a failure, so all the broken modules are reported at once */
+    for (i = 0; i < num_modules; i++) {
+        if (linker_add_module(&linker, module_paths[i]) != STATUS_SUCCESS) {
+            status = 1;
+        }
+    }
+
+    if (status == 0 && linker_link(&linker, &program) != STATUS_SUCCESS) {
+        status = 1;
+    }
+
+    if (status == 0) {
+        arena_init(&output_arena);
+        if (write_output(&program, &output_arena, output_path) != STATUS_SUCCESS) {
+            status = 1;
+        }
+        arena_free(&output_arena);
+    }
+
+    linker_free(&linker);
+
+CLEANUP:
+    for (i = 0; i < num_modules; i++) {
+        free(module_paths[i]);
+    }
+    free(module_paths);
+    return status;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "objfile.h"
+#include "emulator.h"
+
+/* Runs an assembled program:
+ *   obrun prog.ob     reads prog.ob (and prog.ent / prog.ext if they exist) and runs it
+ *   obrun prog.obb    runs the .obb file
+ * red reads characters from stdin and prn writes characters to stdout, so the messages go to stderr. */
+
+void print_usage(void) {
+    fprintf(stderr, "usage: obrun [--max-steps N] [--regs] <prog.ob | prog.obb>\n");
+    fprintf(stderr, "       --max-steps N stops the program after N instructions\n");
+    fprintf(stderr, "       --regs prints the registers and the number of instructions when the program ends\n");
+}
+
+/* Parses the value of '--max-steps'. */
+Status parse_max_steps(const char* str, unsigned long* out) {
+    char* endptr = 0;
+    unsigned long value = 0;
+
+    value = strtoul(str, &endptr, 10);
+    if (endptr == str || *endptr != '\0' || str[0] == '-' || value == 0) {
+        print_diagnostic("invalid number of steps '%s'\n", str);
+        return STATUS_FAILURE;
+    }
+
+    *out = value;
+    return STATUS_SUCCESS;
+}
+
+/* Loads the program in 'path' (a .ob or a .obb file) into 'emulator'. */
+Status load_program(Emulator* emulator, Arena* arena, char* path) {
+    ObjectFile object;
+
+    if (objfile_read(&object, arena, path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    return emulator_load(emulator, &object, path);
+}
+
+void print_registers(Emulator* emulator) {
+    int i = 0;
+
+    fprintf(stderr, "pc %04d, %lu instructions\n", emulator->pc, emulator->steps);
+    for (i = 0; i < REGISTERS_NUM; i++) {
+        fprintf(stderr, "r%d %05o%s", i, emulator->registers[i], i + 1 < REGISTERS_NUM ? " " : "\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    Emulator* emulator = NULL;
+    Arena arena;
+    char* program_path = NULL;
+    unsigned long max_steps = 0;
+    bool print_regs = FALSE;
+    EmulatorResult result = EMULATOR_STOPPED;
+    int status = 0;
+    int i = 0;
+
+    diagnostics_set_stream(stderr);
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--regs") == 0) {
+            print_regs = TRUE;
+        } else if (strcmp(argv[i], "--max-steps") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            i++;
+            if (parse_max_steps(argv[i], &max_steps) != STATUS_SUCCESS) {
+                return 1;
+            }
+        } else if (program_path == NULL) {
+            program_path = argv[i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (program_path == NULL) {
+        print_usage();
+        return 1;
+    }
+
+    /* The emulator holds the whole memory and its decoded instructions, too big for the stack */
+    emulator = (Emulator*)calloc(1, sizeof(Emulator));
+    if (emulator == NULL) {
+        print_diagnostic("failed to allocate memory for the emulator\n");
+        return 1;
+    }
+
+    arena_init(&arena);
+    if (load_program(emulator, &arena, program_path) != STATUS_SUCCESS) {
+        status = 1;
+        goto CLEANUP;
+    }
+
+    emulator->max_steps = max_steps;
+    result = emulator_run(emulator);
+    if (result == EMULATOR_STEP_LIMIT) {
+        print_diagnostic("%s: stopped after %lu instructions\n", program_path, emulator->steps);
+    }
+    if (result != EMULATOR_STOPPED) {
+        status = 1;
+    }
+
+    if (print_regs) {
+        print_registers(emulator);
+    }
+
+CLEANUP:
+    arena_free(&arena);
+    free(emulator);
+    return status;
+}
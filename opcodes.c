@@ -0,0 +1,23 @@
+#include "common.h"
+#include "assembler.h"
+
+/* The instruction set: the operands every opcode accepts. shared by the assembler and the emulator
+ * (read-only, so any number of threads can assemble at once). */
+const OpcodeTableEntry opcodeTable[] = {
+    {"mov", 0, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
+    {"cmp", 1, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
+    {"add", 2, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
+    {"sub", 3, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
+    {"lea", 4, ADDRESSING_1, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 2},
+    {"clr", 5, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
+    {"not", 6, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
+    {"inc", 7, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
+    {"dec", 8, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
+    {"jmp", 9, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2, 1},
+    {"bne", 10, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2, 1},
+    {"red", 11, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
+    {"prn", 12, ADDRESSING_NONE, ADDRESSING_0|ADDRESSING_1|ADDRESSING_2|ADDRESSING_3, 1},
+    {"jsr", 13, ADDRESSING_NONE, ADDRESSING_1|ADDRESSING_2, 1},
+    {"rts", 14, ADDRESSING_NONE, ADDRESSING_NONE, 0},
+    {"stop", 15, ADDRESSING_NONE, ADDRESSING_NONE, 0}
+};
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "outstream.h"
+
+/* "<kind> <size>\n": the longest kind, a space, the digits of a long and a '\n' */
+#define FRAME_HEADER_SIZE 48
+
+const char* outstream_kind_names[OUTPUT_NUM_KINDS] = {"am", "ob", "ent", "ext", "obb", "diagnostics"};
+
+void outstream_init(OutputStream* stream, int frame_fd) {
+    int i = 0;
+
+    memset(stream, 0, sizeof(OutputStream));
+    stream->frame_fd = frame_fd;
+    for (i = 0; i < OUTPUT_NUM_KINDS; i++) {
+        stream->fds[i] = -1;
+    }
+}
+
+void outstream_init_memory(OutputStream* stream, Arena* arena) {
+    outstream_init(stream, -1);
+    stream->arena = arena;
+}
+
+/* Copies the views of an output, one after the other, into a single buffer of the stream's arena. */
+Status outstream_keep_views(OutputStream* stream, OutputKind kind, StringView* views, int count) {
+    OutputBuffer* output = &stream->buffers[kind];
+    long size = 0;
+    int i = 0;
+
+    for (i = 0; i < count; i++) {
+        size += views[i].length;
+    }
+
+    output->buffer = (byte*)arena_alloc(stream->arena, size > 0 ? size : 1);
+    if (output->buffer == NULL) {
+        print_diagnostic("failed to allocate memory for the %s output\n", outstream_kind_names[kind]);
+        return STATUS_FAILURE;
+    }
+
+    output->size = 0;
+    for (i = 0; i < count; i++) {
+        memcpy(output->buffer + output->size, views[i].start, views[i].length);
+        output->size += views[i].length;
+    }
+    return STATUS_SUCCESS;
+}
+
+Status outstream_write_files(OutputStream* stream, Arena* arena, char* source_path) {
+    char* output_path = NULL;
+    Status status = STATUS_SUCCESS;
+    int i = 0;
+
+    for (i = 0; i < OUTPUT_NUM_KINDS; i++) {
+        if (i == OUTPUT_DIAGNOSTICS || stream->buffers[i].buffer == NULL) {
+            continue;
+        }
+
+        output_path = change_extension(arena, source_path, (char*)outstream_kind_names[i]);
+        if (output_path == NULL || write_buffer_to_file(stream->buffers[i].buffer, stream->buffers[i].size, output_path) != STATUS_SUCCESS) {
+            status = STATUS_FAILURE;
+        }
+    }
+    return status;
+}
+
+Status outstream_parse_fd(OutputStream* stream, const char* option) {
+    const char* equals = strchr(option, '=');
+    long fd = 0;
+    int i = 0;
+
+    if (equals != NULL && view_to_long(view_of(equals + 1), 0, 1023, &fd) == STATUS_SUCCESS) {
+        for (i = 0; i < OUTPUT_NUM_KINDS; i++) {
+            if ((int)strlen(outstream_kind_names[i]) == equals - option &&
+                strncmp(option, outstream_kind_names[i], equals - option) == 0) {
+                stream->fds[i] = (int)fd;
+                return STATUS_SUCCESS;
+            }
+        }
+    }
+
+    printf("invalid output descriptor '%s' (should be <kind>=<fd>, where <kind> is am, ob, ent, ext, obb or diagnostics)\n", option);
+    return STATUS_FAILURE;
+}
+
+Status outstream_write_views(OutputStream* stream, OutputKind kind, StringView* views, int count) {
+    char header[FRAME_HEADER_SIZE];
+    StringView header_view;
+    long size = 0;
+    int i = 0;
+
+    if (stream->arena != NULL) {
+        return outstream_keep_views(stream, kind, views, count);
+    }
+
+    if (stream->fds[kind] >= 0) {
+        if (write_views(stream->fds[kind], views, count) != STATUS_SUCCESS) {
+            print_diagnostic("failed to write the %s output to descriptor %d\n", outstream_kind_names[kind], stream->fds[kind]);
+            return STATUS_FAILURE;
+        }
+        return STATUS_SUCCESS;
+    }
+
+    for (i = 0; i < count; i++) {
+        size += views[i].length;
+    }
+    header_view.start = header;
+    header_view.length = sprintf(header, "%s %ld\n", outstream_kind_names[kind], size);
+
+    if (write_views(stream->frame_fd, &header_view, 1) != STATUS_SUCCESS ||
+        write_views(stream->frame_fd, views, count) != STATUS_SUCCESS) {
+        print_diagnostic("failed to write the %s output\n", outstream_kind_names[kind]);
+        return STATUS_FAILURE;
+    }
+    return STATUS_SUCCESS;
+}
+
+Status outstream_write(OutputStream* stream, OutputKind kind, const byte* buffer, long size) {
+    StringView view;
+
+    view.start = (const char*)buffer;
+    view.length = (int)size;
+    return outstream_write_views(stream, kind, &view, 1);
+}
+
+Status outstream_finish(OutputStream* stream, Status status) {
+    StringView view;
+
+    if (stream->arena != NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    view = view_of(status == STATUS_SUCCESS ? "status 1\n0" : "status 1\n1");
+    return write_views(stream->frame_fd, &view, 1);
+}
@@ -0,0 +1,59 @@
+#ifndef _OUTSTREAM_H
+#define _OUTSTREAM_H
+
+#include "common.h"
+
+/* The outputs of assembling a single source read from stdin (the source "-"), for pipelines that never touch the
+ * file system. Every output goes either to a file descriptor of its own (raw), or to 'frame_fd' (usually stdout),
+ * multiplexed as frames:
+ *   <kind> <size>\n<size bytes>
+ * e.g. "ob 42\n" followed by the 42 bytes of the .ob file. The kinds are the names in outstream_kind_names.
+ * Outputs that aren't produced (e.g. an .ent file without entries) get no frame. The last frame is always
+ *   status 1\n0        (or 1, if assembling failed) */
+
+typedef enum {
+    OUTPUT_AM,
+    OUTPUT_OB,
+    OUTPUT_ENT,
+    OUTPUT_EXT,
+    OUTPUT_OBB,
+    OUTPUT_DIAGNOSTICS,
+    OUTPUT_NUM_KINDS
+} OutputKind;
+
+/* An output kept in memory (see outstream_init_memory). 'buffer' is NULL if the output wasn't produced */
+typedef struct {
+    byte* buffer;
+    long size;
+} OutputBuffer;
+
+typedef struct {
+    int frame_fd;
+    int fds[OUTPUT_NUM_KINDS]; /* -1: framed on 'frame_fd'. otherwise the output is written, as is, to this fd */
+    Arena* arena; /* not NULL: nothing is written anywhere, every output is copied into 'buffers' (allocated from 'arena') */
+    OutputBuffer buffers[OUTPUT_NUM_KINDS];
+} OutputStream;
+
+extern const char* outstream_kind_names[OUTPUT_NUM_KINDS];
+
+/* Frames every output on 'frame_fd'. */
+void outstream_init(OutputStream* stream, int frame_fd);
+
+/* Keeps every output in memory, in 'stream->buffers', instead of writing it. the buffers live as long as 'arena'. */
+void outstream_init_memory(OutputStream* stream, Arena* arena);
+
+/* Writes every output kept in memory (but the diagnostics) to a file next to 'source_path', with the kind as its
+ * extension (e.g. prog.as -> prog.ob). outputs that weren't produced are left alone. */
+Status outstream_write_files(OutputStream* stream, Arena* arena, char* source_path);
+
+/* Parses a "<kind>=<fd>" option (e.g. "ob=3") and sends the output of that kind to the fd. prints an error on failure. */
+Status outstream_parse_fd(OutputStream* stream, const char* option);
+
+/* Writes an output that is made of 'count' consecutive views (e.g. the lines of the .am file). */
+Status outstream_write_views(OutputStream* stream, OutputKind kind, StringView* views, int count);
+Status outstream_write(OutputStream* stream, OutputKind kind, const byte* buffer, long size);
+
+/* Writes the final status frame (nothing, for a stream in memory). */
+Status outstream_finish(OutputStream* stream, Status status);
+
+#endif
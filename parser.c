@@ -3,97 +3,119 @@
 #include <string.h>
 #include <ctype.h>
 #include "parser.h"
+#include "scan.h"
 
 #define MAX_LABEL_LENGTH 31
-#define DIRECTIVES_NUM 4
-
-char *directives[] = {".data", ".string", ".entry", ".extern"};
 
 /* chek if directive */
-bool is_directive(const char* word) {
-    int i = 0;
+bool is_directive(StringView word) {
+    return keyword_lookup(word.start, word.length).kind == KEYWORD_DIRECTIVE;
+}
 
-    for (i = 0; i < DIRECTIVES_NUM; i++) {
-        if (strcmp(word, directives[i]) == 0) {
-            return TRUE;
+void parsed_line_init(ParsedLine* parsed, Arena* arena) {
+    memset(parsed, 0, sizeof(ParsedLine));
+    parsed->params = parsed->inline_params;
+    parsed->arena = arena;
+}
+
+/* Adds a parameter, moving the parameters to 'data_params' when they don't fit in 'inline_params'. */
+Status parsed_line_add_param(ParsedLine* parsed, StringView param) {
+    StringView* new_params = NULL;
+    int new_capacity = 0;
+
+    if (parsed->num_params == MAX_INLINE_PARAMS && parsed->params == parsed->inline_params) {
+        if (parsed->data_params_capacity == 0) {
+            new_capacity = 8 * MAX_INLINE_PARAMS;
+            parsed->data_params = (StringView*)arena_alloc(parsed->arena, new_capacity * sizeof(StringView));
+            if (parsed->data_params == NULL) {
+                print_diagnostic("failed to allocate memory for parameters\n");
+                return STATUS_FAILURE;
+            }
+            parsed->data_params_capacity = new_capacity;
         }
+        memcpy(parsed->data_params, parsed->inline_params, MAX_INLINE_PARAMS * sizeof(StringView));
+        parsed->params = parsed->data_params;
     }
-    return FALSE;
-}
 
-bool is_empty_line(const char* line) {
-    int i = 0;
-    while (is_whitespace(line[i])) {
-        i++;
+    if (parsed->params == parsed->data_params && parsed->num_params >= parsed->data_params_capacity) {
+        new_capacity = parsed->data_params_capacity * 2;
+        new_params = (StringView*)arena_resize(parsed->arena, parsed->data_params, parsed->num_params * sizeof(StringView), new_capacity * sizeof(StringView));
+        if (new_params == NULL) {
+            print_diagnostic("failed to allocate memory for parameters\n");
+            return STATUS_FAILURE;
+        }
+        parsed->data_params = new_params;
+        parsed->data_params_capacity = new_capacity;
+        parsed->params = parsed->data_params;
     }
-    return (line[i] == '\0');
+
+    parsed->params[parsed->num_params] = param;
+    parsed->num_params++;
+    return STATUS_SUCCESS;
+}
+
+bool is_empty_line(const char* line, int length) {
+    return scan_skip_whitespace(line, 0, length) == length;
 }
 
-Status validate_label_name(const char* label, const char* file_path, int line_number) {
-    int len = strlen(label);
+Status validate_label_name(StringView label, const char* file_path, int line_number) {
+    int len = label.length;
     int i = 0;
 
     if (len == 0) {
-        printf("%s:%d: empty label not allowed\n", file_path, line_number);
+        print_diagnostic("%s:%d: empty label not allowed\n", file_path, line_number);
         return STATUS_FAILURE;
     }
 
     if (len > MAX_LABEL_LENGTH) {
-        printf("%s:%d: label too long\n", file_path, line_number);
+        print_diagnostic("%s:%d: label too long\n", file_path, line_number);
         return STATUS_FAILURE;
     }
 
-    if (!isalpha(label[0])) {
-        printf("%s:%d: label must start with a letter\n", file_path, line_number);
+    if (!isalpha((byte)label.start[0])) {
+        print_diagnostic("%s:%d: label must start with a letter\n", file_path, line_number);
         return STATUS_FAILURE;
     }
 
     for (i = 0; i < len; i++) {
-        if (!isalnum(label[i])) {
-            printf("%s:%d: label contains invalid characters\n", file_path, line_number);
+        if (!isalnum((byte)label.start[i])) {
+            print_diagnostic("%s:%d: label contains invalid characters\n", file_path, line_number);
             return STATUS_FAILURE;
         }
     }
 
-    for (i = 0; i < NUM_RESERVED_WORDS; i++) {
-        if (strcmp(label, reserved_words[i]) == 0) {
-            printf("%s:%d: label cannot be a reserved word\n", file_path, line_number);
-            return STATUS_FAILURE;
-        }
+    if (is_reserved_word(label.start, label.length)) {
+        print_diagnostic("%s:%d: label cannot be a reserved word\n", file_path, line_number);
+        return STATUS_FAILURE;
     }
 
     return STATUS_SUCCESS;
 }
 
 /* line should point to the start of the first parameter */
-Status parse_params(ParsedLine* parsed, const char* line, const char* filepath, int line_number) {
+Status parse_params(ParsedLine* parsed, const char* line, int length, const char* filepath, int line_number) {
     int i = 0;
-    int j = 0;
+    StringView param;
 
-    while (line[i] != '\0') {
-        while (is_whitespace(line[i])) {
-            i++;
-        }
+    while (i < length) {
+        i = scan_skip_whitespace(line, i, length);
 
-        j = 0;
-        while(line[i] != '\0' && line[i] != ',' && !is_whitespace(line[i])) {
-            parsed->params[parsed->num_params][j] = line[i];
-            i++;
-            j++;
-        }
+        param.start = line + i;
+        i = scan_find(line, i, length, SCAN_WHITESPACE | SCAN_COMMA);
+        param.length = line + i - param.start;
 
-        while (is_whitespace(line[i])) {
-            i++;
-        }
+        i = scan_skip_whitespace(line, i, length);
 
-        if (j == 0) {
-            printf("%s:%d: invalid parameter structure\n", filepath, line_number);
+        if (param.length == 0) {
+            print_diagnostic("%s:%d: invalid parameter structure\n", filepath, line_number);
             return STATUS_FAILURE;
         }
 
-        parsed->num_params++;
+        if (parsed_line_add_param(parsed, param) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
 
-        if (line[i] == '\0') {
+        if (i == length) {
             break;
         }
 
@@ -103,69 +125,64 @@ Status parse_params(ParsedLine* parsed, const char* line, const char* filepath,
         }
 
         /* If we found another letter, but there was no ',' before that (e.g. "a b c")*/
-        printf("%s:%d: invalid parameter structure\n", filepath, line_number);
+        print_diagnostic("%s:%d: invalid parameter structure\n", filepath, line_number);
         return STATUS_FAILURE;
     }
 
     return STATUS_SUCCESS;
 }
 
-Status parse_line(ParsedLine* parsed, char* line, const char* filepath, int line_number) {    
+Status parse_line(ParsedLine* parsed, const char* line, int length, const char* filepath, int line_number) {    
     int i = 0;
-    int j = 0;
-    char token[LINEBUFFER_SIZE] = {0};
+    StringView token;
 
-    memset(parsed, 0, sizeof(ParsedLine));
+    parsed->label.start = line;
+    parsed->label.length = 0;
+    parsed->instruction.start = line;
+    parsed->instruction.length = 0;
+    parsed->keyword.kind = KEYWORD_NONE;
+    parsed->num_params = 0;
+    parsed->params = parsed->inline_params;
 
-    /* Read the first token into 'token' (terminated by whitespace).
-     * If it ends with a ':' , copy it into 'parsed->label'.
-     * Otherwise, copy it into parsed->instruction. */
+    /* Read the first token (terminated by whitespace).
+     * If it ends with a ':' , it's the label.
+     * Otherwise, it's the instruction. */
 
-    while (is_whitespace(line[i])) { /* Skip whitespaces */
-        i++;
-    }
+    i = scan_skip_whitespace(line, i, length);
 
-    j = 0;
-    while (line[i] != '\0' && !is_whitespace(line[i])) {
-        token[j] = line[i];
-        i++;
-        j++;
-    }
+    token.start = line + i;
+    i = scan_find(line, i, length, SCAN_WHITESPACE);
+    token.length = line + i - token.start;
 
-    if (token[strlen(token) - 1] == ':') { /* The first token is a label: read the instruction. */
-        strcpy(parsed->label, token);
-        parsed->label[strlen(token) - 1] = '\0'; /* Remove the colon, we don't need it anymore. */
+    if (token.length > 0 && token.start[token.length - 1] == ':') { /* The first token is a label: read the instruction. */
+        parsed->label.start = token.start;
+        parsed->label.length = token.length - 1; /* Remove the colon, we don't need it anymore. */
 
         if (validate_label_name(parsed->label, filepath, line_number) != STATUS_SUCCESS) {
             return STATUS_FAILURE;
         }
 
-        while (is_whitespace(line[i])) { /* Skip whitespaces */
-            i++;
-        }
+        i = scan_skip_whitespace(line, i, length);
         
-        j = 0;
-        while (line[i] != '\0' && !is_whitespace(line[i])) {
-            parsed->instruction[j] = line[i];
-            i++;
-            j++;
-        }
+        parsed->instruction.start = line + i;
+        i = scan_find(line, i, length, SCAN_WHITESPACE);
+        parsed->instruction.length = line + i - parsed->instruction.start;
 
-        if (strlen(parsed->instruction) == 0) {
-            printf("%s:%d: no instruction or directive found\n", filepath, line_number);
+        if (parsed->instruction.length == 0) {
+            print_diagnostic("%s:%d: no instruction or directive found\n", filepath, line_number);
             return STATUS_FAILURE;
         }
 
     } else { /* The first token is an instruction */
-        strcpy(parsed->instruction, token);
+        parsed->instruction = token;
     }
 
-    while (is_whitespace(line[i])) { /* Skip whitespaces. */
-        i++;
-    }
+    parsed->keyword = keyword_lookup(parsed->instruction.start, parsed->instruction.length);
+
+    i = scan_skip_whitespace(line, i, length);
 
-    if (line[i] != '\0') {
-        if (parse_params(parsed, line + i, filepath, line_number)) {
+    if (i < length) {
+        if (parse_params(parsed, line + i, length - i, filepath, line_number)) {
             return STATUS_FAILURE;
         }
     }
@@ -2,20 +2,32 @@
 #define _PARSER_H
 
 #include "common.h"
+#include "keywords.h"
 
+/* Instructions have at most 2 operands. Longer parameter lists (.data) go to 'data_params'. */
+#define MAX_INLINE_PARAMS 2
+
+/* All the views point into the parsed source line, so they are only valid as long as the line is. */
 typedef struct {
-    char label[LINEBUFFER_SIZE]; /* optional label */
-    char instruction[LINEBUFFER_SIZE]; /* instruction or directive */
+    StringView label; /* optional label (without the ':'). empty if there is no label */
+    StringView instruction; /* instruction or directive */
+    Keyword keyword; /* the classification of 'instruction' */
     int num_params;
-    char params[LINEBUFFER_SIZE][LINEBUFFER_SIZE];
+    StringView* params; /* points to 'inline_params', or to 'data_params' when there are more than MAX_INLINE_PARAMS */
+    StringView inline_params[MAX_INLINE_PARAMS];
+    StringView* data_params; /* growable, kept between lines */
+    int data_params_capacity;
+    Arena* arena; /* 'data_params' is allocated from here */
 } ParsedLine;
 
-bool is_empty_line(const char* line);
-Status validate_label_name(const char* label, const char* file_path, int line_number);
+void parsed_line_init(ParsedLine* parsed, Arena* arena);
+
+bool is_empty_line(const char* line, int length);
+Status validate_label_name(StringView label, const char* file_path, int line_number);
 
-Status parse_params(ParsedLine* parsed, const char* line, const char* filepath, int line_number);
-Status parse_line(ParsedLine* parsed, char* line, const char* filepath, int line_number);
+Status parse_params(ParsedLine* parsed, const char* line, int length, const char* filepath, int line_number);
+Status parse_line(ParsedLine* parsed, const char* line, int length, const char* filepath, int line_number);
 
-bool is_directive(const char* word);
+bool is_directive(StringView word);
 
 #endif
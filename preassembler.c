@@ -1,252 +1,357 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "preassembler.h"
 #include "common.h"
+#include "linereader.h"
+#include "scan.h"
+#include "keywords.h"
 
-Status macrotable_init(MacroTable* table) {
+Status macrotable_init(MacroTable* table, Interner* names, Arena* arena) {
+    table->arena = arena;
+    table->names = names;
     table->arr_capacity = INITIAL_CAPACITY;
     table->macro_count = 0;
-    table->macros = (MacroTableEntry*)malloc(table->arr_capacity * sizeof(MacroTableEntry));
+    table->macros = (MacroTableEntry*)arena_alloc(arena, table->arr_capacity * sizeof(MacroTableEntry));
     if (table->macros == NULL) {
-        printf("Failed to allocate memory for macros\n");
+        print_diagnostic("Failed to allocate memory for macros\n");
+        return STATUS_FAILURE;
+    }
+
+    if (idmap_init(&table->by_name, arena) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    table->line_capacity = INITIAL_CAPACITY;
+    table->line_count = 0;
+    table->lines = (StringView*)arena_alloc(arena, table->line_capacity * sizeof(StringView));
+    if (table->lines == NULL) {
+        print_diagnostic("Failed to allocate memory for macros\n");
         return STATUS_FAILURE;
     }
 
     return STATUS_SUCCESS;
 }
 
-Status add_macro(MacroTable* table, char* name, char* content) {
-    int i = 0;
-    MacroTableEntry* new_macros = 0;
-    
-    for (i = 0; i < table->macro_count; i++) {
-        if(strcmp(table->macros[i].macro_name , name) == 0){
-            return STATUS_FAILURE; /* macro already exist */
+/* Adds a line to the body of the macro that is being defined (the macro is added by add_macro when it ends). */
+Status add_macro_line(MacroTable* table, const char* line, int length) {
+    StringView* new_lines = NULL;
+
+    if (table->line_count >= table->line_capacity) {
+        new_lines = (StringView*)arena_resize(table->arena, table->lines, table->line_capacity * sizeof(StringView), table->line_capacity * 2 * sizeof(StringView));
+        if (new_lines == NULL) {
+            print_diagnostic("failed to allocater memory for macros\n");
+            return STATUS_FAILURE;
         }
+        table->lines = new_lines;
+        table->line_capacity *= 2;
+    }
+
+    table->lines[table->line_count].start = line;
+    table->lines[table->line_count].length = length;
+    table->line_count++;
+    return STATUS_SUCCESS;
+}
+
+/* Adds a macro, whose lines are the lines added since 'first_line'. */
+Status add_macro(MacroTable* table, StringView name, int first_line) {
+    MacroTableEntry* new_macros = 0;
+    unsigned int name_id = 0;
+
+    if (interner_intern(table->names, name, &name_id) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (idmap_get(&table->by_name, name_id) >= 0) {
+        return STATUS_FAILURE; /* macro already exist */
     }
 
     /* if table is full, increase capacity */
     if(table->macro_count >= table->arr_capacity) {
-        new_macros = (MacroTableEntry*)malloc(table->arr_capacity * 2 * sizeof(MacroTableEntry));
+        new_macros = (MacroTableEntry*)arena_resize(table->arena, table->macros, table->arr_capacity * sizeof(MacroTableEntry), table->arr_capacity * 2 * sizeof(MacroTableEntry));
         if (new_macros == NULL) {
-            printf("failed to allocater memory for macros\n");
+            print_diagnostic("failed to allocater memory for macros\n");
             return STATUS_FAILURE; 
         }
-        memcpy(new_macros, table->macros, table->arr_capacity * sizeof(MacroTableEntry));
-        free(table->macros);
         table->arr_capacity *= 2;
         table->macros = new_macros;
     }
 
-    table->macros[table->macro_count].macro_name = my_strdup(name);
-    if (table->macros[table->macro_count].macro_name == NULL) {
-        printf("failed to allocater memory for macros\n");
-        return STATUS_FAILURE; 
-    }
-    table->macros[table->macro_count].macro_content = my_strdup(content);
-    if (table->macros[table->macro_count].macro_content == NULL) {
-        printf("failed to allocater memory for macros\n");
-        free(table->macros[table->macro_count].macro_name);
-        return STATUS_FAILURE; 
+    if (idmap_set(&table->by_name, name_id, table->macro_count) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
     }
+
+    table->macros[table->macro_count].macro_name = name_id;
+    table->macros[table->macro_count].first_line = first_line;
+    table->macros[table->macro_count].num_lines = table->line_count - first_line;
     table->macro_count++;
     return STATUS_SUCCESS;
 }
 
-char* get_macro_content(MacroTable* table, char* name) {
-    int i = 0;
-    for (i = 0; i < table->macro_count; i++) {
-        if (strcmp(table->macros[i].macro_name , name) == 0) {
-            return table->macros[i].macro_content;
-        }
+/* returns the macro called 'name', or NULL if there is no such macro. */
+MacroTableEntry* get_macro(MacroTable* table, StringView name) {
+    unsigned int name_id = 0;
+    int position = 0;
+
+    /* Most single-token lines are plain instructions (e.g. "rts", "stop"), reject them as cheaply as possible:
+     * no macro can be named after a keyword (see validate_macro_name), and the keyword switch is cheaper than the table */
+    if (table->macro_count == 0 || keyword_lookup(name.start, name.length).kind != KEYWORD_NONE) {
+        return NULL;
     }
-    return NULL;
-}
 
-void free_macro_table(MacroTable* table) {
-    int i = 0;
-    
-    if (table->macros != NULL) {
-        for (i = 0; i < table->macro_count; i++) {
-            free(table->macros[i].macro_name);
-            free(table->macros[i].macro_content);
-        }
-        free(table->macros);
-        table->macros = NULL;
+    if (!interner_find(table->names, name, &name_id)) {
+        return NULL;
     }
 
-    table->macro_count = 0;
-    table->arr_capacity = 0;
+    position = idmap_get(&table->by_name, name_id);
+    if (position < 0) {
+        return NULL;
+    }
+    return &table->macros[position];
 }
 
-Status validate_macro_name(const char* macro_name, const char* input_file_path, int line_number) {
+Status validate_macro_name(StringView macro_name, const char* input_file_path, int line_number) {
     int i = 0;
-    if (!isalpha(macro_name[0])) {
-        printf("%s:%d: macro name must start with a letter\n", input_file_path, line_number);
+    if (!isalpha((byte)macro_name.start[0])) {
+        print_diagnostic("%s:%d: macro name must start with a letter\n", input_file_path, line_number);
         return STATUS_FAILURE;
     }
-    for (i = 0; macro_name[i] != '\0'; i++) {
-        if (!isalnum(macro_name[i]) && macro_name[i] != '_') {
-            printf("%s:%d: macro name contains invalid characters\n", input_file_path, line_number);
+    for (i = 0; i < macro_name.length; i++) {
+        if (!isalnum((byte)macro_name.start[i]) && macro_name.start[i] != '_') {
+            print_diagnostic("%s:%d: macro name contains invalid characters\n", input_file_path, line_number);
             return STATUS_FAILURE;
         }
     }
-    for (i = 0; i < NUM_RESERVED_WORDS; i++) {
-        if (strcmp(macro_name, reserved_words[i]) == 0) {
-            printf("%s:%d: macro name cannot be a reserved word: %s)\n", input_file_path, line_number, reserved_words[i]);
-            return STATUS_FAILURE;
-        }
+    if (is_reserved_word(macro_name.start, macro_name.length)) {
+        print_diagnostic("%s:%d: macro name cannot be a reserved word: %.*s)\n", input_file_path, line_number, macro_name.length, macro_name.start);
+        return STATUS_FAILURE;
     }
     return STATUS_SUCCESS;
 }
 
-/* Assumes that there is only one token. (macros must be on their own line).
-   If the token is not a macro, just appends the token to output_bytearray.
-   If the token is a macro, appends the macro-content to the output_bytearray */
-Status replace_macros_in_line(MacroTable* macro_table, Tokens* tokens, ByteArray* output_bytearray) {
-    const char* macro_content = 0;
-
-    macro_content = get_macro_content(macro_table, tokens->tokens[0]);
-    if (macro_content != NULL) {
-        if (bytearray_append(output_bytearray, (byte*)macro_content, strlen(macro_content)) != STATUS_SUCCESS) {
+typedef struct {
+    LineHandler handler;
+    void* context;
+    bool emit_am;
+    int am_file; /* -1 if the .am output was not requested, or goes to 'am_stream' */
+    char* am_file_path;
+    OutputStream* am_stream;
+    /* The lines of the .am file, as views into the source file (or into 'newline').
+     * they are written with writev once the whole file was preassembled. */
+    StringView* am_lines;
+    int am_line_count;
+    int am_line_capacity;
+    long macro_expansions;
+    Arena* arena;
+} PreassemblerOutput;
+
+const char newline[] = "\n";
+
+Status preassembler_add_am_line(PreassemblerOutput* output, const char* line, int length) {
+    StringView* new_lines = NULL;
+
+    if (output->am_line_count >= output->am_line_capacity) {
+        new_lines = (StringView*)arena_resize(output->arena, output->am_lines, output->am_line_capacity * sizeof(StringView), output->am_line_capacity * 2 * sizeof(StringView));
+        if (new_lines == NULL) {
+            print_diagnostic("failed to allocate memory for the .am output\n");
             return STATUS_FAILURE;
         }
-    } else {
-        if (bytearray_append(output_bytearray, (byte*)tokens->tokens[0], strlen(tokens->tokens[0])) != STATUS_SUCCESS) {
+        output->am_lines = new_lines;
+        output->am_line_capacity *= 2;
+    }
+
+    output->am_lines[output->am_line_count].start = line;
+    output->am_lines[output->am_line_count].length = length;
+    output->am_line_count++;
+    return STATUS_SUCCESS;
+}
+
+Status preassembler_emit_line(PreassemblerOutput* output, const char* line, int length) {
+    if (output->emit_am && preassembler_add_am_line(output, line, length) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (output->handler != NULL) {
+        return output->handler(output->context, line, length);
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Emits the lines of a macro. they point into the source file, so nothing is copied. */
+Status preassembler_emit_macro(PreassemblerOutput* output, MacroTable* macro_table, MacroTableEntry* macro) {
+    StringView* lines = macro_table->lines + macro->first_line;
+    int i = 0;
+
+    output->macro_expansions++;
+    for (i = 0; i < macro->num_lines; i++) {
+        if (preassembler_emit_line(output, lines[i].start, lines[i].length) != STATUS_SUCCESS) {
             return STATUS_FAILURE;
         }
-        if (bytearray_append(output_bytearray, (byte*)"\n", 1) != STATUS_SUCCESS) {
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Assumes that there is only one token. (macros must be on their own line).
+   If the token is not a macro, just emits the token as a line.
+   If the token is a macro, emits the macro-content lines */
+Status replace_macros_in_line(MacroTable* macro_table, Tokens* tokens, PreassemblerOutput* output) {
+    MacroTableEntry* macro = NULL;
+    StringView token = tokens->tokens[0];
+
+    macro = get_macro(macro_table, token);
+    if (macro != NULL) {
+        return preassembler_emit_macro(output, macro_table, macro);
+    }
+
+    /* The line is the token without the surrounding whitespaces. the .am file gets it with a '\n' */
+    if (output->emit_am) {
+        if (preassembler_add_am_line(output, token.start, token.length) != STATUS_SUCCESS ||
+            preassembler_add_am_line(output, newline, 1) != STATUS_SUCCESS) {
             return STATUS_FAILURE;
         }
     }
 
+    if (output->handler != NULL) {
+        return output->handler(output->context, token.start, token.length);
+    }
     return STATUS_SUCCESS;
 }
 
+void report_counts(PreassembleCounts* counts, LineReader* reader, MacroTable* macro_table, PreassemblerOutput* output) {
+    if (counts != NULL) {
+        counts->lines = reader->line_number;
+        counts->bytes = reader->size;
+        counts->macros = macro_table->macro_count;
+        counts->macro_expansions = output->macro_expansions;
+    }
+}
 
-
-Status preassemble(char* input_file_path) {
-    char* output_file_path = 0;
-    ByteArray preassembled_bytearray = {0};
-    FILE* input_file = 0;
-    char* fgets_result = 0;
-    byte line[LINEBUFFER_SIZE] = {0};
+Status preassemble_reader(Arena* arena, Interner* names, LineReader* reader, char* source_name, bool emit_am, OutputStream* am_stream,
+                          LineHandler handler, void* context, PreassembleCounts* counts) {
+    PreassemblerOutput output = {0};
+    const char* line = 0;
+    int line_length = 0;
+    int content_length = 0;
+    int first_char = 0;
+    Keyword keyword;
     Tokens tokens = {0};
-    char* current_macro_name = 0;
-    ByteArray current_macro_content = {0};
+    StringView current_macro_name = {0};
+    bool is_in_macro = FALSE;
+    int current_macro_first_line = 0;
     MacroTable macro_table = {0};
     int line_number = 0;
 
-    if (validate_extension(input_file_path, "as") != STATUS_SUCCESS) {
-        goto FAILURE;
-    }
-
-    if (bytearray_init(&preassembled_bytearray) != STATUS_SUCCESS) {
-        goto FAILURE;
+    output.handler = handler;
+    output.context = context;
+    output.emit_am = emit_am;
+    output.am_file = -1;
+    output.am_stream = am_stream;
+    output.arena = arena;
+    if (emit_am) {
+        output.am_line_capacity = INITIAL_CAPACITY;
+        output.am_lines = (StringView*)arena_alloc(arena, output.am_line_capacity * sizeof(StringView));
+        if (output.am_lines == NULL) {
+            print_diagnostic("failed to allocate memory for the .am output of %s\n", source_name);
+            goto FAILURE;
+        }
     }
+    if (emit_am && am_stream == NULL) {
+        output.am_file_path = change_extension(arena, source_name, "am");
+        if (output.am_file_path == NULL) {
+            print_diagnostic("failed to change extension of %s", source_name);
+            goto FAILURE;
+        }
 
-    if (macrotable_init(&macro_table) != STATUS_SUCCESS) {
-        goto FAILURE;
+        output.am_file = open(output.am_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (output.am_file < 0) {
+            print_diagnostic("failed to open file %s for writing\n", output.am_file_path);
+            goto FAILURE;
+        }
     }
 
-    input_file = fopen(input_file_path, "rb");
-    if (input_file == NULL) {
-        printf("%s: cannot open file\n", input_file_path);
+    if (macrotable_init(&macro_table, names, arena) != STATUS_SUCCESS) {
         goto FAILURE;
     }
 
-    while (TRUE) {
-        fgets_result = fgets((char*)line, LINEBUFFER_SIZE, input_file);
-        line_number++;
 
-        if (fgets_result == NULL && !feof(input_file)) {
-            printf("%s: failed reading from file", input_file_path);
-            goto FAILURE;
-        }
-        if (fgets_result == NULL && feof(input_file)) {
-            break;
+    while (linereader_next(reader, &line, &line_length, &line_number)) {
+        content_length = line_length;
+        if (content_length > 0 && line[content_length - 1] == '\n') {
+            content_length--;
         }
-
-        if (strlen((char*)line) > MAX_LINE_SIZE && line[strlen((char*)line) - 1] != '\n') {
-            printf("%s:%d: line too long\n", input_file_path, line_number);
+        if (content_length > MAX_LINE_SIZE) {
+            print_diagnostic("%s:%d: line too long\n", source_name, line_number);
             goto FAILURE;
         }
 
-        tokens_init(&tokens, (char*)line);
-        if (tokens.size == 0) {
+        first_char = scan_skip_whitespace(line, 0, line_length);
+        if (first_char == line_length) { /* This is an empty line */
             continue;
         }
 
-        if (tokens.tokens[0][0] == ';') { /* This is a comment*/
+        if (line[first_char] == ';') { /* This is a comment*/
             continue;
         }
 
-        if (strcmp(tokens.tokens[0], "macr") == 0) {
-            if (current_macro_name != NULL) {
-                printf("%s:%d: nested macro definition\n", input_file_path, line_number);
-                goto FAILURE;
-            }
-
-            if (tokens.size != 2) {
-                printf("%s:%d: invalid macro definition\n", input_file_path, line_number);
-                goto FAILURE;
-            }
+        tokens_init(&tokens, line, line_length);
+        keyword = keyword_lookup(tokens.tokens[0].start, tokens.tokens[0].length);
 
-            if (validate_macro_name(tokens.tokens[1], input_file_path, line_number) != STATUS_SUCCESS) {
+        if (keyword.kind == KEYWORD_MACRO && keyword.id == MACRO_START) {
+            if (is_in_macro) {
+                print_diagnostic("%s:%d: nested macro definition\n", source_name, line_number);
                 goto FAILURE;
             }
 
-            current_macro_name = my_strdup(tokens.tokens[1]);
-            if (current_macro_name == NULL) {
-                printf("strdup failed\n");
+            if (tokens.size != 2) {
+                print_diagnostic("%s:%d: invalid macro definition\n", source_name, line_number);
                 goto FAILURE;
             }
 
-            if (bytearray_init(&current_macro_content) != STATUS_SUCCESS) {
+            if (validate_macro_name(tokens.tokens[1], source_name, line_number) != STATUS_SUCCESS) {
                 goto FAILURE;
             }
 
+            current_macro_name = tokens.tokens[1];
+            current_macro_first_line = macro_table.line_count;
+            is_in_macro = TRUE;
             continue;
         }
 
-        if (strcmp(tokens.tokens[0], "endmacr") == 0) {
-            if (current_macro_name == NULL) {
-                printf("%s:%d: endmacr encountered without macro definition\n", input_file_path, line_number);
+        if (keyword.kind == KEYWORD_MACRO && keyword.id == MACRO_END) {
+            if (!is_in_macro) {
+                print_diagnostic("%s:%d: endmacr encountered without macro definition\n", source_name, line_number);
                 goto FAILURE;
             }
 
             if (tokens.size != 1) {
-                printf("%s:%d: endmacr must be on a separate line\n", input_file_path, line_number);
+                print_diagnostic("%s:%d: endmacr must be on a separate line\n", source_name, line_number);
                 goto FAILURE;
             }
 
-            if (bytearray_append(&current_macro_content, (byte*)"", 1) != STATUS_SUCCESS) { /* Add null terminator to the 'current_macro_content' buffer. */
-                goto FAILURE;
-            }
-            if (add_macro(&macro_table, current_macro_name, (char*)current_macro_content.buffer) != STATUS_SUCCESS) {
-                printf("%s:%d: macro '%s' already defined\n", input_file_path, line_number, current_macro_name);
+            if (add_macro(&macro_table, current_macro_name, current_macro_first_line) != STATUS_SUCCESS) {
+                print_diagnostic("%s:%d: macro '%.*s' already defined\n", source_name, line_number, current_macro_name.length, current_macro_name.start);
                 goto FAILURE;
             }
 
-            free(current_macro_name);
-            current_macro_name = NULL;
-            bytearray_free(&current_macro_content);
+            is_in_macro = FALSE;
             continue;
         }
 
-        if (current_macro_name != NULL) { /* While in a macro, append the line to 'current_macro_contents'. */
-            if (bytearray_append(&current_macro_content, line, strlen((char*)line)) != STATUS_SUCCESS) {
+        if (is_in_macro) { /* While in a macro, add the line to the lines of the macro. */
+            if (add_macro_line(&macro_table, line, line_length) != STATUS_SUCCESS) {
                 goto FAILURE;
             }
         } else { /* If not in a macro, just append the line to the output-buffer. */
             if (tokens.size != 1) {
-                if (bytearray_append(&preassembled_bytearray, line, strlen((char*)line)) != STATUS_SUCCESS) {
+                if (preassembler_emit_line(&output, line, line_length) != STATUS_SUCCESS) {
                     goto FAILURE;
                 }
             } else {
-                if (replace_macros_in_line(&macro_table, &tokens, &preassembled_bytearray) != STATUS_SUCCESS) {
+                if (replace_macros_in_line(&macro_table, &tokens, &output) != STATUS_SUCCESS) {
                     goto FAILURE;
                 }
             }
@@ -254,42 +359,73 @@ Status preassemble(char* input_file_path) {
         }
     }
 
-    if (current_macro_name != NULL) {
-        printf("%s: unterminated macro\n", input_file_path);
+    if (is_in_macro) {
+        print_diagnostic("%s: unterminated macro\n", source_name);
         goto FAILURE;
     }
 
-    fclose(input_file);
-    input_file = NULL;
-
-    output_file_path = change_extension(input_file_path, "am");
-    if (output_file_path == NULL) {
-        printf("failed to change extension of %s", input_file_path);
-        goto FAILURE;
+    /* The lines point into the source, so they are written before the caller closes the reader */
+    if (emit_am && am_stream != NULL) {
+        if (outstream_write_views(am_stream, OUTPUT_AM, output.am_lines, output.am_line_count) != STATUS_SUCCESS) {
+            goto FAILURE;
+        }
     }
+    if (output.am_file >= 0) {
+        if (write_views(output.am_file, output.am_lines, output.am_line_count) != STATUS_SUCCESS) {
+            print_diagnostic("failed to write to file %s\n", output.am_file_path);
+            goto FAILURE;
+        }
 
-    if (write_bytearray_to_file(&preassembled_bytearray, output_file_path) != STATUS_SUCCESS) {
-        goto FAILURE;
+        if (close(output.am_file) != 0) {
+            output.am_file = -1;
+            print_diagnostic("failed to write to file %s\n", output.am_file_path);
+            remove(output.am_file_path);
+            goto FAILURE;
+        }
+        output.am_file = -1;
     }
 
-    if (input_file != NULL) {
-        fclose(input_file);
-    }
-    bytearray_free(&preassembled_bytearray);
-    bytearray_free(&current_macro_content);
-    free_macro_table(&macro_table);
-    free(current_macro_name);
-    free(output_file_path);
+    report_counts(counts, reader, &macro_table, &output);
     return STATUS_SUCCESS;
 
 FAILURE:
-    if (input_file != NULL) {
-        fclose(input_file);
-    }
-    bytearray_free(&preassembled_bytearray);
-    bytearray_free(&current_macro_content);
-    free_macro_table(&macro_table);
-    free(current_macro_name);
-    free(output_file_path);
+    report_counts(counts, reader, &macro_table, &output);
+    if (output.am_file >= 0) { /* Don't leave a partial .am file behind */
+        close(output.am_file);
+        remove(output.am_file_path);
+    }
     return STATUS_FAILURE;
 }
+
+Status preassemble_stream(Arena* arena, Interner* names, char* input_file_path, bool emit_am, OutputStream* am_stream,
+                          LineHandler handler, void* context, PreassembleCounts* counts) {
+    LineReader reader = {0};
+    Status status = STATUS_SUCCESS;
+    bool is_stdin = (strcmp(input_file_path, STDIN_PATH) == 0);
+
+    if (!is_stdin && validate_extension(input_file_path, "as") != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (linereader_open(&reader, input_file_path) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    status = preassemble_reader(arena, names, &reader, is_stdin ? STDIN_NAME : input_file_path, emit_am, am_stream, handler, context, counts);
+    linereader_close(&reader);
+    return status;
+}
+
+Status preassemble(char* input_file_path) {
+    Arena arena;
+    Interner names;
+    Status status = STATUS_SUCCESS;
+
+    arena_init(&arena);
+    status = interner_init(&names, &arena);
+    if (status == STATUS_SUCCESS) {
+        status = preassemble_stream(&arena, &names, input_file_path, TRUE, NULL, NULL, NULL, NULL);
+    }
+    arena_free(&arena);
+    return status;
+}
@@ -2,18 +2,55 @@
 #define _PREASSEMBLER_H
 
 #include "common.h"
+#include "interner.h"
+#include "outstream.h"
+#include "linereader.h"
 
+/* The lines of a macro are views into the source file, nothing is copied.
+ * they are 'num_lines' consecutive entries of the 'lines' of the table, starting at 'first_line'. */
 typedef struct macrotableentry_t {
-    char* macro_name;
-    char* macro_content;
+    unsigned int macro_name; /* the id of the name in the 'names' of the table */
+    int first_line;
+    int num_lines;
 } MacroTableEntry;
 
 typedef struct {
     MacroTableEntry* macros;
     int macro_count;
     int arr_capacity;
+    StringView* lines; /* the lines of all the macros (with their '\n') */
+    int line_count;
+    int line_capacity;
+    IdMap by_name; /* the position of every macro in 'macros', by the id of its name */
+    Interner* names;
+    Arena* arena; /* the table, and the macro names and contents, are allocated from here */
 } MacroTable;
 
+/* Receives the lines of the preassembled output, one at a time and in order.
+ * 'line' is 'length' bytes long (including the '\n', if there is one) and is only valid during the call. */
+typedef Status (*LineHandler)(void* context, const char* line, int length);
+
+/* What the preassembler went through (see stats.h). */
+typedef struct {
+    long lines;
+    long bytes;
+    long macros;
+    long macro_expansions;
+} PreassembleCounts;
+
+/* Expands the macros in 'input_file_path' ("-" is stdin) and streams the output lines into 'handler' (which may be NULL).
+ * The .am output is only produced if 'emit_am' is TRUE: to 'am_stream' if it isn't NULL, otherwise to the .am file.
+ * all the memory is allocated from 'arena', and the macro names are interned in 'names' (which the assembler shares with its labels).
+ * If 'counts' is not NULL, it gets the counts of the input (also when preassembling fails). */
+Status preassemble_stream(Arena* arena, Interner* names, char* input_file_path, bool emit_am, OutputStream* am_stream,
+                          LineHandler handler, void* context, PreassembleCounts* counts);
+
+/* Same, for a source that is already open in 'reader' (e.g. a buffer in memory), named 'source_name' in diagnostics.
+ * A requested .am file is named after 'source_name'. the reader is left open. */
+Status preassemble_reader(Arena* arena, Interner* names, LineReader* reader, char* source_name, bool emit_am, OutputStream* am_stream,
+                          LineHandler handler, void* context, PreassembleCounts* counts);
+
+/* Expands the macros in 'input_file_path' into a .am file. */
 Status preassemble(char* input_file_path);
 
 #endif
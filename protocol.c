@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "protocol.h"
+
+void socketreader_init(SocketReader* reader, int fd) {
+    reader->fd = fd;
+    reader->start = 0;
+    reader->end = 0;
+}
+
+/* Reads more bytes into the buffer (after moving the unread bytes to its start). fails at the end of the input. */
+Status socketreader_fill(SocketReader* reader) {
+    ssize_t bytes_read = 0;
+
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    do {
+        bytes_read = read(reader->fd, reader->buffer + reader->end, PROTOCOL_BUFFER_SIZE - reader->end);
+    } while (bytes_read < 0 && errno == EINTR);
+
+    if (bytes_read <= 0) {
+        return STATUS_FAILURE;
+    }
+    reader->end += bytes_read;
+    return STATUS_SUCCESS;
+}
+
+Status socketreader_read_line(SocketReader* reader, char* line, int size) {
+    char* newline = NULL;
+    int length = 0;
+
+    while ((newline = (char*)memchr(reader->buffer + reader->start, '\n', reader->end - reader->start)) == NULL) {
+        if (reader->end - reader->start >= size || socketreader_fill(reader) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+
+    length = newline - (reader->buffer + reader->start);
+    if (length >= size) {
+        return STATUS_FAILURE;
+    }
+    memcpy(line, reader->buffer + reader->start, length);
+    line[length] = '\0';
+    reader->start += length + 1;
+    return STATUS_SUCCESS;
+}
+
+Status socketreader_read(SocketReader* reader, char* out, long size) {
+    long buffered = 0;
+    ssize_t bytes_read = 0;
+
+    /* The buffered bytes first, then the rest straight into 'out' */
+    buffered = reader->end - reader->start;
+    if (buffered > size) {
+        buffered = size;
+    }
+    memcpy(out, reader->buffer + reader->start, buffered);
+    reader->start += buffered;
+
+    while (buffered < size) {
+        bytes_read = read(reader->fd, out + buffered, size - buffered);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            return STATUS_FAILURE;
+        }
+        buffered += bytes_read;
+    }
+    return STATUS_SUCCESS;
+}
+
+Status make_address(const char* path, struct sockaddr_un* address) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        printf("%s: the socket path is too long\n", path);
+        return STATUS_FAILURE;
+    }
+    strcpy(address->sun_path, path);
+    return STATUS_SUCCESS;
+}
+
+int protocol_listen(const char* path) {
+    struct sockaddr_un address;
+    int fd = -1;
+    int existing = -1;
+
+    if (make_address(path, &address) != STATUS_SUCCESS) {
+        return -1;
+    }
+
+    /* A socket file that nobody listens on is left over from a server that didn't exit cleanly */
+    existing = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (existing >= 0 && connect(existing, (struct sockaddr*)&address, sizeof(address)) == 0) {
+        printf("%s: a server is already listening on this socket\n", path);
+        close(existing);
+        return -1;
+    }
+    if (existing >= 0) {
+        close(existing);
+    }
+    unlink(path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        printf("failed to create a socket\n");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        printf("%s: failed to listen on the socket\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int protocol_connect(const char* path) {
+    struct sockaddr_un address;
+    int fd = -1;
+
+    if (make_address(path, &address) != STATUS_SUCCESS) {
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        printf("failed to create a socket\n");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        printf("%s: failed to connect to the server (is a.out --serve running?)\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,43 @@
+#ifndef _PROTOCOL_H
+#define _PROTOCOL_H
+
+#include "common.h"
+
+/* The protocol of the assembler server (a.out --serve) over a Unix domain socket.
+ * A client sends a request, and reads its whole response before sending the next one:
+ *   assemble <emit_am> <emit_obb> <size> <name>\n
+ * followed by the <size> bytes of the source. <emit_am> and <emit_obb> are 0 or 1, and <name> names the
+ * source in diagnostics (e.g. its path, it may contain spaces).
+ * The response is the outputs of the source as frames, exactly like the output of a source from stdin
+ * (see outstream.h), ending with the status frame. A request the server can't parse gets a diagnostics frame
+ * and a failed status, and the server closes the connection. */
+
+#define PROTOCOL_LINE_SIZE 4096
+#define PROTOCOL_MAX_SOURCE_SIZE (16L * 1024 * 1024)
+#define PROTOCOL_BUFFER_SIZE 65536
+
+/* Buffered reads from a socket, for the line-and-bytes framing of the protocol */
+typedef struct {
+    int fd;
+    int start; /* the unread bytes are buffer[start..end) */
+    int end;
+    char buffer[PROTOCOL_BUFFER_SIZE];
+} SocketReader;
+
+void socketreader_init(SocketReader* reader, int fd);
+
+/* Reads a line into 'line' (null-terminated, without the '\n'). fails at the end of the input,
+ * or if the line doesn't fit in 'size' bytes. */
+Status socketreader_read_line(SocketReader* reader, char* line, int size);
+
+/* Reads exactly 'size' bytes into 'out'. */
+Status socketreader_read(SocketReader* reader, char* out, long size);
+
+/* Returns a socket listening on 'path', or -1 (with an error message). a stale socket file is replaced,
+ * but a path that a server is still listening on is not. */
+int protocol_listen(const char* path);
+
+/* Returns a socket connected to the server on 'path', or -1 (with an error message). */
+int protocol_connect(const char* path);
+
+#endif
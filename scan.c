@@ -0,0 +1,183 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_HAS_SIMD
+#include <immintrin.h>
+#endif
+
+/* Classifies a block of characters: bit i of the result is set if block[i] belongs to one of 'classes'. */
+typedef unsigned int (*ScanBlockFunction)(const char* block, int classes);
+
+typedef struct {
+    const char* name;
+    int block_size; /* 0 for the scalar implementation */
+    unsigned int full_mask; /* a mask with a bit set for every character of a block */
+    ScanBlockFunction classify_block;
+} ScanImplementation;
+
+/* The classes of every character, used by the scalar implementation and for the tails of lines. */
+byte scan_class_table[256];
+
+#ifdef SCAN_HAS_SIMD
+__attribute__((target("sse2")))
+unsigned int scan_block_sse2(const char* block, int classes) {
+    __m128i chars = _mm_loadu_si128((const __m128i*)block);
+    __m128i matches = _mm_setzero_si128();
+
+    if (classes & SCAN_WHITESPACE) {
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t')));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')));
+    }
+    if (classes & SCAN_COMMA) {
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, _mm_set1_epi8(',')));
+    }
+    if (classes & SCAN_SEMICOLON) {
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, _mm_set1_epi8(';')));
+    }
+    if (classes & SCAN_COLON) {
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chars, _mm_set1_epi8(':')));
+    }
+
+    return (unsigned int)_mm_movemask_epi8(matches);
+}
+
+__attribute__((target("avx2")))
+unsigned int scan_block_avx2(const char* block, int classes) {
+    __m256i chars = _mm256_loadu_si256((const __m256i*)block);
+    __m256i matches = _mm256_setzero_si256();
+
+    if (classes & SCAN_WHITESPACE) {
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' ')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\t')));
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')));
+    }
+    if (classes & SCAN_COMMA) {
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(',')));
+    }
+    if (classes & SCAN_SEMICOLON) {
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(';')));
+    }
+    if (classes & SCAN_COLON) {
+        matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(':')));
+    }
+
+    return (unsigned int)_mm256_movemask_epi8(matches);
+}
+#endif
+
+ScanImplementation scan_scalar = {"scalar", 0, 0, NULL};
+#ifdef SCAN_HAS_SIMD
+ScanImplementation scan_sse2 = {"sse2", 16, 0xffffu, scan_block_sse2};
+ScanImplementation scan_avx2 = {"avx2", 32, 0xffffffffu, scan_block_avx2};
+#endif
+
+ScanImplementation* scan_selected = &scan_scalar;
+pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+/* Builds the class table and picks the widest implementation the CPU supports.
+ * ASM_SCAN=scalar|sse2 in the environment forces a narrower one (for testing the fallbacks). */
+void scan_init(void) {
+    const char* forced = getenv("ASM_SCAN");
+
+    memset(scan_class_table, 0, sizeof(scan_class_table));
+    scan_class_table[(byte)' '] = SCAN_WHITESPACE;
+    scan_class_table[(byte)'\t'] = SCAN_WHITESPACE;
+    scan_class_table[(byte)'\n'] = SCAN_WHITESPACE;
+    scan_class_table[(byte)','] = SCAN_COMMA;
+    scan_class_table[(byte)';'] = SCAN_SEMICOLON;
+    scan_class_table[(byte)':'] = SCAN_COLON;
+
+    scan_selected = &scan_scalar;
+#ifdef SCAN_HAS_SIMD
+    __builtin_cpu_init();
+    if (forced != NULL && strcmp(forced, "scalar") == 0) {
+        return;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        scan_selected = &scan_sse2;
+    }
+    if (forced != NULL && strcmp(forced, "sse2") == 0) {
+        return;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        scan_selected = &scan_avx2;
+    }
+#else
+    (void)forced;
+#endif
+}
+
+int scan_find(const char* line, int from, int length, int classes) {
+    ScanImplementation* implementation = NULL;
+    unsigned int mask = 0;
+    int i = from;
+
+    pthread_once(&scan_once, scan_init);
+    implementation = scan_selected;
+
+#ifdef SCAN_HAS_SIMD
+    if (implementation->block_size > 0) {
+        while (i + implementation->block_size <= length) {
+            mask = implementation->classify_block(line + i, classes);
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+            i += implementation->block_size;
+        }
+    }
+#else
+    (void)mask;
+    (void)implementation;
+#endif
+
+    for (; i < length; i++) {
+        if (scan_class_table[(byte)line[i]] & classes) {
+            return i;
+        }
+    }
+    return length;
+}
+
+int scan_skip_whitespace(const char* line, int from, int length) {
+    ScanImplementation* implementation = NULL;
+    unsigned int mask = 0;
+    int i = from;
+
+    pthread_once(&scan_once, scan_init);
+    implementation = scan_selected;
+
+#ifdef SCAN_HAS_SIMD
+    if (implementation->block_size > 0) {
+        while (i + implementation->block_size <= length) {
+            mask = ~implementation->classify_block(line + i, SCAN_WHITESPACE) & implementation->full_mask;
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+            i += implementation->block_size;
+        }
+    }
+#else
+    (void)mask;
+    (void)implementation;
+#endif
+
+    for (; i < length; i++) {
+        if (!(scan_class_table[(byte)line[i]] & SCAN_WHITESPACE)) {
+            return i;
+        }
+    }
+    return length;
+}
+
+const char* scan_implementation(void) {
+    pthread_once(&scan_once, scan_init);
+    return scan_selected->name;
+}
@@ -0,0 +1,23 @@
+#ifndef _SCAN_H
+#define _SCAN_H
+
+#include "common.h"
+
+/* Character classes for scanning source lines. they can be combined with '|'. */
+#define SCAN_WHITESPACE 1 /* ' ', '\t', '\n' (the same as is_whitespace) */
+#define SCAN_COMMA      2
+#define SCAN_SEMICOLON  4
+#define SCAN_COLON      8
+
+/* Returns the index of the first character in line[from, length) that belongs to one of 'classes',
+ * or 'length' if there is none. */
+int scan_find(const char* line, int from, int length, int classes);
+
+/* Returns the index of the first character in line[from, length) that is not a whitespace,
+ * or 'length' if there is none. */
+int scan_skip_whitespace(const char* line, int from, int length);
+
+/* The name of the implementation selected for this CPU ("avx2", "sse2" or "scalar"). */
+const char* scan_implementation(void);
+
+#endif
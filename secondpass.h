@@ -7,8 +7,9 @@
 
 
 Word make_instruction_word(byte opcode, byte src_addressing, byte dst_addressing, byte are);
-Status prepare_param_word(Assembler* assembler, const char* str, byte addressing, SrcOrDst src_or_dst, Word* out, const char* filepath, int linenumber);
-Status assembler_secondpass(Assembler* assembler, FILE* input_file, const char* preassembled_path);
+Status prepare_param_word(Assembler* assembler, StringView str, byte addressing, SrcOrDst src_or_dst, Word* out, const char* filepath, int linenumber);
+/* Resolves all the fixups recorded during the first pass, in the order they were recorded. */
+Status assembler_secondpass(Assembler* assembler, const char* preassembled_path);
   
 
 #endif
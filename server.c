@@ -0,0 +1,194 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "assembler.h"
+#include "outstream.h"
+#include "protocol.h"
+#include "server.h"
+
+typedef struct {
+    int listen_fd;
+} Server;
+
+/* Answers a request that can't be served with a diagnostic and a failed status. */
+void reject_request(int fd, const char* message) {
+    OutputStream stream;
+
+    outstream_init(&stream, fd);
+    outstream_write(&stream, OUTPUT_DIAGNOSTICS, (const byte*)message, (long)strlen(message));
+    outstream_finish(&stream, STATUS_FAILURE);
+}
+
+/* Assembles one source on the warm 'assembler', and writes its outputs, its diagnostics and its status to 'fd'.
+ * fails only if the response couldn't be written. */
+Status serve_request(Assembler* assembler, int fd, char* name, const char* source, long size, bool emit_am, bool emit_obb) {
+    OutputStream stream;
+    FILE* diagnostics = NULL;
+    char* diagnostics_buffer = NULL;
+    size_t diagnostics_size = 0;
+    Status status = STATUS_SUCCESS;
+    Status write_status = STATUS_SUCCESS;
+
+    outstream_init(&stream, fd);
+    assembler->stream = &stream;
+
+    /* The diagnostics are collected, and sent as an output of their own */
+    diagnostics = open_memstream(&diagnostics_buffer, &diagnostics_size);
+    if (diagnostics == NULL) {
+        status = STATUS_FAILURE;
+    } else {
+        diagnostics_set_stream(diagnostics);
+        status = assembler_assemble_buffer(assembler, name, source, size, emit_am, emit_obb);
+        diagnostics_set_stream(NULL);
+        fclose(diagnostics);
+    }
+
+    if (diagnostics_size > 0) {
+        write_status = outstream_write(&stream, OUTPUT_DIAGNOSTICS, (byte*)diagnostics_buffer, (long)diagnostics_size);
+    }
+    if (write_status == STATUS_SUCCESS) {
+        write_status = outstream_finish(&stream, status);
+    }
+
+    free(diagnostics_buffer);
+    assembler->stream = NULL;
+    return write_status;
+}
+
+/* Serves the requests of a connection, until the client closes it (or breaks the protocol). */
+void serve_connection(Assembler* assembler, int fd) {
+    SocketReader* reader = NULL;
+    char header[PROTOCOL_LINE_SIZE];
+    int emit_am = 0;
+    int emit_obb = 0;
+    long size = 0;
+    int name_offset = 0;
+    char* name = NULL;
+    char* source = NULL;
+
+    reader = (SocketReader*)malloc(sizeof(SocketReader));
+    if (reader == NULL) {
+        reject_request(fd, "the server failed to allocate memory for the connection\n");
+        return;
+    }
+    socketreader_init(reader, fd);
+
+    while (socketreader_read_line(reader, header, PROTOCOL_LINE_SIZE) == STATUS_SUCCESS) {
+        name_offset = 0;
+        if (sscanf(header, "assemble %d %d %ld %n", &emit_am, &emit_obb, &size, &name_offset) != 3 ||
+            name_offset == 0 || header[name_offset] == '\0' ||
+            (emit_am != 0 && emit_am != 1) || (emit_obb != 0 && emit_obb != 1)) {
+            reject_request(fd, "invalid request (should be 'assemble <emit_am> <emit_obb> <size> <name>')\n");
+            break;
+        }
+        if (size < 0 || size > PROTOCOL_MAX_SOURCE_SIZE) {
+            reject_request(fd, "the source is too large for the server\n");
+            break;
+        }
+
+        /* The source lives in the arena of the file, like everything else the request allocates */
+        if (assembler_reset(assembler) != STATUS_SUCCESS ||
+            (name = arena_strdup(&assembler->arena, header + name_offset)) == NULL ||
+            (source = (char*)arena_alloc(&assembler->arena, size > 0 ? size : 1)) == NULL) {
+            reject_request(fd, "the server failed to allocate memory for the source\n");
+            break;
+        }
+        if (socketreader_read(reader, source, size) != STATUS_SUCCESS) {
+            break;
+        }
+
+        if (serve_request(assembler, fd, name, source, size, (bool)emit_am, (bool)emit_obb) != STATUS_SUCCESS) {
+            break;
+        }
+    }
+
+    free(reader);
+}
+
+void* server_worker(void* arg) {
+    Server* server = (Server*)arg;
+    Assembler assembler;
+    int fd = -1;
+
+    if (assembler_init(&assembler) != STATUS_SUCCESS) {
+        printf("a server worker failed to start\n");
+        return NULL;
+    }
+
+    while (TRUE) {
+        fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        serve_connection(&assembler, fd);
+        close(fd);
+    }
+
+    assembler_free(&assembler);
+    return NULL;
+}
+
+Status server_run(const char* socket_path, int num_workers) {
+    Server server;
+    pthread_t* threads = NULL;
+    sigset_t signals;
+    struct sigaction ignore;
+    int num_started = 0;
+    int signal_number = 0;
+    int i = 0;
+
+    /* A client that goes away mid-response only ends its own connection */
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, NULL);
+
+    /* The workers inherit the blocked signals, so only the main thread (in sigwait) ever gets them */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    server.listen_fd = protocol_listen(socket_path);
+    if (server.listen_fd < 0) {
+        return STATUS_FAILURE;
+    }
+
+    threads = (pthread_t*)malloc(num_workers * sizeof(pthread_t));
+    if (threads == NULL) {
+        printf("failed to allocate memory for the server workers\n");
+        goto CLEANUP;
+    }
+    for (i = 0; i < num_workers; i++) {
+        if (pthread_create(&threads[i], NULL, server_worker, &server) != 0) {
+            break;
+        }
+        num_started++;
+    }
+    if (num_started == 0) {
+        printf("failed to start the server workers\n");
+        goto CLEANUP;
+    }
+
+    printf("serving on %s with %d workers\n", socket_path, num_started);
+    fflush(stdout);
+    sigwait(&signals, &signal_number);
+    printf("shutting down\n");
+
+CLEANUP:
+    /* The workers are left to the exit of the process: they may be blocked on clients that are still connected */
+    unlink(socket_path);
+    close(server.listen_fd);
+    free(threads);
+    return num_started > 0 ? STATUS_SUCCESS : STATUS_FAILURE;
+}
@@ -0,0 +1,13 @@
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include "common.h"
+
+/* Serves assemble requests (see protocol.h) on the Unix domain socket 'socket_path', until SIGINT or SIGTERM.
+ * Each of the 'num_workers' threads keeps a warm assembler (its arena, interner and tables are recycled
+ * between requests) and serves one connection at a time, so a client that keeps its connection open
+ * pays neither the process startup nor the allocations of a cold assembler on every source.
+ * The socket file is removed on exit. */
+Status server_run(const char* socket_path, int num_workers);
+
+#endif
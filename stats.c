@@ -0,0 +1,136 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+const char* stats_phase_names[STATS_NUM_PHASES] = {
+    "preassemble", "firstpass", "secondpass", "write_ob", "write_ent", "write_ext", "write_obb"
+};
+
+double read_clock(clockid_t clock) {
+    struct timespec now;
+
+    if (clock_gettime(clock, &now) != 0) {
+        return 0;
+    }
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+double stats_wall_clock(void) {
+    return read_clock(CLOCK_MONOTONIC);
+}
+
+void stats_timer_start(StatsTimer* timer, bool whole_process) {
+    timer->whole_process = whole_process;
+    timer->wall_start = stats_wall_clock();
+    timer->cpu_start = read_clock(whole_process ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID);
+}
+
+void stats_timer_stop(StatsTimer* timer, PhaseTime* time) {
+    time->wall += stats_wall_clock() - timer->wall_start;
+    time->cpu += read_clock(timer->whole_process ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID) - timer->cpu_start;
+}
+
+void stats_phase_begin(FileStats* stats, StatsTimer* timer) {
+    if (stats != NULL) {
+        stats_timer_start(timer, FALSE);
+    }
+}
+
+void stats_phase_end(FileStats* stats, StatsTimer* timer, StatsPhase phase) {
+    if (stats != NULL) {
+        stats_timer_stop(timer, &stats->phases[phase]);
+    }
+}
+
+long stats_peak_rss_kb(void) {
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss; /* in kilobytes on Linux */
+}
+
+void stats_add(FileStats* total, FileStats* stats) {
+    int i = 0;
+
+    for (i = 0; i < STATS_NUM_PHASES; i++) {
+        total->phases[i].wall += stats->phases[i].wall;
+        total->phases[i].cpu += stats->phases[i].cpu;
+    }
+    total->lines += stats->lines;
+    total->bytes += stats->bytes;
+    total->macros += stats->macros;
+    total->macro_expansions += stats->macro_expansions;
+    total->labels += stats->labels;
+    total->extern_refs += stats->extern_refs;
+    total->name_lookups += stats->name_lookups;
+    total->name_probes += stats->name_probes;
+    total->bytes_allocated += stats->bytes_allocated;
+    if (stats->peak_rss_kb > total->peak_rss_kb) {
+        total->peak_rss_kb = stats->peak_rss_kb;
+    }
+}
+
+void print_counts(FILE* out, FileStats* stats) {
+    int i = 0;
+
+    fprintf(out, "  time (ms, wall/cpu):");
+    for (i = 0; i < STATS_NUM_PHASES; i++) {
+        fprintf(out, " %s %.3f/%.3f", stats_phase_names[i], stats->phases[i].wall * 1e3, stats->phases[i].cpu * 1e3);
+    }
+    fprintf(out, "\n");
+    fprintf(out, "  %ld lines, %ld bytes, %ld macros (%ld expansions), %ld labels, %ld extern references\n",
+            stats->lines, stats->bytes, stats->macros, stats->macro_expansions, stats->labels, stats->extern_refs);
+    fprintf(out, "  %ld name lookups (%ld extra probes), %ld bytes allocated, peak RSS %ld KB\n",
+            stats->name_lookups, stats->name_probes, stats->bytes_allocated, stats->peak_rss_kb);
+}
+
+void stats_print(FILE* out, const char* path, FileStats* stats) {
+    if (stats->is_cached) {
+        fprintf(out, "%s: restored from the cache\n", path);
+        return;
+    }
+    fprintf(out, "%s:\n", path);
+    print_counts(out, stats);
+}
+
+void stats_print_total(FILE* out, FileStats* total, int num_files, PhaseTime* batch) {
+    fprintf(out, "total of %d files (%.3f ms wall, %.3f ms cpu):\n", num_files, batch->wall * 1e3, batch->cpu * 1e3);
+    print_counts(out, total);
+}
+
+void print_json_counts(FILE* out, FileStats* stats) {
+    int i = 0;
+
+    fprintf(out, "\"phases\": {");
+    for (i = 0; i < STATS_NUM_PHASES; i++) {
+        fprintf(out, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i == 0 ? "" : ", ", stats_phase_names[i],
+                stats->phases[i].wall * 1e3, stats->phases[i].cpu * 1e3);
+    }
+    fprintf(out, "}, \"lines\": %ld, \"bytes\": %ld, \"macros\": %ld, \"macro_expansions\": %ld, \"labels\": %ld, \"extern_refs\": %ld",
+            stats->lines, stats->bytes, stats->macros, stats->macro_expansions, stats->labels, stats->extern_refs);
+    fprintf(out, ", \"name_lookups\": %ld, \"name_probes\": %ld, \"bytes_allocated\": %ld, \"peak_rss_kb\": %ld",
+            stats->name_lookups, stats->name_probes, stats->bytes_allocated, stats->peak_rss_kb);
+}
+
+void stats_print_json(FILE* out, char** paths, FileStats* stats, int num_files, FileStats* total, PhaseTime* batch) {
+    int i = 0;
+
+    fprintf(out, "{\n  \"files\": [\n");
+    for (i = 0; i < num_files; i++) {
+        fprintf(out, "    {\"path\": ");
+        print_json_string(out, paths[i]);
+        fprintf(out, ", \"cached\": %s, ", stats[i].is_cached ? "true" : "false");
+        print_json_counts(out, &stats[i]);
+        fprintf(out, "}%s\n", i + 1 < num_files ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"total\": {\"files\": %d, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, ", num_files, batch->wall * 1e3, batch->cpu * 1e3);
+    print_json_counts(out, total);
+    fprintf(out, "}\n}\n");
+}
@@ -0,0 +1,72 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdio.h>
+#include "common.h"
+
+/* Statistics of assembling a file, reported by --stats / --stats-json.
+ * They are only collected when the Assembler has somewhere to put them ('stats' is not NULL). */
+
+typedef enum {
+    STATS_PHASE_PREASSEMBLE,
+    STATS_PHASE_FIRSTPASS,
+    STATS_PHASE_SECONDPASS,
+    STATS_PHASE_WRITE_OB,
+    STATS_PHASE_WRITE_ENT,
+    STATS_PHASE_WRITE_EXT,
+    STATS_PHASE_WRITE_OBB,
+    STATS_NUM_PHASES
+} StatsPhase;
+
+typedef struct {
+    double wall; /* seconds */
+    double cpu; /* seconds of the thread that ran the phase */
+} PhaseTime;
+
+typedef struct {
+    PhaseTime phases[STATS_NUM_PHASES];
+    long lines; /* of the source */
+    long bytes; /* of the source */
+    long macros;
+    long macro_expansions;
+    long labels;
+    long extern_refs; /* the operands that reference externs */
+    long name_lookups; /* the lookups of label and macro names (they share a single hash table) */
+    long name_probes; /* the slots visited by those lookups, beyond the first one */
+    long bytes_allocated;
+    long peak_rss_kb; /* of the whole process, so far */
+    bool is_cached; /* the outputs were restored from the build cache, nothing else was collected */
+} FileStats;
+
+typedef struct {
+    double wall_start;
+    double cpu_start;
+    bool whole_process; /* measure the cpu time of all the threads, rather than of the calling one */
+} StatsTimer;
+
+extern const char* stats_phase_names[STATS_NUM_PHASES];
+
+/* Seconds since an arbitrary point, for measuring intervals. */
+double stats_wall_clock(void);
+
+void stats_timer_start(StatsTimer* timer, bool whole_process);
+/* Adds the time since stats_timer_start to 'time'. */
+void stats_timer_stop(StatsTimer* timer, PhaseTime* time);
+
+/* The same, for a phase of 'stats'. both do nothing if 'stats' is NULL. */
+void stats_phase_begin(FileStats* stats, StatsTimer* timer);
+void stats_phase_end(FileStats* stats, StatsTimer* timer, StatsPhase phase);
+
+long stats_peak_rss_kb(void);
+
+/* Adds the numbers of 'stats' to 'total' (the peak RSS is the maximum of the two). */
+void stats_add(FileStats* total, FileStats* stats);
+
+void stats_print(FILE* out, const char* path, FileStats* stats);
+/* Prints the total of a batch of 'num_files' files, and 'batch', the time the whole batch took. */
+void stats_print_total(FILE* out, FileStats* total, int num_files, PhaseTime* batch);
+
+/* Writes the statistics of every file, and their total, as a JSON object. */
+void stats_print_json(FILE* out, char** paths, FileStats* stats, int num_files, FileStats* total, PhaseTime* batch);
+
+#endif
@@ -0,0 +1,7 @@
+; .entry takes exactly one label, reported by the second pass in line order
+MAIN: mov r1, r2
+.entry
+.entry MAIN, LOOP
+LOOP: jmp UNDEFINED
+.entry MAIN
+stop
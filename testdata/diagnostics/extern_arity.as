@@ -0,0 +1,7 @@
+; .extern takes exactly one label
+.extern
+.extern A, B
+.extern C D
+.extern E
+MAIN: jmp E
+stop
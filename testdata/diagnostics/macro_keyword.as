@@ -0,0 +1,6 @@
+; a macro can't be named after an instruction
+macr stop
+inc r1
+endmacr
+MAIN: mov r1, r2
+stop
@@ -0,0 +1,8 @@
+; instructions stay instructions when a macro is defined
+macr m_inc
+inc r1
+endmacr
+MAIN: mov r1, r2
+m_inc
+rts
+stop
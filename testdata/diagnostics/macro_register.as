@@ -0,0 +1,6 @@
+; nor after a register
+macr r3
+inc r1
+endmacr
+MAIN: mov r3, r2
+stop
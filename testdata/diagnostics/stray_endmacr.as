@@ -0,0 +1,5 @@
+; a rejected source only gets the preassembler's error
+MAIN: mov r1
+inc
+endmacr
+stop
@@ -0,0 +1,163 @@
+/* Assembles the same sources on several threads at once through libasm.a, every thread on a context of its own,
+ * and checks that every result is the one a single context gives. built by testdata/run_tests.sh as C99, with
+ * <stdbool.h> included first, since libasm.h must not depend on the types of the assembler. */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "libasm.h"
+
+#define NUM_SOURCES 64
+#define NUM_THREADS 4
+#define NUM_ROUNDS 20
+
+/* What a result holds, flattened into a single string */
+typedef struct {
+    char* text;
+} Expected;
+
+char* sources[NUM_SOURCES];
+Expected expected[NUM_SOURCES];
+
+/* Every source is different (its data, and whether it has externs, entries or errors) */
+char* make_source(int i) {
+    char* source = malloc(512);
+
+    if (source == NULL) {
+        return NULL;
+    }
+    sprintf(source,
+            "%s"
+            "MAIN: mov #%d, r1\n"
+            "LOOP: dec r1\n"
+            "%s"
+            "bne LOOP\n"
+            "%s"
+            "stop\n"
+            "N: .data %d, -%d\n"
+            "S: .string \"snippet%d\"\n",
+            i % 3 == 0 ? ".extern EXT\n.entry MAIN\n" : "",
+            i, i % 3 == 0 ? "jsr EXT\n" : "", i % 7 == 0 ? "mov r1\n" : "", i, i, i);
+    return source;
+}
+
+void append_buffer(char* out, const char* name, AsmBuffer buffer) {
+    char header[64];
+
+    sprintf(header, "[%s %ld]\n", name, buffer.data == NULL ? -1L : buffer.size);
+    strcat(out, header);
+    if (buffer.data != NULL) {
+        strncat(out, (const char*)buffer.data, (size_t)buffer.size);
+    }
+}
+
+/* The binary .obb output, in hex */
+void append_hex(char* out, const char* name, AsmBuffer buffer) {
+    char header[64];
+    long i = 0;
+
+    sprintf(header, "[%s %ld]\n", name, buffer.data == NULL ? -1L : buffer.size);
+    strcat(out, header);
+    out += strlen(out);
+    for (i = 0; buffer.data != NULL && i < buffer.size; i++) {
+        sprintf(out + 2 * i, "%02x", buffer.data[i]);
+    }
+}
+
+/* Flattens a result (its status, its outputs and its diagnostics) into 'out' (of 16 KB) */
+void describe(int status, AsmResult* result, char* out) {
+    int i = 0;
+
+    sprintf(out, "status %d\n", status);
+    append_buffer(out, "ob", result->object);
+    append_buffer(out, "ent", result->entries);
+    append_buffer(out, "ext", result->externs);
+    append_buffer(out, "am", result->preassembled);
+    append_hex(out, "obb", result->obb);
+    for (i = 0; i < result->num_diagnostics; i++) {
+        strcat(out, result->diagnostics[i]);
+        strcat(out, "\n");
+    }
+}
+
+void* assemble_all(void* arg) {
+    long id = (long)arg;
+    AsmContext* context = asm_context_new();
+    AsmResult result;
+    char* actual = malloc(16384);
+    long failures = 0;
+    int round = 0;
+    int i = 0;
+    int k = 0;
+    int status = 0;
+
+    if (context == NULL || actual == NULL) {
+        return (void*)1;
+    }
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        for (k = 0; k < NUM_SOURCES; k++) {
+            /* Every thread goes through the sources in an order of its own */
+            i = (int)((k * 5 + id * 11 + round) % NUM_SOURCES);
+            status = asm_assemble(context, "snippet.as", sources[i], (long)strlen(sources[i]), 1, i % 2, &result);
+            describe(status, &result, actual);
+            if (strcmp(actual, expected[i].text) != 0) {
+                if (failures == 0) {
+                    printf("thread %ld, source %d:\n%s\nexpected:\n%s\n", id, i, actual, expected[i].text);
+                }
+                failures++;
+            }
+        }
+    }
+    free(actual);
+    asm_context_free(context);
+    return (void*)failures;
+}
+
+int main(void) {
+    pthread_t threads[NUM_THREADS];
+    AsmContext* context = NULL;
+    AsmResult result;
+    void* failures = NULL;
+    long total_failures = 0;
+    int status = 0;
+    long i = 0;
+
+    context = asm_context_new();
+    if (context == NULL) {
+        printf("asm_context_new failed\n");
+        return 1;
+    }
+    for (i = 0; i < NUM_SOURCES; i++) {
+        sources[i] = make_source((int)i);
+        expected[i].text = malloc(16384);
+        if (sources[i] == NULL || expected[i].text == NULL) {
+            return 1;
+        }
+        status = asm_assemble(context, "snippet.as", sources[i], (long)strlen(sources[i]), 1, (int)(i % 2), &result);
+        describe(status, &result, expected[i].text);
+    }
+    asm_context_free(context);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        if (pthread_create(&threads[i], NULL, assemble_all, (void*)i) != 0) {
+            printf("pthread_create failed\n");
+            return 1;
+        }
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], &failures);
+        total_failures += (long)failures;
+    }
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        free(sources[i]);
+        free(expected[i].text);
+    }
+    if (total_failures > 0) {
+        printf("%ld results differ from the ones of a single context\n", total_failures);
+        return 1;
+    }
+    return 0;
+}
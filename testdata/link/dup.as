@@ -0,0 +1,3 @@
+; defines PRINT again
+	.entry PRINT
+PRINT:	rts
@@ -0,0 +1,10 @@
+; prints the characters at r1, up to the terminating 0
+	.entry PRINT
+	.entry COUNT
+PRINT:	cmp *r1, #0
+	bne CHAR
+	rts
+CHAR:	prn *r1
+	inc r1
+	jmp PRINT
+COUNT:	.data 33
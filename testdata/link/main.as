@@ -0,0 +1,9 @@
+; prints its string with PRINT of lib.as, and then the COUNT of lib.as
+	.extern PRINT
+	.extern COUNT
+	.entry MAIN
+MAIN:	lea MSG, r1
+	jsr PRINT
+	prn COUNT
+	stop
+MSG:	.string "hi"
@@ -0,0 +1,5 @@
+; no entries and no externs: only the .ob file is written
+MAIN:	mov #3, r1
+	prn r1
+	stop
+N:	.data 7, -7
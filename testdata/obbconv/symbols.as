@@ -0,0 +1,8 @@
+; a module with entries and externs, so all three textual files are written
+	.extern PRINT
+	.entry MAIN
+	.entry MSG
+MAIN:	lea MSG, r1
+	jsr PRINT
+	stop
+MSG:	.string "hi"
@@ -0,0 +1,6 @@
+; the first instruction is jsr
+	jsr FN
+	prn #66
+	stop
+FN:	prn #65
+	rts
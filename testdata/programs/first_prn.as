@@ -0,0 +1,4 @@
+; the first instruction is prn
+	prn #65
+	prn #66
+	stop
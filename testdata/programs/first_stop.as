@@ -0,0 +1,2 @@
+; the first instruction is stop: nothing is printed
+	stop
@@ -0,0 +1,6 @@
+; a store into the code: the operand of the prn at T becomes 66 before it runs
+	lea T, r2
+	inc r2
+	add #8, *r2
+T:	prn #65
+	stop
@@ -0,0 +1,6 @@
+; a store into the code turns the prn at T into an illegal instruction
+	lea T, r2
+	mov #65, r1
+	add #1, *r2
+T:	prn #65
+	stop
@@ -0,0 +1,150 @@
+#!/bin/sh
+# Runs the tests under testdata. run from the top directory after make (see 'make test'):
+#   diagnostics/<name>.as  is assembled, and what a.out prints (and its exit status) is compared to <name>.expected
+#   obbconv/<name>.as      is assembled with --emit-obb, and obbconv must convert the .obb file to the same textual
+#                          files, and the textual files to the same .obb file
+#   link/                  main and lib are linked and compared to linked.ob/.ent.expected, and the duplicate and
+#                          undefined symbol errors are compared to duplicate/undefined.expected
+#   programs/<name>.as     is assembled, run by obrun and by its ob2c translation, and what both print is compared
+#                          to <name>.expected
+#   stdin/<name>.as        is assembled from stdin, and the frames on stdout are compared to <name>.expected
+#   server                 the sources assembled through a.out --serve and asmc must give what a.out gives
+#   libasm                 libasm.a must export only the asm_ functions, libasm.h must build on its own as C99 and C++,
+#                          and libasm_threads.c (assembling on several threads at once) must build and succeed
+
+TOP=$(pwd)
+WORK=$(mktemp -d)
+failed=0
+
+trap 'rm -rf "$WORK"' EXIT
+
+# check <test> <actual> <expected>: prints "ok   <test>", or the difference between the two files
+check() {
+    if cmp -s "$2" "$3"; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1:"
+        diff "$3" "$2"
+        failed=1
+    fi
+}
+
+mkdir "$WORK/diagnostics"
+for source in testdata/diagnostics/*.as; do
+    name=$(basename "$source" .as)
+    cp "$source" "$WORK/diagnostics/$name.as"
+    (cd "$WORK/diagnostics" && "$TOP/a.out" "$name.as"; echo "exit $?") > "$WORK/diagnostics/$name.out" 2>&1
+    check "diagnostics/$name" "$WORK/diagnostics/$name.out" "testdata/diagnostics/$name.expected"
+done
+
+mkdir "$WORK/obbconv" "$WORK/obbconv/text" "$WORK/obbconv/obb"
+for source in testdata/obbconv/*.as; do
+    name=$(basename "$source" .as)
+    cp "$source" "$WORK/obbconv/$name.as"
+    ./a.out --emit-obb "$WORK/obbconv/$name.as"
+
+    cp "$WORK/obbconv/$name.obb" "$WORK/obbconv/text/"
+    ./obbconv "$WORK/obbconv/text/$name.obb"
+    for extension in ob ent ext; do
+        if [ -f "$WORK/obbconv/$name.$extension" ] || [ -f "$WORK/obbconv/text/$name.$extension" ]; then
+            check "obbconv/$name.obb -> $name.$extension" "$WORK/obbconv/text/$name.$extension" "$WORK/obbconv/$name.$extension"
+        fi
+    done
+
+    for extension in ob ent ext; do
+        if [ -f "$WORK/obbconv/$name.$extension" ]; then
+            cp "$WORK/obbconv/$name.$extension" "$WORK/obbconv/obb/"
+        fi
+    done
+    ./obbconv "$WORK/obbconv/obb/$name.ob"
+    check "obbconv/$name.ob -> $name.obb" "$WORK/obbconv/obb/$name.obb" "$WORK/obbconv/$name.obb"
+done
+
+mkdir "$WORK/link"
+cp testdata/link/*.as "$WORK/link/"
+(cd "$WORK/link" && "$TOP/a.out" main.as lib.as dup.as) > "$WORK/link/assemble.log"
+(cd "$WORK/link" && "$TOP/oblink" -o linked.ob main.ob lib.ob; echo "exit $?") > "$WORK/link/linked.out" 2>&1
+check "link/linked.ob" "$WORK/link/linked.ob" testdata/link/linked.ob.expected
+check "link/linked.ent" "$WORK/link/linked.ent" testdata/link/linked.ent.expected
+(cd "$WORK/link" && "$TOP/oblink" -o duplicate.ob main.ob lib.ob dup.ob; echo "exit $?") > "$WORK/link/duplicate.out" 2>&1
+check "link/duplicate" "$WORK/link/duplicate.out" testdata/link/duplicate.expected
+(cd "$WORK/link" && "$TOP/oblink" -o undefined.ob main.ob; echo "exit $?") > "$WORK/link/undefined.out" 2>&1
+check "link/undefined" "$WORK/link/undefined.out" testdata/link/undefined.expected
+
+PROGRAMS=testdata/programs
+mkdir "$WORK/programs"
+for source in "$PROGRAMS"/*.as; do
+    name=$(basename "$source" .as)
+    out="$WORK/programs/$name"
+    cp "$source" "$out.as"
+
+    if ! ./a.out "$out.as" > "$out.log"; then
+        echo "FAIL programs/$name: assembling failed"
+        cat "$out.log"
+        failed=1
+        continue
+    fi
+
+    ./obrun "$out.ob" > "$out.obrun" 2>&1
+    if ! cmp -s "$out.obrun" "$PROGRAMS/$name.expected"; then
+        echo "FAIL programs/$name: obrun printed:"
+        cat "$out.obrun"
+        echo
+        failed=1
+        continue
+    fi
+
+    ./ob2c "$out.ob" > "$out.log" &&
+        ${CC:-gcc} -I. -o "$out" "$out.c" libobrt.a -pthread >> "$out.log" 2>&1
+    if [ $? -ne 0 ]; then
+        echo "FAIL programs/$name: translating failed"
+        cat "$out.log"
+        failed=1
+        continue
+    fi
+
+    "$out" > "$out.ob2c" 2>&1
+    check "programs/$name" "$out.ob2c" "$PROGRAMS/$name.expected"
+done
+
+mkdir "$WORK/stdin"
+for source in testdata/stdin/*.as; do
+    name=$(basename "$source" .as)
+    ./a.out - < "$source" > "$WORK/stdin/$name.frames"
+    check "stdin/$name" "$WORK/stdin/$name.frames" "testdata/stdin/$name.expected"
+done
+
+# The server answers on a socket of its own, and is stopped (it removes the socket) when the tests are done
+mkdir "$WORK/server" "$WORK/server/a.out" "$WORK/server/asmc"
+./a.out --serve "$WORK/server/asm.sock" -j 2 > "$WORK/server/server.log" 2>&1 &
+server=$!
+for i in 1 2 3 4 5; do
+    [ -S "$WORK/server/asm.sock" ] && break
+    sleep 1
+done
+for tool in a.out asmc; do
+    cp testdata/full_test_1.as testdata/errors.as testdata/obbconv/symbols.as "$WORK/server/$tool/"
+done
+(cd "$WORK/server/a.out" && "$TOP/a.out" --emit-obb full_test_1.as errors.as symbols.as; echo "exit $?") > "$WORK/server/a.out.out" 2>&1
+(cd "$WORK/server/asmc" && "$TOP/asmc" --socket "$WORK/server/asm.sock" --emit-obb full_test_1.as errors.as symbols.as; echo "exit $?") > "$WORK/server/asmc.out" 2>&1
+kill $server
+wait $server
+check "server/diagnostics" "$WORK/server/asmc.out" "$WORK/server/a.out.out"
+for output in "$WORK/server/a.out"/*.ob "$WORK/server/a.out"/*.ent "$WORK/server/a.out"/*.ext "$WORK/server/a.out"/*.obb; do
+    check "server/$(basename "$output")" "$WORK/server/asmc/$(basename "$output")" "$output"
+done
+
+mkdir "$WORK/libasm"
+echo "exit 0" > "$WORK/libasm/success"
+nm -g --defined-only libasm.a | awk 'NF == 3 && $3 !~ /^asm_/ { print $3 }' > "$WORK/libasm/exported"
+check "libasm/exported symbols" "$WORK/libasm/exported" /dev/null
+(${CC:-gcc} -std=c99 -Wall -pedantic -I. -o "$WORK/libasm/threads" testdata/libasm_threads.c libasm.a -pthread; echo "exit $?") > "$WORK/libasm/build.out" 2>&1
+check "libasm/c99 build" "$WORK/libasm/build.out" "$WORK/libasm/success"
+("$WORK/libasm/threads"; echo "exit $?") > "$WORK/libasm/threads.out" 2>&1
+check "libasm/threads" "$WORK/libasm/threads.out" "$WORK/libasm/success"
+if command -v "${CXX:-g++}" > /dev/null; then
+    (echo '#include "libasm.h"' | "${CXX:-g++}" -Wall -fsyntax-only -x c++ -I. -; echo "exit $?") > "$WORK/libasm/c++.out" 2>&1
+    check "libasm/c++ header" "$WORK/libasm/c++.out" "$WORK/libasm/success"
+fi
+
+exit $failed
@@ -0,0 +1,3 @@
+; a diagnostics frame, and a failed status
+MAIN:	mov r1
+	stop
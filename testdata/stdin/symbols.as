@@ -0,0 +1,7 @@
+; the .ob, .ent and .ext frames, and the status
+	.extern PRINT
+	.entry MAIN
+MAIN:	lea MSG, r1
+	jsr PRINT
+	stop
+MSG:	.string "hi"
@@ -0,0 +1,183 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "stats.h"
+
+/* The TraceBuffer of the calling thread (NULL if it isn't attached) */
+pthread_key_t trace_key;
+pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+/* Set by tracer_init (before any thread is attached). lets a run without --trace skip the key lookup */
+bool is_tracing = FALSE;
+
+void trace_key_init(void) {
+    pthread_key_create(&trace_key, NULL);
+}
+
+Status tracer_init(Tracer* tracer) {
+    memset(tracer, 0, sizeof(Tracer));
+    tracer->start = stats_wall_clock();
+    if (pthread_mutex_init(&tracer->lock, NULL) != 0) {
+        print_diagnostic("failed to initialize the trace\n");
+        return STATUS_FAILURE;
+    }
+    pthread_once(&trace_key_once, trace_key_init);
+    is_tracing = TRUE;
+    return STATUS_SUCCESS;
+}
+
+void tracer_free(Tracer* tracer) {
+    int i = 0;
+
+    for (i = 0; i < tracer->num_buffers; i++) {
+        free(tracer->buffers[i]);
+    }
+    free(tracer->buffers);
+    pthread_mutex_destroy(&tracer->lock);
+    memset(tracer, 0, sizeof(Tracer));
+    is_tracing = FALSE;
+}
+
+Status trace_attach_thread(Tracer* tracer, const char* thread_name) {
+    TraceBuffer* buffer = NULL;
+    TraceBuffer** new_buffers = NULL;
+    Status status = STATUS_SUCCESS;
+
+    buffer = (TraceBuffer*)malloc(sizeof(TraceBuffer));
+    if (buffer == NULL) {
+        print_diagnostic("failed to allocate memory for the trace\n");
+        return STATUS_FAILURE;
+    }
+    buffer->count = 0;
+    strncpy(buffer->thread_name, thread_name, sizeof(buffer->thread_name) - 1);
+    buffer->thread_name[sizeof(buffer->thread_name) - 1] = '\0';
+
+    pthread_mutex_lock(&tracer->lock);
+    if (tracer->num_buffers >= tracer->capacity) {
+        new_buffers = (TraceBuffer**)realloc(tracer->buffers, (tracer->capacity * 2 + 1) * sizeof(TraceBuffer*));
+        if (new_buffers == NULL) {
+            status = STATUS_FAILURE;
+        } else {
+            tracer->buffers = new_buffers;
+            tracer->capacity = tracer->capacity * 2 + 1;
+        }
+    }
+    if (status == STATUS_SUCCESS) {
+        buffer->thread_id = tracer->num_buffers;
+        tracer->buffers[tracer->num_buffers] = buffer;
+        tracer->num_buffers++;
+    }
+    pthread_mutex_unlock(&tracer->lock);
+
+    if (status != STATUS_SUCCESS) {
+        print_diagnostic("failed to allocate memory for the trace\n");
+        free(buffer);
+        return STATUS_FAILURE;
+    }
+
+    pthread_setspecific(trace_key, buffer);
+    return STATUS_SUCCESS;
+}
+
+void trace_detach_thread(void) {
+    if (is_tracing) {
+        pthread_setspecific(trace_key, NULL);
+    }
+}
+
+void trace_record(const char* name, const char* file, char phase) {
+    TraceBuffer* buffer = NULL;
+    TraceEvent* event = NULL;
+
+    if (!is_tracing) {
+        return;
+    }
+    buffer = (TraceBuffer*)pthread_getspecific(trace_key);
+    if (buffer == NULL) {
+        return;
+    }
+
+    event = &buffer->events[buffer->count % TRACE_RING_SIZE];
+    event->name = name;
+    event->file = file;
+    event->phase = phase;
+    event->timestamp = stats_wall_clock();
+    buffer->count++;
+}
+
+void trace_begin(const char* name, const char* file) {
+    trace_record(name, file, 'B');
+}
+
+void trace_end(const char* name) {
+    trace_record(name, NULL, 'E');
+}
+
+/* Writes the events that are still in the ring of 'buffer'. ends whose beginning was overwritten are skipped. */
+void write_buffer_events(FILE* out, Tracer* tracer, TraceBuffer* buffer, bool* is_first) {
+    TraceEvent* event = NULL;
+    long first = buffer->count > TRACE_RING_SIZE ? buffer->count - TRACE_RING_SIZE : 0;
+    long i = 0;
+    int depth = 0;
+
+    for (i = first; i < buffer->count; i++) {
+        event = &buffer->events[i % TRACE_RING_SIZE];
+        if (event->phase == 'E') {
+            if (depth == 0) {
+                continue;
+            }
+            depth--;
+        } else {
+            depth++;
+        }
+
+        fprintf(out, "%s\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d",
+                *is_first ? "" : ",", event->name, event->phase, (event->timestamp - tracer->start) * 1e6, buffer->thread_id);
+        if (event->file != NULL) {
+            fprintf(out, ", \"args\": {\"file\": ");
+            print_json_string(out, event->file);
+            fprintf(out, "}");
+        }
+        fprintf(out, "}");
+        *is_first = FALSE;
+    }
+}
+
+Status tracer_write(Tracer* tracer, const char* path) {
+    FILE* out = NULL;
+    TraceBuffer* buffer = NULL;
+    bool is_first = TRUE;
+    int i = 0;
+
+    out = fopen(path, "w");
+    if (out == NULL) {
+        print_diagnostic("failed to open file %s for writing\n", path);
+        return STATUS_FAILURE;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (i = 0; i < tracer->num_buffers; i++) {
+        buffer = tracer->buffers[i];
+        fprintf(out, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ",
+                is_first ? "" : ",", buffer->thread_id);
+        print_json_string(out, buffer->thread_name);
+        fprintf(out, "}}");
+        is_first = FALSE;
+
+        write_buffer_events(out, tracer, buffer, &is_first);
+        if (buffer->count > TRACE_RING_SIZE) {
+            print_diagnostic("trace: the first %ld events of %s were overwritten\n", buffer->count - TRACE_RING_SIZE, buffer->thread_name);
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    if (fclose(out) != 0) {
+        print_diagnostic("failed to write to file %s\n", path);
+        return STATUS_FAILURE;
+    }
+    return STATUS_SUCCESS;
+}
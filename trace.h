@@ -0,0 +1,52 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <pthread.h>
+#include "common.h"
+
+/* A timeline of a run (--trace), written in the Chrome Trace Event format, for about:tracing or Perfetto.
+ *
+ * Every thread that takes part records its events into a ring buffer of its own, so recording takes no locks:
+ * once the buffer is full the oldest events are overwritten. The trace_* calls of a thread that isn't attached
+ * to a Tracer (e.g. when tracing is off) do nothing. */
+
+/* The number of events every thread keeps */
+#define TRACE_RING_SIZE 16384
+
+typedef struct {
+    const char* name; /* a string literal */
+    const char* file; /* the source the event belongs to, or NULL. must outlive the Tracer */
+    double timestamp; /* seconds since tracer_init */
+    char phase; /* 'B' (begin) or 'E' (end) */
+} TraceEvent;
+
+typedef struct {
+    TraceEvent events[TRACE_RING_SIZE];
+    long count; /* all the events recorded. the latest TRACE_RING_SIZE of them are in 'events' */
+    char thread_name[32];
+    int thread_id;
+} TraceBuffer;
+
+typedef struct {
+    TraceBuffer** buffers; /* one per attached thread */
+    int num_buffers;
+    int capacity;
+    double start;
+    pthread_mutex_t lock; /* protects 'buffers' */
+} Tracer;
+
+Status tracer_init(Tracer* tracer);
+void tracer_free(Tracer* tracer);
+
+/* Records the events of the calling thread into 'tracer', under 'thread_name', until trace_detach_thread. */
+Status trace_attach_thread(Tracer* tracer, const char* thread_name);
+void trace_detach_thread(void);
+
+/* Marks the beginning and the end of a span of the calling thread. 'file' may be NULL. */
+void trace_begin(const char* name, const char* file);
+void trace_end(const char* name);
+
+/* Writes the events of all the threads to 'path'. the threads should be done (or detached) by now. */
+Status tracer_write(Tracer* tracer, const char* path);
+
+#endif
@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "common.h"
+#include "objfile.h"
+#include "assembler.h"
+#include "emulator.h"
+#include "translator.h"
+
+/* The longest line that emit writes (the formats below are short, and their arguments are numbers) */
+#define EMIT_LINE_MAX 256
+/* The number of image words on a line of the generated source */
+#define IMAGE_WORDS_PER_LINE 8
+
+/* The opcodes, in the order of opcodeTable */
+#define OP_MOV 0
+#define OP_CMP 1
+#define OP_ADD 2
+#define OP_SUB 3
+#define OP_LEA 4
+#define OP_CLR 5
+#define OP_NOT 6
+#define OP_INC 7
+#define OP_DEC 8
+#define OP_JMP 9
+#define OP_BNE 10
+#define OP_RED 11
+#define OP_PRN 12
+#define OP_JSR 13
+#define OP_RTS 14
+#define OP_STOP 15
+
+typedef struct {
+    Emulator* emulator; /* the program, loaded (so its code is decoded) */
+    int code_start;
+    int code_end;
+    bool is_start[MAX_MEMORY_SIZE]; /* TRUE at the first word of every instruction of the code */
+    bool is_leader[MAX_MEMORY_SIZE]; /* TRUE at the first instruction of every basic block */
+    bool is_target[MAX_MEMORY_SIZE]; /* TRUE at the blocks that a jump goes to directly */
+    bool uses_dispatch; /* TRUE if there are jumps to addresses that are only known at run time (rts, jmp *r) */
+    /* The temporaries that the translated instructions use, so only those are declared */
+    bool uses_memory;
+    bool uses_src_address;
+    bool uses_dst_address;
+    bool uses_char;
+    bool uses_stack;
+} Translator;
+
+/* Appends a printf-formatted line (at most EMIT_LINE_MAX characters) to 'out'. */
+Status emit(ByteArray* out, const char* format, ...) {
+    va_list args;
+    int length = 0;
+
+    if (bytearray_reserve(out, EMIT_LINE_MAX) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    va_start(args, format);
+    length = vsprintf((char*)out->buffer + out->size, format, args);
+    va_end(args);
+
+    out->size += length;
+    return STATUS_SUCCESS;
+}
+
+/* Appends 'str' as the contents of a C string literal. */
+Status emit_escaped(ByteArray* out, const char* str) {
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            if (bytearray_append(out, (byte*)"\\", 1) != STATUS_SUCCESS) {
+                return STATUS_FAILURE;
+            }
+        }
+        if (bytearray_append(out, (byte*)str, 1) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+bool is_jump(int op) {
+    return op == OP_JMP || op == OP_BNE || op == OP_JSR;
+}
+
+bool is_store(int op) {
+    return op == OP_MOV || op == OP_ADD || op == OP_SUB || op == OP_LEA || op == OP_CLR ||
+           op == OP_NOT || op == OP_INC || op == OP_DEC || op == OP_RED;
+}
+
+/* The register that 'operand' points to, or -1 */
+int operand_register(Translator* translator, Word* operand) {
+    if (operand >= translator->emulator->registers && operand < translator->emulator->registers + REGISTERS_NUM) {
+        return operand - translator->emulator->registers;
+    }
+    return -1;
+}
+
+/* The address of the memory word that 'operand' points to, or -1 */
+int operand_address(Translator* translator, Word* operand) {
+    if (operand >= translator->emulator->memory && operand < translator->emulator->memory + MAX_MEMORY_SIZE) {
+        return operand - translator->emulator->memory;
+    }
+    return -1;
+}
+
+/* Writes the C expression of an operand to 'out': a register, a memory word, or a constant (an immediate or an address).
+ * an indirect operand is the memory word at the address in 'temporary'. */
+void operand_expression(Translator* translator, Word* operand, bool indirect, const char* temporary, char* out) {
+    if (indirect) {
+        sprintf(out, "M[%s]", temporary);
+        translator->uses_memory = TRUE;
+    } else if (operand_register(translator, operand) >= 0) {
+        sprintf(out, "r%d", operand_register(translator, operand));
+    } else if (operand_address(translator, operand) >= 0) {
+        sprintf(out, "M[%d]", operand_address(translator, operand));
+        translator->uses_memory = TRUE;
+    } else {
+        sprintf(out, "%u", (unsigned int)*operand);
+    }
+}
+
+/* Marks 'address' as the start of a block, if it's an instruction of the code */
+void mark_leader(Translator* translator, int address) {
+    if (address >= translator->code_start && address < translator->code_end && translator->is_start[address]) {
+        translator->is_leader[address] = TRUE;
+    }
+}
+
+/* Finds the instructions and the basic blocks of the code section. */
+void find_blocks(Translator* translator) {
+    DecodedInstruction* instruction = NULL;
+    int address = translator->code_start;
+
+    while (address < translator->code_end) {
+        translator->is_start[address] = TRUE;
+        address += translator->emulator->decoded[address].length;
+    }
+
+    mark_leader(translator, translator->code_start);
+    for (address = translator->code_start; address < translator->code_end; address++) {
+        if (!translator->is_start[address]) {
+            continue;
+        }
+
+        instruction = &translator->emulator->decoded[address];
+        if (is_jump(instruction->op) && operand_register(translator, instruction->dst) < 0) {
+            mark_leader(translator, *instruction->dst);
+            if (*instruction->dst < MAX_MEMORY_SIZE && translator->is_leader[*instruction->dst]) {
+                translator->is_target[*instruction->dst] = TRUE;
+            }
+        }
+        if ((is_jump(instruction->op) && operand_register(translator, instruction->dst) >= 0) || instruction->op == OP_RTS) {
+            translator->uses_dispatch = TRUE;
+        }
+        /* lea of a code label is usually the target of a later jump through a register */
+        if (instruction->op == OP_LEA) {
+            mark_leader(translator, *instruction->src);
+        }
+        if (is_jump(instruction->op) || instruction->op == OP_RTS || instruction->op == OP_STOP || instruction->op >= OPCODE_NUM) {
+            mark_leader(translator, address + instruction->length);
+        }
+    }
+}
+
+/* Emits a jump to the address in 'operand' (a register, or a constant address) */
+Status emit_jump(Translator* translator, ByteArray* out, Word* operand) {
+    int reg = operand_register(translator, operand);
+    int target = *operand;
+
+    if (reg >= 0) {
+        return emit(out, "{ pc = r%d; goto DISPATCH; }\n", reg);
+    }
+    if (target < MAX_MEMORY_SIZE && translator->is_leader[target]) {
+        return emit(out, "goto L%d;\n", target);
+    }
+    return emit(out, "FALLBACK(%d);\n", target);
+}
+
+/* Emits the C code of the instruction at 'address'. */
+Status translate_instruction(Translator* translator, ByteArray* out, int address) {
+    DecodedInstruction* instruction = &translator->emulator->decoded[address];
+    int op = instruction->op;
+    int next = address + instruction->length;
+    int dst_address = operand_address(translator, instruction->dst);
+    char src[32];
+    char dst[32];
+
+    if (op >= OPCODE_NUM) {
+        return emit(out, "    FALLBACK(%d); /* %04d: not a valid instruction */\n", address, address);
+    }
+
+    if (emit(out, "    /* %04d: %s */\n", address, opcodeTable[op].name) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    /* A store into the code would change the translated instructions, so the interpreter runs it (and what comes next) */
+    if (is_store(op) && !instruction->dst_indirect && dst_address >= translator->code_start && dst_address < translator->code_end) {
+        return emit(out, "    FALLBACK(%d); /* a store into the code */\n", address);
+    }
+
+    /* The interpreter also runs the instructions with an invalid indirect address, and reports them */
+    if (instruction->src_indirect) {
+        translator->uses_src_address = TRUE;
+        if (emit(out, "    as = r%d;\n    if (as >= %d) FALLBACK(%d);\n", operand_register(translator, instruction->src), MAX_MEMORY_SIZE, address) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+    if (instruction->dst_indirect) {
+        translator->uses_dst_address = TRUE;
+        if (emit(out, is_store(op) ? "    ad = r%d;\n    if (ad >= %d || (ad >= CODE_START && ad < CODE_END)) FALLBACK(%d);\n"
+                                   : "    ad = r%d;\n    if (ad >= %d) FALLBACK(%d);\n",
+                 operand_register(translator, instruction->dst), MAX_MEMORY_SIZE, address) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+
+    operand_expression(translator, instruction->src, instruction->src_indirect, "as", src);
+    operand_expression(translator, instruction->dst, instruction->dst_indirect, "ad", dst);
+
+    switch (op) {
+    case OP_MOV:
+    case OP_LEA:
+        return emit(out, "    %s = %s;\n", dst, src);
+    case OP_CMP:
+        return emit(out, "    z = (%s == %s);\n", src, dst);
+    case OP_ADD:
+        return emit(out, "    %s = (Word)((%s + %s) & 077777);\n", dst, dst, src);
+    case OP_SUB:
+        return emit(out, "    %s = (Word)((%s - %s) & 077777);\n", dst, dst, src);
+    case OP_CLR:
+        return emit(out, "    %s = 0;\n", dst);
+    case OP_NOT:
+        return emit(out, "    %s = (Word)(~%s & 077777);\n", dst, dst);
+    case OP_INC:
+        return emit(out, "    %s = (Word)((%s + 1) & 077777);\n", dst, dst);
+    case OP_DEC:
+        return emit(out, "    %s = (Word)((%s - 1) & 077777);\n", dst, dst);
+    case OP_JMP:
+        return emit(out, "    ") == STATUS_SUCCESS ? emit_jump(translator, out, instruction->dst) : STATUS_FAILURE;
+    case OP_BNE:
+        return emit(out, "    if (!z) ") == STATUS_SUCCESS ? emit_jump(translator, out, instruction->dst) : STATUS_FAILURE;
+    case OP_RED:
+        translator->uses_char = TRUE;
+        return emit(out, "    c = getchar();\n    %s = (Word)(c == EOF ? 077777 : c);\n", dst);
+    case OP_PRN:
+        return emit(out, "    putchar(%s & 0xff);\n", dst);
+    case OP_JSR:
+        translator->uses_stack = TRUE;
+        if (emit(out, "    if (sp >= EMULATOR_STACK_SIZE) FALLBACK(%d);\n    stack[sp++] = %d;\n    ", address, next) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+        return emit_jump(translator, out, instruction->dst);
+    case OP_RTS:
+        translator->uses_stack = TRUE;
+        return emit(out, "    if (sp == 0) FALLBACK(%d);\n    pc = stack[--sp];\n    goto DISPATCH;\n", address);
+    case OP_STOP:
+        return emit(out, "    return 0;\n");
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Emits the blocks of the code, and the switch that jumps to them by address (when it's needed).
+ * only the blocks that are jumped to get a label, the others are reached by falling through. */
+Status translate_code(Translator* translator, ByteArray* out) {
+    int address = 0;
+
+    if (translator->uses_dispatch) {
+        /* The program starts at the first block anyway, the switch is only reached by a goto */
+        if (emit(out, "    goto L%d;\n\nDISPATCH:\n    switch (pc) {\n", translator->code_start) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+        for (address = translator->code_start; address < translator->code_end; address++) {
+            if (translator->is_leader[address]) {
+                translator->is_target[address] = TRUE;
+                if (emit(out, "    case %d: goto L%d;\n", address, address) != STATUS_SUCCESS) {
+                    return STATUS_FAILURE;
+                }
+            }
+        }
+        if (emit(out, "    }\n    goto INTERPRET;\n") != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+
+    for (address = translator->code_start; address < translator->code_end; address++) {
+        if (!translator->is_start[address]) {
+            continue;
+        }
+        if (translator->is_target[address] && emit(out, "\nL%d:\n", address) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+        if (translate_instruction(translator, out, address) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+
+    /* Running past the last instruction goes on with whatever is after the code */
+    return emit(out, "    FALLBACK(%d);\n", translator->code_end);
+}
+
+/* Emits the words of the program, code first and then data. */
+Status emit_image(ObjectFile* object, ByteArray* out) {
+    int count = object->code_size + object->data_size;
+    int i = 0;
+
+    if (emit(out, "static Word image[] = {") != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    for (i = 0; i < count; i++) {
+        if (emit(out, "%s0%05o%s", i % IMAGE_WORDS_PER_LINE == 0 ? "\n    " : " ",
+                 i < object->code_size ? object->code[i] : object->data[i - object->code_size],
+                 i + 1 < count ? "," : "\n") != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+    return emit(out, "};\n\n");
+}
+
+Status emit_program(Translator* translator, ObjectFile* object, const char* name, ByteArray* code, ByteArray* out) {
+    int i = 0;
+
+    if (emit(out, "/* Translated from %.200s by ob2c. build it with the emulator runtime:\n", name) != STATUS_SUCCESS ||
+        emit(out, " *   gcc -O2 -I<assembler directory> -o <program> <this file> <assembler directory>/libobrt.a -pthread */\n") != STATUS_SUCCESS ||
+        emit(out, "#include <stdio.h>\n#include <stdlib.h>\n#include \"common.h\"\n#include \"objfile.h\"\n#include \"emulator.h\"\n\n") != STATUS_SUCCESS ||
+        emit(out, "#define CODE_START %d\n#define CODE_END %d\n", translator->code_start, translator->code_end) != STATUS_SUCCESS ||
+        emit(out, "#define FALLBACK(address) do { pc = (address); goto INTERPRET; } while (0)\n\n") != STATUS_SUCCESS ||
+        emit_image(object, out) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (emit(out, "static int run(Emulator* emulator) {\n") != STATUS_SUCCESS ||
+        (translator->uses_memory && emit(out, "    Word* M = emulator->memory;\n") != STATUS_SUCCESS) ||
+        (translator->uses_stack && emit(out, "    Word* stack = emulator->stack;\n") != STATUS_SUCCESS) ||
+        emit(out, "    int pc = %d;\n    int sp = 0;\n    int z = 0;\n", translator->code_start) != STATUS_SUCCESS ||
+        (translator->uses_src_address && emit(out, "    unsigned int as = 0;\n") != STATUS_SUCCESS) ||
+        (translator->uses_dst_address && emit(out, "    unsigned int ad = 0;\n") != STATUS_SUCCESS) ||
+        (translator->uses_char && emit(out, "    int c = 0;\n") != STATUS_SUCCESS) ||
+        emit(out, "    Word r0 = 0, r1 = 0, r2 = 0, r3 = 0, r4 = 0, r5 = 0, r6 = 0, r7 = 0;\n\n") != STATUS_SUCCESS ||
+        bytearray_append(out, code->buffer, code->size) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    /* The interpreter carries on from 'pc', with the state of the translated code */
+    if (emit(out, "\nINTERPRET:\n") != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    for (i = 0; i < REGISTERS_NUM; i++) {
+        if (emit(out, "    emulator->registers[%d] = r%d;\n", i, i) != STATUS_SUCCESS) {
+            return STATUS_FAILURE;
+        }
+    }
+    if (emit(out, "    emulator->zero = (bool)z;\n    emulator->stack_size = sp;\n    emulator->pc = pc;\n") != STATUS_SUCCESS ||
+        emit(out, "    return emulator_run(emulator) == EMULATOR_STOPPED ? 0 : 1;\n}\n\n") != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+
+    if (emit(out, "int main(void) {\n    Emulator* emulator = (Emulator*)calloc(1, sizeof(Emulator));\n    ObjectFile object = {0};\n\n") != STATUS_SUCCESS ||
+        emit(out, "    if (emulator == NULL) {\n        return 1;\n    }\n    diagnostics_set_stream(stderr);\n\n") != STATUS_SUCCESS ||
+        emit(out, "    object.load_base = %d;\n    object.code = image;\n    object.code_size = %d;\n", object->load_base, object->code_size) != STATUS_SUCCESS ||
+        emit(out, "    object.data = image + %d;\n    object.data_size = %d;\n", object->code_size, object->data_size) != STATUS_SUCCESS ||
+        emit(out, "    if (emulator_load(emulator, &object, \"") != STATUS_SUCCESS ||
+        emit_escaped(out, name) != STATUS_SUCCESS ||
+        emit(out, "\") != STATUS_SUCCESS) {\n        return 1;\n    }\n    return run(emulator);\n}\n") != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    return STATUS_SUCCESS;
+}
+
+Status translate_program(ObjectFile* object, const char* name, ByteArray* out) {
+    Translator* translator = NULL;
+    Arena arena;
+    ByteArray code = {0};
+    Status status = STATUS_FAILURE;
+
+    /* The translator holds a whole emulator, too big for the stack */
+    translator = (Translator*)calloc(1, sizeof(Translator));
+    if (translator == NULL || (translator->emulator = (Emulator*)calloc(1, sizeof(Emulator))) == NULL) {
+        print_diagnostic("failed to allocate memory for the translator\n");
+        free(translator);
+        return STATUS_FAILURE;
+    }
+
+    arena_init(&arena);
+    if (emulator_load(translator->emulator, object, name) == STATUS_SUCCESS && bytearray_init(&code, &arena) == STATUS_SUCCESS) {
+        translator->code_start = object->load_base;
+        translator->code_end = object->load_base + object->code_size;
+        find_blocks(translator);
+
+        /* The code is translated first, so the declarations only include the temporaries it uses */
+        if (translate_code(translator, &code) == STATUS_SUCCESS &&
+            emit_program(translator, object, name, &code, out) == STATUS_SUCCESS) {
+            status = STATUS_SUCCESS;
+        }
+    }
+
+    arena_free(&arena);
+    free(translator->emulator);
+    free(translator);
+    return status;
+}
@@ -0,0 +1,19 @@
+#ifndef _TRANSLATOR_H
+#define _TRANSLATOR_H
+
+#include "common.h"
+#include "objfile.h"
+
+/* Translates an assembled (and linked) program to a C program that runs it natively.
+ *
+ * Every basic block of the code section becomes straight-line C under its own label, with the registers
+ * as local variables and the memory as the Word array of an Emulator. Jumps to known blocks are gotos,
+ * rts and jumps through a register go through a switch on the address.
+ * Whatever the translation can't run - a store into the code section, a jump outside of the known blocks,
+ * an invalid instruction or address - hands the machine over to emulator_run, which carries on from there.
+ * The generated program is built with the emulator runtime (libobrt.a, see the Makefile). */
+
+/* Appends the C source of 'object' to 'out'. 'name' is only used in comments and error messages. */
+Status translate_program(ObjectFile* object, const char* name, ByteArray* out);
+
+#endif